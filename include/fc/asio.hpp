@@ -79,12 +79,15 @@ namespace asio {
           ~default_io_service_scope();
           static void     set_num_threads(uint16_t num_threads);
           static uint16_t get_num_threads();
+          /** Pins the io service threads to the given CPUs. Call it before the first use of default_io_service(). */
+          static void     set_cpu_affinity(const std::vector<int>& cpus);
           boost::asio::io_service*          io;
        private:
           std::vector<boost::thread*>       asio_threads;
           boost::asio::io_service::work*    the_work;
        protected:
           static uint16_t num_io_threads; // marked protected to help with testing
+          static std::vector<int> io_cpus;
     };
 
     /**
@@ -6,13 +6,38 @@
 
 namespace fc {
   class path;
+
+  /** How file streams and the file_appender reach the disk */
+  enum class file_io_backend {
+    blocking,    ///< in the calling thread, which stalls every fiber of that fc::thread
+    thread_pool, ///< on the "file io" worker pool, only the calling fiber waits
+    io_uring     ///< through an io_uring (Linux 5.6+), only the calling fiber waits
+  };
+
+  /**
+   *  Selects the backend of file streams opened from now on. io_uring falls
+   *  back to thread_pool where the kernel does not provide it. The
+   *  thread_pool backend uses two threads unless the worker pool named
+   *  "file io" is configured before, see configure_worker_pool().
+   *
+   *  Reads and writes of the other backends suspend the calling fiber, so
+   *  they must not be used while an exception is being handled.
+   *
+   *  @return the backend in effect
+   */
+  file_io_backend set_file_io_backend( file_io_backend backend );
+  /** @return the backend of streams opened now, blocking by default */
+  file_io_backend get_file_io_backend();
+
   class ofstream : virtual public ostream {
     public:
       ofstream();
       ofstream( const fc::path& file, std::ios_base::openmode m = std::ios_base::out | std::ios_base::binary );
       ~ofstream();
 
-      void open( const fc::path& file, std::ios_base::openmode m = std::ios_base::out | std::ios_base::binary );
+      /** @param backend used for the writes of this stream, e.g. blocking where the caller must not be suspended */
+      void open( const fc::path& file, std::ios_base::openmode m = std::ios_base::out | std::ios_base::binary,
+                 file_io_backend backend = get_file_io_backend() );
       size_t writesome( const char* buf, size_t len );
       size_t writesome(const std::shared_ptr<const char>& buffer, size_t len, size_t offset);
       void   put( char c );
@@ -1,6 +1,12 @@
 #pragma once
 #include <fc/variant.hpp>
+#include <fc/exception/exception.hpp>
 #include <fc/filesystem.hpp>
+#include <fc/reflect/reflect.hpp>
+
+#include <set>
+#include <type_traits>
+#include <utility>
 
 #define DEFAULT_MAX_RECURSION_DEPTH 200
 
@@ -41,6 +47,14 @@ namespace fc
          static variant  from_stream( buffered_istream& in, parse_type ptype = legacy_parser, uint32_t max_depth = DEFAULT_MAX_RECURSION_DEPTH );
 
          static variant  from_string( const string& utf8_str, parse_type ptype = legacy_parser, uint32_t max_depth = DEFAULT_MAX_RECURSION_DEPTH );
+         /**
+          *  Reads reflected types with json_reader, without parsing them into a variant first.
+          *  Returns the same as from_string( utf8_str, ptype, max_depth ).as<T>( max_depth ),
+          *  errors are reported as json_reader describes. Parser types that json_reader does
+          *  not support go through the variant.
+          */
+         template<typename T>
+         static T        from_string( const string& utf8_str, parse_type ptype = legacy_parser, uint32_t max_depth = DEFAULT_MAX_RECURSION_DEPTH );
          static variants variants_from_string( const string& utf8_str, parse_type ptype = legacy_parser, uint32_t max_depth = DEFAULT_MAX_RECURSION_DEPTH );
          static string   to_string( const variant& v, output_formatting format = stringify_large_ints_and_doubles, uint32_t max_depth = DEFAULT_MAX_RECURSION_DEPTH );
          static string   to_pretty_string( const variant& v, output_formatting format = stringify_large_ints_and_doubles, uint32_t max_depth = DEFAULT_MAX_RECURSION_DEPTH );
@@ -62,11 +76,9 @@ namespace fc
             return json::from_file(p, ptype, max_depth).as<T>(max_depth);
          }
 
+         /** Writes reflected types with json_writer, without converting them to a variant first */
          template<typename T>
-         static string   to_string( const T& v, output_formatting format = stringify_large_ints_and_doubles, uint32_t max_depth = DEFAULT_MAX_RECURSION_DEPTH )
-         {
-            return to_string( variant(v, max_depth), format, max_depth );
-         }
+         static string   to_string( const T& v, output_formatting format = stringify_large_ints_and_doubles, uint32_t max_depth = DEFAULT_MAX_RECURSION_DEPTH );
 
          template<typename T>
          static string   to_pretty_string( const T& v, output_formatting format = stringify_large_ints_and_doubles, uint32_t max_depth = DEFAULT_MAX_RECURSION_DEPTH )
@@ -81,6 +93,402 @@ namespace fc
          } 
    };
 
+   /**
+    *  @brief Writes values as JSON without building a variant tree for them
+    *
+    *  Classes reflected with FC_REFLECT, whose conversion to a variant is the one
+    *  of fc/reflect/variant.hpp, are written member by member, and so are their
+    *  strings, vectors and optional members. Values of all other types are
+    *  converted to a variant and written from there. The output is the same as
+    *  that of json::to_string( variant( v, max_depth ), format, max_depth ).
+    *
+    *  The JSON is appended to the string, so that one buffer can be reused for
+    *  many values. If writing fails, the buffer holds the JSON written so far.
+    */
+   class json_writer
+   {
+      public:
+         json_writer( std::string& out, json::output_formatting format = json::stringify_large_ints_and_doubles,
+                      uint32_t max_depth = DEFAULT_MAX_RECURSION_DEPTH );
+
+         template<typename T>
+         json_writer& write( const T& v )
+         {
+            write( v, _max_depth, _max_depth );
+            return *this;
+         }
+         json_writer& write( const variant& v );
+
+      private:
+         /** Whether T is written through its reflected members or enum names */
+         template<typename T>
+         struct is_reflected : detail::uses_reflected_to_variant<T> {};
+
+         template<typename T>
+         class member_writer
+         {
+            public:
+               member_writer( json_writer& w, const T& v, uint32_t depth, uint32_t stream_depth )
+               :_writer(w),_val(v),_depth(depth),_stream_depth(stream_depth),_first(true) {}
+
+               template<typename Member, class Class, Member (Class::*member)>
+               void operator()( const char* name )const
+               {
+                  add( name, _val.*member );
+               }
+
+            private:
+               template<typename M>
+               void add( const char* name, const optional<M>& v )const
+               {
+                  if( v.valid() )
+                     add( name, *v );
+               }
+               template<typename M>
+               void add( const char* name, const M& v )const
+               {
+                  if( !_first )
+                     _writer._out += ',';
+                  _first = false;
+                  _writer._out += '"';
+                  _writer._out += name;
+                  _writer._out += "\":";
+                  _writer.write( v, _depth, _stream_depth );
+               }
+
+               json_writer&   _writer;
+               const T&       _val;
+               const uint32_t _depth;
+               const uint32_t _stream_depth;
+               mutable bool   _first;
+         };
+
+         // depth is the one to_variant() would get, stream_depth the one of json::to_stream(),
+         // which differ by one below values of type optional
+         template<typename T>
+         void write( const T& v, uint32_t depth, uint32_t stream_depth )
+         {
+            write( v, depth, stream_depth, std::integral_constant< bool, is_reflected<T>::value >(),
+                   typename fc::reflector<T>::is_enum() );
+         }
+         template<typename T, typename IsEnum>
+         void write( const T& v, uint32_t depth, uint32_t stream_depth, std::false_type, IsEnum )
+         {
+            write_variant( variant( v, depth ), stream_depth );
+         }
+         template<typename T>
+         void write( const T& v, uint32_t depth, uint32_t stream_depth, std::true_type, fc::false_type )
+         {
+            _FC_ASSERT( depth > 0, "Recursion depth exceeded!" );
+            _FC_ASSERT( stream_depth > 0, "Too many nested objects!" );
+            _out += '{';
+            fc::reflector<T>::visit( member_writer<T>( *this, v, depth - 1, stream_depth - 1 ) );
+            _out += '}';
+         }
+         template<typename T>
+         void write( const T& v, uint32_t depth, uint32_t stream_depth, std::true_type, fc::true_type )
+         {
+            write( fc::reflector<T>::to_fc_string( v ), depth, stream_depth );
+         }
+         template<typename T>
+         void write( const std::vector<T>& v, uint32_t depth, uint32_t stream_depth )
+         {
+            _FC_ASSERT( depth > 0, "Recursion depth exceeded!" );
+            _FC_ASSERT( stream_depth > 0, "Too many nested objects!" );
+            _out += '[';
+            for( size_t i = 0; i < v.size(); ++i )
+            {
+               if( i )
+                  _out += ',';
+               write( v[i], depth - 1, stream_depth - 1 );
+            }
+            _out += ']';
+         }
+         template<typename T>
+         void write( const optional<T>& v, uint32_t depth, uint32_t stream_depth )
+         {
+            _FC_ASSERT( depth > 0, "Recursion depth exceeded!" );
+            if( v.valid() )
+               write( *v, depth - 1, stream_depth );
+            else
+               write_variant( variant(), stream_depth );
+         }
+         void write( const std::string& v, uint32_t depth, uint32_t stream_depth );
+         void write( const std::vector<char>& v, uint32_t depth, uint32_t stream_depth );
+         void write_variant( const variant& v, uint32_t stream_depth );
+
+         std::string&                  _out;
+         const json::output_formatting _format;
+         const uint32_t                _max_depth;
+   };
+
+   template<typename T>
+   string json::to_string( const T& v, output_formatting format, uint32_t max_depth )
+   {
+      string result;
+      json_writer( result, format, max_depth ).write( v );
+      return result;
+   }
+
+   /**
+    *  @brief Reads JSON into values without building a variant tree for them
+    *
+    *  Classes reflected with FC_REFLECT, whose conversion from a variant is the one
+    *  of fc/reflect/variant.hpp, are read member by member, and so are their strings,
+    *  vectors, sets, optional and static_variant members and time_points. Values of
+    *  all other types are parsed into a variant and converted from there, and so are
+    *  classes that reflect two members of the same name. Of duplicate keys the first
+    *  one wins, unknown keys are parsed and dropped.
+    *
+    *  Only the legacy parsers are supported. A value that was read is the same as
+    *  json::from_string( in, ptype, max_depth ).as<T>( max_depth ), and syntax errors
+    *  and exceeded depth limits raise the same exceptions. As values are converted
+    *  while they are read, a value that cannot be converted is reported before a
+    *  syntax error that follows it.
+    */
+   class json_reader
+   {
+      public:
+         /** in must outlive the reader */
+         json_reader( const std::string& in, json::parse_type ptype = json::legacy_parser,
+                      uint32_t max_depth = DEFAULT_MAX_RECURSION_DEPTH );
+
+         /** Whether json_reader can read JSON of the given parser type */
+         static bool supports( json::parse_type ptype );
+
+         template<typename T>
+         json_reader& read( T& v )
+         {
+            read( v, _max_depth, _max_depth );
+            return *this;
+         }
+
+      private:
+         /** Whether T is read through its reflected members, which takes their table */
+         template<typename T>
+         struct is_reflected
+         : std::integral_constant< bool, detail::uses_reflected_from_variant<T>::value
+                                         && detail::has_member_table<T>::value > {};
+
+         /** The functions reading the members of T, in the order of reflector<T>::members() */
+         template<typename T>
+         class member_readers
+         {
+            public:
+               typedef void (*reader)( json_reader& r, T& v, uint32_t depth, uint32_t parse_depth );
+
+               member_readers()
+               :_distinct(true)
+               {
+                  reader* next = _readers;
+                  fc::reflector<T>::visit( collector( next ) );
+                  const reflected_member_table& members = fc::reflector<T>::members();
+                  for( size_t i = 0; i < members.size(); ++i )
+                     _distinct = _distinct && members.first_index( i ) == i;
+               }
+
+               /** Whether no two members share a name */
+               bool   distinct()const                 { return _distinct; }
+               reader operator[]( size_t index )const { return _readers[index]; }
+
+            private:
+               class collector
+               {
+                  public:
+                     explicit collector( reader*& next ):_next(next){}
+
+                     template<typename Member, class Class, Member (Class::*member)>
+                     void operator()( const char* name )const
+                     {
+                        *_next++ = &read_member<Member, Class, member>;
+                     }
+
+                  private:
+                     reader*& _next;
+               };
+
+               template<typename Member, class Class, Member (Class::*member)>
+               static void read_member( json_reader& r, T& v, uint32_t depth, uint32_t parse_depth )
+               {
+                  r.read( v.*member, depth, parse_depth );
+               }
+
+               reader _readers[ fc::reflector<T>::total_member_count + 1 ];
+               bool   _distinct;
+         };
+
+         class alternative_reader
+         {
+            public:
+               typedef void result_type;
+
+               alternative_reader( json_reader& r, uint32_t depth, uint32_t parse_depth )
+               :_reader(r),_depth(depth),_parse_depth(parse_depth) {}
+
+               template<typename T>
+               void operator()( T& v )const
+               {
+                  _reader.read( v, _depth, _parse_depth );
+               }
+
+            private:
+               json_reader&   _reader;
+               const uint32_t _depth;
+               const uint32_t _parse_depth;
+         };
+
+         // depth is the one from_variant() would get, parse_depth the one of the parser,
+         // which differ by one below values of type optional
+         template<typename T>
+         void read( T& v, uint32_t depth, uint32_t parse_depth )
+         {
+            read( v, depth, parse_depth, std::integral_constant< bool, is_reflected<T>::value >(),
+                  typename fc::reflector<T>::is_enum() );
+         }
+         template<typename T, typename IsEnum>
+         void read( T& v, uint32_t depth, uint32_t parse_depth, std::false_type, IsEnum )
+         {
+            read_through_variant( v, depth, parse_depth );
+         }
+         template<typename T>
+         void read( T& v, uint32_t depth, uint32_t parse_depth, std::true_type, fc::true_type )
+         {
+            read_through_variant( v, depth, parse_depth );
+         }
+         template<typename T>
+         void read( T& v, uint32_t depth, uint32_t parse_depth, std::true_type, fc::false_type )
+         {
+            static const member_readers<T> readers;
+            if( !readers.distinct() || begin_value( parse_depth ) != '{' )
+               return read_through_variant( v, depth, parse_depth );
+            _FC_ASSERT( depth > 0, "Recursion depth exceeded!" );
+            const reflected_member_table& members = fc::reflector<T>::members();
+            bool seen[ fc::reflector<T>::total_member_count + 1 ] = {};
+            ++_pos;
+            try
+            {
+               while( next_key() )
+               {
+                  const size_t i = members.index_of( _key.data(), _key.size() );
+                  if( i < members.size() && !seen[i] )
+                  {
+                     seen[i] = true;
+                     readers[i]( *this, v, depth - 1, parse_depth - 1 );
+                  }
+                  else
+                     read_variant( parse_depth - 1 );
+               }
+            }
+            catch( const fc::eof_exception& e )
+            {
+               unexpected_eof( e );
+            }
+         }
+         template<typename T>
+         void read( std::vector<T>& v, uint32_t depth, uint32_t parse_depth )
+         {
+            if( begin_value( parse_depth ) != '[' )
+               return read_through_variant( v, depth, parse_depth );
+            _FC_ASSERT( depth > 0, "Recursion depth exceeded!" );
+            v.clear();
+            ++_pos;
+            while( next_element() )
+            {
+               T item;
+               read( item, depth - 1, parse_depth - 1 );
+               v.push_back( std::move( item ) );
+            }
+         }
+         template<typename T>
+         void read( std::set<T>& v, uint32_t depth, uint32_t parse_depth )
+         {
+            if( begin_value( parse_depth ) != '[' )
+               return read_through_variant( v, depth, parse_depth );
+            _FC_ASSERT( depth > 0, "Recursion depth exceeded!" );
+            v.clear();
+            ++_pos;
+            while( next_element() )
+            {
+               T item;
+               read( item, depth - 1, parse_depth - 1 );
+               v.insert( std::move( item ) );
+            }
+         }
+         template<typename T>
+         void read( optional<T>& v, uint32_t depth, uint32_t parse_depth )
+         {
+            const char c = begin_value( parse_depth );
+            if( c == 'n' || c == '\0' )
+               return read_through_variant( v, depth, parse_depth );
+            _FC_ASSERT( depth > 0, "Recursion depth exceeded!" );
+            v = T();
+            read( *v, depth - 1, parse_depth );
+         }
+         template<typename... T>
+         void read( static_variant<T...>& v, uint32_t depth, uint32_t parse_depth )
+         {
+            if( begin_value( parse_depth ) != '[' )
+               return read_through_variant( v, depth, parse_depth );
+            _FC_ASSERT( depth > 0, "Recursion depth exceeded!" );
+            ++_pos;
+            // arrays of less than two elements leave v as it is
+            if( !next_element() )
+               return;
+            const variant which = read_variant( parse_depth - 1 );
+            if( !next_element() )
+               return;
+            v.set_which( which.as_uint64() );
+            v.visit( alternative_reader( *this, depth - 1, parse_depth - 1 ) );
+            while( next_element() )
+               read_variant( parse_depth - 1 );
+         }
+         void read( std::vector<char>& v, uint32_t depth, uint32_t parse_depth )
+         {
+            // hex, like from_variant() expects
+            read_through_variant( v, depth, parse_depth );
+         }
+         void read( std::string& v, uint32_t depth, uint32_t parse_depth );
+         void read( time_point& v, uint32_t depth, uint32_t parse_depth );
+         void read( time_point_sec& v, uint32_t depth, uint32_t parse_depth );
+
+         template<typename T>
+         void read_through_variant( T& v, uint32_t depth, uint32_t parse_depth )
+         {
+            from_variant( read_variant( parse_depth ), v, depth );
+         }
+
+         /** Skips white space, @return the first char of the next value */
+         char    begin_value( uint32_t parse_depth );
+         variant read_variant( uint32_t parse_depth );
+         /** Reads a string at the position, with the escapes of the legacy parser */
+         void    read_string( std::string& s );
+         /** Moves on to the next key of an object and reads it into _key, @return false at its end */
+         bool    next_key();
+         /** Moves on to the next element of an array, @return false at its end */
+         bool    next_element();
+         /** Throws the parse_error_exception that the variant path throws when an object is cut off */
+         NO_RETURN static void unexpected_eof( const fc::eof_exception& e );
+
+         const char*            _pos;
+         const char* const      _end;
+         const json::parse_type _ptype;
+         const uint32_t         _max_depth;
+         std::string            _key;  // of the last next_key()
+   };
+
+   template<typename T>
+   T json::from_string( const string& utf8_str, parse_type ptype, uint32_t max_depth )
+   {
+      if( !json_reader::supports( ptype ) )
+         return from_string( utf8_str, ptype, max_depth ).as<T>( max_depth );
+      try
+      {
+         T result;
+         json_reader( utf8_str, ptype, max_depth ).read( result );
+         return result;
+      } FC_RETHROW_EXCEPTIONS( warn, "", ("str",utf8_str) )
+   }
+
 } // fc
 
 #undef DEFAULT_MAX_RECURSION_DEPTH
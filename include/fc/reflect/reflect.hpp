@@ -16,6 +16,9 @@
 #include <boost/preprocessor/stringize.hpp>
 #include <stdint.h>
 #include <string.h>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 #include <fc/reflect/typename.hpp>
 
@@ -61,11 +64,139 @@ struct reflector{
     #ifdef DOXYGEN
     template<typename Visitor>
     static inline void visit( const Visitor& v );
+
+    /** @return the number of members visit() visits, those of the bases included */
+    static constexpr size_t member_count();
+
+    /** @return the names of the members in the order of visit() */
+    static const reflected_member_table& members();
     #endif // DOXYGEN
 };
 
 void throw_bad_enum_cast( int64_t i, const char* e );
 void throw_bad_enum_cast( const char* k, const char* e );
+
+namespace detail {
+   constexpr uint64_t fnv1a( const char* s, uint64_t h )
+   {
+      return *s ? fnv1a( s + 1, ( h ^ uint8_t( *s ) ) * 1099511628211ull ) : h;
+   }
+}
+
+/** FNV-1a hash of a member name, evaluated by the compiler for the names in FC_REFLECT */
+constexpr uint64_t reflected_name_hash( const char* name )
+{
+   return detail::fnv1a( name, 14695981039346656037ull );
+}
+
+/** Same as above, for names that are not null terminated */
+inline uint64_t reflected_name_hash( const char* name, size_t length )
+{
+   uint64_t h = 14695981039346656037ull;
+   for( size_t i = 0; i < length; ++i )
+      h = ( h ^ uint8_t( name[i] ) ) * 1099511628211ull;
+   return h;
+}
+
+class variant;
+
+namespace detail {
+   namespace reflected_probe {
+      /**
+       *  As good a match as the generic to_variant() and from_variant() of
+       *  fc/reflect/variant.hpp, so that a call which would take one of those is
+       *  ambiguous here. The conversions declared in fc are found through the
+       *  variant argument. Never defined.
+       */
+      struct tag {};
+      template<typename T>
+      tag to_variant( const T& o, variant& v, uint32_t max_depth );
+      template<typename T>
+      tag from_variant( const variant& v, T& o, uint32_t max_depth );
+
+      template<typename T, typename = void>
+      struct takes_generic_to_variant : std::true_type {};
+      template<typename T>
+      struct takes_generic_to_variant< T, decltype( void( to_variant( std::declval<const T&>(),
+                                                                      std::declval<variant&>(), uint32_t() ) ) ) >
+      : std::false_type {};
+
+      template<typename T, typename = void>
+      struct takes_generic_from_variant : std::true_type {};
+      template<typename T>
+      struct takes_generic_from_variant< T, decltype( void( from_variant( std::declval<const variant&>(),
+                                                                          std::declval<T&>(), uint32_t() ) ) ) >
+      : std::false_type {};
+   }
+
+   /**
+    *  Whether to_variant() of T is the generic one of fc/reflect/variant.hpp, which
+    *  converts the reflected members or enum names, rather than one that T defines
+    *  for itself. Lets json_writer tell them apart.
+    */
+   template<typename T, bool Defined = reflector<T>::is_defined::value>
+   struct uses_reflected_to_variant : std::false_type {};
+   template<typename T>
+   struct uses_reflected_to_variant<T, true> : reflected_probe::takes_generic_to_variant<T> {};
+
+   /** Whether from_variant() into T is the generic one, see uses_reflected_to_variant */
+   template<typename T, bool Defined = reflector<T>::is_defined::value>
+   struct uses_reflected_from_variant : std::false_type {};
+   template<typename T>
+   struct uses_reflected_from_variant<T, true> : reflected_probe::takes_generic_from_variant<T> {};
+
+   /**
+    *  Whether reflector<T> has the members() table and total_member_count that
+    *  FC_REFLECT defines. A reflector written by hand may only have visit().
+    */
+   template<typename T, typename = void>
+   struct has_member_table : std::false_type {};
+   template<typename T>
+   struct has_member_table< T, decltype( void( reflector<T>::members() ),
+                                         void( size_t( reflector<T>::total_member_count ) ) ) >
+   : std::true_type {};
+}
+
+/** @brief the name of a reflected member */
+struct reflected_member
+{
+   const char* name;
+   size_t      length;
+   uint64_t    hash;
+};
+
+/**
+ *  @brief The members of a reflected class, those of its bases first, in the order
+ *  in which reflector<T>::visit() visits them.
+ *
+ *  reflector<T>::members() returns the table of T, which is built on first use.
+ *  Code that walks the members with visit() can count them to know the index of
+ *  the current one, and look up names read from a variant or JSON by index_of()
+ *  instead of comparing strings member by member.
+ */
+class reflected_member_table
+{
+   public:
+      explicit reflected_member_table( std::vector<reflected_member> members );
+
+      size_t                  size()const                   { return _members.size(); }
+      const reflected_member& operator[]( size_t index )const { return _members[index]; }
+
+      /** @return the index of the member called name, size() if there is none */
+      size_t index_of( const char* name, size_t length )const;
+      size_t index_of( const std::string& name )const { return index_of( name.data(), name.size() ); }
+
+      /**
+       *  @return the index of the first member that has the same name as the one at index,
+       *  which differs from index only where a class repeats the name of a member of its bases
+       */
+      size_t first_index( size_t index )const { return _first[index]; }
+
+   private:
+      std::vector<reflected_member> _members;
+      std::vector<uint32_t>         _first;
+      std::vector<uint32_t>         _slots; // index + 1, 0 if free
+};
 } // namespace fc
 
 
@@ -98,6 +229,12 @@ void throw_bad_enum_cast( const char* k, const char* e );
 #define FC_REFLECT_MEMBER_COUNT( r, OP, elem ) \
   OP 1
 
+#define FC_REFLECT_MEMBER_NAME( r, data, elem ) \
+  { BOOST_PP_STRINGIZE(elem), sizeof(BOOST_PP_STRINGIZE(elem)) - 1, fc::reflected_name_hash( BOOST_PP_STRINGIZE(elem) ) },
+
+#define FC_REFLECT_APPEND_BASE_MEMBERS( r, members, base ) \
+  fc::reflector<base>::append_members( members );
+
 #define FC_REFLECT_DERIVED_IMPL_INLINE( TYPE, INHERITS, MEMBERS ) \
 template<typename Visitor>\
 static inline void visit( const Visitor& v ) { \
@@ -110,6 +247,28 @@ static inline void visit_local_member( const Visitor& v, IndexType index ) { \
       BOOST_PP_SEQ_FOR_EACH_I( FC_REFLECT_VISIT_MEMBER_I, v, MEMBERS ) \
       default: break;\
    }\
+}\
+static constexpr size_t member_count() { return total_member_count; } \
+/** The members declared by TYPE itself, null terminated */ \
+static const fc::reflected_member* local_members() { \
+   static const fc::reflected_member names[] = { \
+      BOOST_PP_SEQ_FOR_EACH( FC_REFLECT_MEMBER_NAME, _, MEMBERS ) \
+      { nullptr, 0, 0 } \
+   }; \
+   return names; \
+} \
+static void append_members( std::vector<fc::reflected_member>& members ) { \
+   BOOST_PP_SEQ_FOR_EACH( FC_REFLECT_APPEND_BASE_MEMBERS, members, INHERITS ) \
+   members.insert( members.end(), local_members(), local_members() + local_member_count ); \
+} \
+static const fc::reflected_member_table& members() { \
+   static const fc::reflected_member_table table( [] () { \
+      std::vector<fc::reflected_member> members; \
+      members.reserve( total_member_count ); \
+      append_members( members ); \
+      return members; \
+   }() ); \
+   return table; \
 }
 
 #define FC_REFLECT_DERIVED_IMPL_EXT( TYPE, INHERITS, MEMBERS ) \
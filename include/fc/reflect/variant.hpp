@@ -2,6 +2,10 @@
 #include <fc/reflect/reflect.hpp>
 #include <fc/variant_object.hpp>
 
+#include <algorithm>
+#include <type_traits>
+#include <utility>
+
 namespace fc
 {
    template<typename T>
@@ -9,6 +13,30 @@ namespace fc
    template<typename T>
    void from_variant( const variant& v, T& o, uint32_t max_depth );
 
+   namespace detail
+   {
+      /**
+       *  Whether from_variant() of a V&& into T moves out of the members of a reflected
+       *  class, i.e. whether V is variant and T is converted by the from_variant() below
+       */
+      template<typename V, typename T>
+      struct moves_reflected_members : std::false_type {};
+      template<typename T>
+      struct moves_reflected_members<variant, T>
+      : std::integral_constant< bool, uses_reflected_from_variant<T>::value && !fc::reflector<T>::is_enum::value
+                                      && has_member_table<T>::value > {};
+
+      /** reflector<T>::total_member_count, or 0 if the reflector does not tell */
+      template<typename T, bool = has_member_table<T>::value>
+      struct total_member_count : std::integral_constant< size_t, 0 > {};
+      template<typename T>
+      struct total_member_count<T, true> : std::integral_constant< size_t, fc::reflector<T>::total_member_count > {};
+   }
+
+   template<typename V, typename T>
+   typename std::enable_if< detail::moves_reflected_members<V, T>::value >::type
+   from_variant( V&& v, T& o, uint32_t max_depth );
+
 
    template<typename T>
    class to_variant_visitor
@@ -41,11 +69,60 @@ namespace fc
          const uint32_t _max_depth;
    };
 
-   template<typename T>
+   /**
+    *  With Object = mutable_variant_object, the values are moved out of the object,
+    *  unless two members share a name and thus a value
+    */
+   template<typename T, typename Object = const variant_object,
+            bool HasMemberTable = detail::has_member_table<T>::value>
    class from_variant_visitor
    {
+      typedef typename std::conditional< std::is_const<Object>::value, const variant, variant >::type value_type;
+
       public:
-         from_variant_visitor( const variant_object& _vo, T& v, uint32_t max_depth )
+         from_variant_visitor( Object& _vo, T& v, uint32_t max_depth )
+         :vo(_vo),val(v),_max_depth(max_depth - 1),_members(fc::reflector<T>::members()),_index(0),
+          _move(!std::is_const<Object>::value) {
+            _FC_ASSERT( max_depth > 0, "Recursion depth exceeded!" );
+            for( size_t i = 0; _move && i < _members.size(); ++i )
+               _move = _members.first_index( i ) == i;
+            // one pass over the object finds the values of all members, the first of duplicate keys wins
+            std::fill( _values, _values + _members.size(), nullptr );
+            for( auto& e : vo )
+            {
+               const size_t i = _members.index_of( e.key() );
+               if( i < _members.size() && !_values[i] )
+                  _values[i] = &e.value();
+            }
+         }
+
+         template<typename Member, class Class, Member (Class::*member)>
+         void operator()( const char* name )const
+         {
+            value_type* value = _values[ _members.first_index( _index++ ) ];
+            if( value && _move )
+               from_variant( std::move( *value ), val.*member, _max_depth );
+            else if( value )
+               from_variant( static_cast<const variant&>( *value ), val.*member, _max_depth );
+         }
+
+         Object& vo;
+         T& val;
+         const uint32_t _max_depth;
+
+      private:
+         const reflected_member_table& _members;
+         value_type*                   _values[ fc::reflector<T>::total_member_count + 1 ];
+         mutable size_t                _index; // of the member visited next
+         bool                          _move;
+   };
+
+   /** Looks up every member by name, for reflectors without a member table */
+   template<typename T, typename Object>
+   class from_variant_visitor<T, Object, false>
+   {
+      public:
+         from_variant_visitor( Object& _vo, T& v, uint32_t max_depth )
          :vo(_vo),val(v),_max_depth(max_depth - 1) {
             _FC_ASSERT( max_depth > 0, "Recursion depth exceeded!" );
          }
@@ -55,10 +132,10 @@ namespace fc
          {
             auto itr = vo.find(name);
             if( itr != vo.end() )
-               from_variant( itr->value(), val.*member, _max_depth );
+               from_variant( static_cast<const variant&>( itr->value() ), val.*member, _max_depth );
          }
 
-         const variant_object& vo;
+         Object& vo;
          T& val;
          const uint32_t _max_depth;
    };
@@ -70,6 +147,7 @@ namespace fc
       static inline void to_variant( const T& v, fc::variant& vo, uint32_t max_depth )
       {
          mutable_variant_object mvo;
+         mvo.reserve( detail::total_member_count<T>::value );
          fc::reflector<T>::visit( to_variant_visitor<T>( mvo, v, max_depth ) );
          vo = std::move(mvo);
       }
@@ -111,4 +189,19 @@ namespace fc
    {
       if_enum<typename fc::reflector<T>::is_enum>::from_variant( v, o, max_depth );
    }
+
+   /**
+    *  Only taken for rvalue variants, and only where the conversion above would be
+    *  the one of a const variant&. The entries of the object are taken over unless
+    *  copies of it share them.
+    */
+   template<typename V, typename T>
+   typename std::enable_if< detail::moves_reflected_members<V, T>::value >::type
+   from_variant( V&& v, T& o, uint32_t max_depth )
+   {
+      if( !v.is_object() )
+         return from_variant( static_cast<const variant&>( v ), o, max_depth );
+      mutable_variant_object mvo( std::move( v.get_object() ) );
+      fc::reflector<T>::visit( from_variant_visitor<T, mutable_variant_object>( mvo, o, max_depth ) );
+   }
 }
@@ -20,8 +20,17 @@ namespace fc {
 
     protected:
       virtual ~retainable();
+      /**
+       *  for objects that are never shared between threads, the count is then kept without atomics;
+       *  debug builds assert that retain() and release() are only called on the calling thread
+       */
+      void    set_single_threaded();
     private:
       volatile int32_t _ref_count;
+      bool             _single_threaded; // fits next to _ref_count, so it does not grow the object
+#ifndef NDEBUG
+      const void*      _owner = nullptr; // identifies the thread of a single threaded object
+#endif
   };
 
   template<typename T>
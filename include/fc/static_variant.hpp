@@ -14,6 +14,7 @@
 #include <functional>
 #include <stdexcept>
 #include <typeinfo>
+#include <utility>
 
 #include <fc/array.hpp>
 #include <fc/exception/exception.hpp>
@@ -471,6 +472,20 @@ public:
       }
    };
 
+   /** Like to_static_variant, but moves out of var */
+   struct move_to_static_variant
+   {
+      variant& var;
+      const uint32_t _max_depth;
+      move_to_static_variant( variant& dv, uint32_t max_depth ):var(dv),_max_depth(max_depth){}
+
+      typedef void result_type;
+      template<typename T> void operator()( T& v )const
+      {
+         from_variant( std::move(var), v, _max_depth );
+      }
+   };
+
 
    template<typename... T> void to_variant( const fc::static_variant<T...>& s, fc::variant& v, uint32_t max_depth )
    {
@@ -488,6 +503,14 @@ public:
       s.set_which( ar[0].as_uint64() );
       s.visit( to_static_variant(ar[1], max_depth - 1) );
    }
+   template<typename... T> void from_variant( fc::variant&& v, fc::static_variant<T...>& s, uint32_t max_depth )
+   {
+      FC_ASSERT( max_depth > 0 );
+      variants& ar = v.get_array();
+      if( ar.size() < 2 ) return;
+      s.set_which( ar[0].as_uint64() );
+      s.visit( move_to_static_variant(ar[1], max_depth - 1) );
+   }
 
    template< typename... T > struct get_comma_separated_typenames;
 
@@ -0,0 +1,22 @@
+#pragma once
+#include <vector>
+
+namespace fc {
+
+   /**
+    *  Restricts the calling OS thread to the given CPUs. An empty list
+    *  allows all CPUs again. Memory that the thread touches first is then
+    *  placed on the NUMA node of those CPUs by the kernel.
+    *
+    *  @throws fc::exception if the CPU set is rejected
+    *  @note only implemented on Linux, elsewhere the call has no effect
+    */
+   void set_current_thread_affinity( const std::vector<int>& cpus );
+
+   /**
+    *  @return the CPUs of the given NUMA node, empty if the node is unknown
+    *  or the platform does not report NUMA topology
+    */
+   std::vector<int> numa_node_cpus( int node );
+
+} // namespace fc
@@ -0,0 +1,197 @@
+#pragma once
+#include <fc/exception/exception.hpp>
+#include <fc/thread/spin_yield_lock.hpp>
+#include <fc/thread/unique_lock.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace fc {
+  namespace detail {
+    struct lock_waiter;
+
+    /** Suspends and wakes the fibers that wait on a channel, independent of its item type */
+    class channel_base {
+      protected:
+        channel_base();
+        ~channel_base();
+
+        /**
+         *  Releases lock, suspends the current fiber until it is notified and
+         *  takes lock again. Callers check their condition in a loop.
+         */
+        void wait_for_space( fc::unique_lock<fc::spin_yield_lock>& lock ) { wait( m_senders, lock ); }
+        void wait_for_items( fc::unique_lock<fc::spin_yield_lock>& lock ) { wait( m_receivers, lock ); }
+
+        // called with m_lock held
+        void notify_senders( size_t n = 1 )   { notify( m_senders, n ); }
+        void notify_receivers( size_t n = 1 ) { notify( m_receivers, n ); }
+        void notify_all()                     { notify( m_senders, size_t(-1) ); notify( m_receivers, size_t(-1) ); }
+
+        mutable fc::spin_yield_lock m_lock;
+
+      private:
+        struct waiter_list
+        {
+          lock_waiter* head;
+          lock_waiter* tail;
+        };
+
+        void wait( waiter_list& list, fc::unique_lock<fc::spin_yield_lock>& lock );
+        void notify( waiter_list& list, size_t n );
+
+        waiter_list m_senders;
+        waiter_list m_receivers;
+    };
+  }
+
+  /**
+   *  @brief bounded multi-producer/multi-consumer queue for fibers
+   *
+   *  send() suspends the calling fiber while the channel is full and
+   *  receive() while it is empty, so a slow consumer pushes back on its
+   *  producers. Producers and consumers may run on any fc::thread. Items
+   *  live in a ring buffer that is allocated once.
+   *
+   *  close() lets receivers drain the remaining items and makes every later
+   *  send() fail. A fiber that is canceled while it waits on the channel
+   *  leaves it with a canceled_exception.
+   */
+  template<typename T>
+  class channel : private detail::channel_base {
+    public:
+      explicit channel( size_t capacity )
+      : m_capacity(capacity), m_items(new slot[capacity]), m_first(0), m_size(0), m_closed(false)
+      {
+        FC_ASSERT( capacity > 0, "a channel needs room for at least one item" );
+      }
+
+      ~channel()
+      {
+        while( m_size )
+          pop();
+      }
+
+      /** @throws invalid_operation_exception if the channel is closed */
+      void send( T item )
+      {
+        fc::unique_lock<fc::spin_yield_lock> lock( m_lock );
+        for( ;; )
+        {
+          if( m_closed )
+            FC_THROW_EXCEPTION( invalid_operation_exception, "send on a closed channel" );
+          if( m_size < m_capacity )
+            break;
+          wait_for_space( lock );
+        }
+        push( std::move(item) );
+        notify_receivers();
+      }
+
+      /** @return false, leaving item untouched, if the channel is full or closed */
+      bool try_send( T& item )
+      {
+        synchronized(m_lock)
+        if( m_closed || m_size == m_capacity )
+          return false;
+        push( std::move(item) );
+        notify_receivers();
+        return true;
+      }
+
+      /** @throws eof_exception once the channel is closed and drained */
+      T receive()
+      {
+        fc::unique_lock<fc::spin_yield_lock> lock( m_lock );
+        while( !m_size )
+        {
+          if( m_closed )
+            FC_THROW_EXCEPTION( eof_exception, "receive from a closed channel" );
+          wait_for_items( lock );
+        }
+        T item = pop();
+        notify_senders();
+        return item;
+      }
+
+      bool try_receive( T& item )
+      {
+        synchronized(m_lock)
+        if( !m_size )
+          return false;
+        item = pop();
+        notify_senders();
+        return true;
+      }
+
+      /**
+       *  Waits until there is at least one item and appends up to max_items
+       *  items to out, taking the lock once for the whole batch.
+       *
+       *  @return the number of items received, 0 once the channel is closed and drained
+       */
+      size_t receive_many( std::vector<T>& out, size_t max_items )
+      {
+        fc::unique_lock<fc::spin_yield_lock> lock( m_lock );
+        while( !m_size )
+        {
+          if( m_closed || !max_items )
+            return 0;
+          wait_for_items( lock );
+        }
+        const size_t n = std::min( max_items, m_size );
+        for( size_t i = 0; i < n; ++i )
+          out.push_back( pop() );
+        notify_senders( n );
+        return n;
+      }
+
+      void close()
+      {
+        synchronized(m_lock)
+        m_closed = true;
+        notify_all();
+      }
+
+      bool is_closed()const { synchronized(m_lock) return m_closed; }
+      size_t size()const    { synchronized(m_lock) return m_size; }
+      size_t capacity()const { return m_capacity; }
+
+    private:
+      typedef typename std::aligned_storage<sizeof(T), alignof(T)>::type slot;
+
+      T* at( size_t i ) { return reinterpret_cast<T*>( &m_items[i] ); }
+
+      void push( T&& item )
+      {
+        size_t last = m_first + m_size;
+        if( last >= m_capacity )
+          last -= m_capacity;
+        new (at(last)) T( std::move(item) );
+        ++m_size;
+      }
+
+      T pop()
+      {
+        T* p = at( m_first );
+        T item( std::move(*p) );
+        p->~T();
+        if( ++m_first == m_capacity )
+          m_first = 0;
+        --m_size;
+        return item;
+      }
+
+      const size_t            m_capacity;
+      std::unique_ptr<slot[]> m_items;
+      size_t                  m_first;
+      size_t                  m_size;
+      bool                    m_closed;
+  };
+
+} // namespace fc
@@ -0,0 +1,60 @@
+#pragma once
+#include <fc/thread/thread.hpp>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace fc {
+
+   /**
+    *  Controls how the stacks of fibers (fc::context) are allocated.
+    *
+    *  Stacks come from a process-wide cache: when a context is destroyed
+    *  its stack is kept for the next context on any thread, up to
+    *  max_cached stacks. Changes only affect stacks allocated afterwards,
+    *  cached stacks with the old geometry are released.
+    */
+   struct fiber_stack_config
+   {
+      /** usable bytes per stack, rounded up to whole pages */
+      size_t stack_size = FC_CONTEXT_STACK_SIZE;
+      /** idle stacks kept for reuse by the whole process */
+      size_t max_cached = 64;
+#ifdef NDEBUG
+      /** map an inaccessible page below every stack, so that an overflow crashes instead of corrupting memory */
+      bool   guard_page = false;
+#else
+      bool   guard_page = true;
+#endif
+      /** back stacks with huge pages: MAP_HUGETLB for stacks of at least one huge page without a guard page,
+       *  otherwise, or if that fails, regular pages with transparent huge pages enabled */
+      bool   huge_pages = false;
+      /** measure how deep each stack was used whenever its context becomes idle or is destroyed,
+       *  costs a scan of the stack each time, and clearing the used part of cached stacks on reuse */
+      bool   track_high_water_mark = false;
+   };
+
+   struct fiber_stack_stats
+   {
+      size_t   stack_size      = 0; ///< currently configured stack size
+      uint64_t allocations     = 0; ///< stacks mapped from the system
+      uint64_t reuses          = 0; ///< stacks taken from the cache
+      uint64_t in_use          = 0; ///< stacks owned by contexts, including idle contexts kept by threads
+      uint64_t cached          = 0; ///< idle stacks in the process-wide cache
+      size_t   high_water_mark = 0; ///< deepest use of any stack measured while tracking was enabled
+   };
+
+   void               set_fiber_stack_config( const fiber_stack_config& cfg );
+   fiber_stack_config get_fiber_stack_config();
+   fiber_stack_stats  get_fiber_stack_stats();
+
+   /**
+    *  @return the deepest use of the calling fiber's stack so far, measured
+    *  now and whenever the fiber went idle. 0 while track_high_water_mark is
+    *  off, and for the thread's own stack, which is not a fiber stack.
+    *  A fiber that already ran before tracking was enabled may report use by
+    *  an earlier fiber of the same stack.
+    */
+   size_t             get_fiber_stack_high_water_mark();
+
+} // namespace fc
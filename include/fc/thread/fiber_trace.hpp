@@ -0,0 +1,59 @@
+#pragma once
+#include <boost/atomic.hpp>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace fc {
+   class path;
+   class variant;
+
+   /**
+    *  Starts recording a timeline of the fibers of every thread: context
+    *  switches, task start and end, waits on promises, wakeups and asio
+    *  completions. Each OS thread writes into its own ring buffer of
+    *  events_per_thread entries, so only the most recent events are kept.
+    *  Events recorded before are discarded.
+    *
+    *  Task and promise descriptions are stored by address, so they must
+    *  outlive the trace, which string literals do.
+    */
+   void start_fiber_trace( size_t events_per_thread = 64 * 1024 );
+   void stop_fiber_trace();
+
+   /**
+    *  @return the recorded events in the Chrome trace event format, which
+    *  chrome://tracing and Perfetto load. Every OS thread is shown as a
+    *  process and every fiber as a thread of it. Best called after
+    *  stop_fiber_trace(), events that are overwritten while they are copied
+    *  are dropped.
+    */
+   variant get_fiber_trace();
+   void    save_fiber_trace( const fc::path& file );
+
+   namespace detail {
+      enum class trace_event_kind : uint8_t
+      {
+         context_switch,  ///< fiber is the previous context, id the next one
+         task_start,      ///< name is the task description, id the task
+         task_end,
+         wait,            ///< fiber blocks on the promise id, name is its description
+         wake,            ///< fiber was unblocked by the promise id
+         asio_completion  ///< an asio handler completed the promise id, arg is the byte count
+      };
+
+      extern boost::atomic<bool> fiber_trace_enabled;
+
+      void record_trace_event( trace_event_kind kind, const char* name, const void* id,
+                               const void* fiber, uint64_t arg = 0 );
+
+      /** Costs a relaxed load while tracing is off */
+      inline void trace( trace_event_kind kind, const char* name, const void* id,
+                         const void* fiber, uint64_t arg = 0 )
+      {
+         if( fiber_trace_enabled.load( boost::memory_order_relaxed ) )
+            record_trace_event( kind, name, id, fiber, arg );
+      }
+   }
+
+} // namespace fc
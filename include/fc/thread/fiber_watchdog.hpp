@@ -0,0 +1,73 @@
+#pragma once
+#include <fc/time.hpp>
+#include <boost/atomic.hpp>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace fc {
+   class variant;
+
+   struct fiber_watchdog_options
+   {
+      /** a fiber or task that runs longer than this without yielding is reported */
+      microseconds slice_budget = milliseconds(50);
+      /**
+       *  Also run a monitor thread that reports slices while they are still
+       *  running, which catches fibers that never yield again. It wakes up
+       *  twice per slice_budget. Without it, a thread is still started to
+       *  log the warnings, unless log_interval is 0.
+       */
+      bool         monitor = false;
+      /** the monitor samples the stack of a thread that is stuck in a slice (Linux only, uses SIGPROF) */
+      bool         sample_stacks = false;
+      /** at most one warning is logged per interval, the others are counted; 0 disables the log */
+      microseconds log_interval = seconds(10);
+      /** number of reports kept for get_long_slices() */
+      size_t       history = 64;
+   };
+
+   /**
+    *  Checks the time between two context switches of every fc::thread:
+    *  fibers are never preempted, so a fiber that runs for long without
+    *  yielding stalls every other fiber of its thread. Every switch then
+    *  costs a clock read.
+    *
+    *  Slices over budget are counted in fc::thread::get_stats() (long_slices
+    *  and max_long_slice_us), kept for get_long_slices() and logged with
+    *  rate limiting. The warnings are logged from the watchdog's own thread,
+    *  never from within the scheduler. Restarting the watchdog applies new
+    *  options.
+    */
+   void start_fiber_watchdog( const fiber_watchdog_options& options = fiber_watchdog_options() );
+   void stop_fiber_watchdog();
+
+   /**
+    *  @return the most recent slices over budget, newest first, with thread
+    *  name, task description, duration_us, whether the slice was still
+    *  running when it was reported and, from the monitor, the sampled stack
+    */
+   variant get_long_slices();
+
+   namespace detail {
+      extern boost::atomic<bool> fiber_watchdog_enabled;
+
+      int64_t end_slice( const char* next_desc );
+
+      /**
+       *  Ends the slice of the fiber or task that ran so far and starts one
+       *  for next_desc, or none if next_desc is null because the thread goes
+       *  idle. Costs a relaxed load while the watchdog is off.
+       *
+       *  @return the length of the ended slice in microseconds if it was
+       *  over budget, otherwise 0
+       */
+      inline int64_t watchdog_slice( const char* next_desc )
+      {
+         if( fiber_watchdog_enabled.load( boost::memory_order_relaxed ) )
+            return end_slice( next_desc );
+         return 0;
+      }
+   }
+
+} // namespace fc
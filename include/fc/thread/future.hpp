@@ -3,8 +3,13 @@
 #include <fc/shared_ptr.hpp>
 #include <fc/exception/exception.hpp>
 #include <fc/thread/spin_yield_lock.hpp>
+#include <fc/thread/object_pool.hpp>
 #include <fc/optional.hpp>
 
+#include <memory>
+#include <type_traits>
+#include <utility>
+
 //#define FC_TASK_NAMES_ARE_MANDATORY 1
 #ifdef FC_TASK_NAMES_ARE_MANDATORY
 # define FC_TASK_NAME_DEFAULT_ARG
@@ -21,14 +26,28 @@
 
 namespace fc {
   struct void_t{};
+
+  /**
+   *  Tag for a promise that is created, completed and waited on by the
+   *  current fc::thread only, e.g. a result that one fiber hands to another
+   *  fiber of the same thread. Such a promise skips its spin lock and keeps
+   *  a plain reference count. Debug builds assert that it is not used from
+   *  another thread; it must not be passed to then() with an executor on
+   *  another thread either.
+   */
+  struct single_thread_t{};
+  const single_thread_t single_thread = single_thread_t();
   class priority;
   class thread;
 
   namespace detail {
      class completion_handler {
        public:
+          completion_handler():next(nullptr){}
           virtual ~completion_handler(){};
           virtual void on_complete( const void* v, const fc::exception_ptr& e ) = 0;
+
+          completion_handler* next; // handlers of one promise are kept in a list
      };
      
      template<typename Functor, typename T>
@@ -60,6 +79,7 @@ namespace fc {
     public:
       typedef fc::shared_ptr<promise_base> ptr;
       promise_base(const char* desc FC_TASK_NAME_DEFAULT_ARG);
+      promise_base(single_thread_t, const char* desc FC_TASK_NAME_DEFAULT_ARG);
 
       const char* get_desc()const;
                    
@@ -70,25 +90,36 @@ namespace fc {
 
       void set_exception( const fc::exception_ptr& e );
 
+      /** promises and tasks are allocated from the object pool */
+      static void* operator new( std::size_t size ) { return detail::pool_allocate( size ); }
+      static void  operator delete( void* p, std::size_t size ) { detail::pool_free( p, size ); }
+
     protected:
       void _wait( const microseconds& timeout_us );
       void _wait_until( const time_point& timeout_us );
       void _enqueue_thread();
       void _dequeue_thread();
-      void _notify();
+      /** @return the thread that deferred a direct handoff to the woken fiber, see thread::notify() */
+      thread* _notify();
       void _set_timeout();
       void _set_value(const void* v);
 
-      void _on_complete( detail::completion_handler* c );
+      /** @return false if the promise is ready already, in which case c was not queued */
+      bool _on_complete( detail::completion_handler* c );
+      const fc::exception_ptr& _exception()const { return _exceptp; }
       ~promise_base();
 
+      /** asserts in debug builds that a single_thread promise stays on its thread */
+      void _check_owner()const;
+
     private:
       friend class  thread;
       friend struct context;
       friend class  thread_d;
 
       bool                        _ready;
-      mutable spin_yield_lock     _spin_yield;
+      mutable spin_yield_lock     _spin_yield;  // unused by single_thread promises
+      thread*                     _owner;       // the thread of a single_thread promise, else null
       thread*                     _blocked_thread;
       unsigned                    _blocked_fiber_count;
       time_point                  _timeout;
@@ -108,6 +139,7 @@ namespace fc {
     public:
       typedef fc::shared_ptr< promise<T> > ptr;
       promise( const char* desc FC_TASK_NAME_DEFAULT_ARG):promise_base(desc){}
+      promise( single_thread_t st, const char* desc FC_TASK_NAME_DEFAULT_ARG):promise_base(st,desc){}
       promise( const T& val ){ set_value(val); }
       promise( T&& val ){ set_value(std::move(val) ); }
     
@@ -132,7 +164,13 @@ namespace fc {
 
       template<typename CompletionHandler>
       void on_complete( CompletionHandler&& c ) {
-        _on_complete( new detail::completion_handler_impl<CompletionHandler,T>(fc::forward<CompletionHandler>(c)) );
+        typedef typename std::decay<CompletionHandler>::type handler_type;
+        detail::completion_handler* h = new detail::completion_handler_impl<handler_type,T>( fc::forward<CompletionHandler>(c) );
+        if( !_on_complete( h ) )
+        {
+          std::unique_ptr<detail::completion_handler> ready_handler( h );
+          ready_handler->on_complete( _exception() ? nullptr : &*result, _exception() );
+        }
       }
     protected:
       optional<T> result;
@@ -144,6 +182,7 @@ namespace fc {
     public:
       typedef fc::shared_ptr< promise<void> > ptr;
       promise( const char* desc FC_TASK_NAME_DEFAULT_ARG):promise_base(desc){}
+      promise( single_thread_t st, const char* desc FC_TASK_NAME_DEFAULT_ARG):promise_base(st,desc){}
       promise( bool fulfilled, const char* desc FC_TASK_NAME_DEFAULT_ARG ){
           if( fulfilled ) set_value();
       }
@@ -160,11 +199,119 @@ namespace fc {
 
       template<typename CompletionHandler>
       void on_complete( CompletionHandler&& c ) {
-        _on_complete( new detail::completion_handler_impl<CompletionHandler,void>(fc::forward<CompletionHandler>(c)) );
+        typedef typename std::decay<CompletionHandler>::type handler_type;
+        detail::completion_handler* h = new detail::completion_handler_impl<handler_type,void>( fc::forward<CompletionHandler>(c) );
+        if( !_on_complete( h ) )
+        {
+          std::unique_ptr<detail::completion_handler> ready_handler( h );
+          ready_handler->on_complete( nullptr, _exception() );
+        }
       }
     protected:
       ~promise(){}
   };
+
+  namespace detail {
+     /**
+      *  Work that runs once a future is ready, see future<T>::then(). Its
+      *  target promise is completed with the result or with the exception
+      *  that the work throws.
+      */
+     class continuation {
+       public:
+          explicit continuation( const promise_base::ptr& target ):_target(target){}
+          /** completes the target with a canceled_exception if the work never ran */
+          virtual ~continuation();
+
+          void run();
+          void fail( const fc::exception_ptr& e ) { _target->set_exception( e ); }
+          /** called before the continuation is posted, when the input must outlive the handler */
+          virtual void keep_input(){}
+
+       protected:
+          virtual void invoke() = 0;
+
+          promise_base::ptr _target;
+     };
+
+     /**
+      *  Runs c right away if executor is null or the current thread,
+      *  otherwise posts it to executor. Takes ownership of c.
+      */
+     void dispatch_continuation( thread* executor, continuation* c, const char* desc );
+
+     template<typename R>
+     struct set_result {
+        template<typename Functor, typename... Args>
+        static void call( promise<R>& p, Functor& f, const Args&... args ) { p.set_value( f(args...) ); }
+     };
+     template<>
+     struct set_result<void> {
+        template<typename Functor, typename... Args>
+        static void call( promise<void>& p, Functor& f, const Args&... args ) { f(args...); p.set_value(); }
+     };
+
+     template<typename Functor, typename T, typename R>
+     class then_continuation : public continuation {
+       public:
+          template<typename F>
+          then_continuation( F&& f, const typename promise<R>::ptr& r )
+          :continuation(r),_func(fc::forward<F>(f)),_result(r),_input(nullptr){}
+
+          void set_input( const T& v ) { _input = &v; }
+          virtual void keep_input() { _kept = *_input; _input = &*_kept; }
+
+       protected:
+          virtual void invoke() { set_result<R>::call( *_result, _func, *_input ); }
+
+       private:
+          Functor                     _func;
+          typename promise<R>::ptr    _result;
+          const T*                    _input; // the value of the completed promise, or _kept
+          fc::optional<T>             _kept;
+     };
+
+     template<typename Functor, typename R>
+     class then_continuation<Functor,void,R> : public continuation {
+       public:
+          template<typename F>
+          then_continuation( F&& f, const typename promise<R>::ptr& r )
+          :continuation(r),_func(fc::forward<F>(f)),_result(r){}
+
+       protected:
+          virtual void invoke() { set_result<R>::call( *_result, _func ); }
+
+       private:
+          Functor                     _func;
+          typename promise<R>::ptr    _result;
+     };
+
+     /** The completion handler behind future<T>::then() */
+     template<typename Functor, typename T, typename R>
+     class then_handler {
+       public:
+          then_handler( then_continuation<Functor,T,R>* c, thread* executor, const char* desc )
+          :_cont(c),_executor(executor),_desc(desc){}
+
+          template<typename V>
+          void operator()( const V& v, const fc::exception_ptr& e ) {
+             if( e )
+               return _cont->fail( e ); // passed on without running the continuation
+             _cont->set_input( v );
+             dispatch_continuation( _executor, _cont.release(), _desc );
+          }
+          void operator()( const fc::exception_ptr& e ) {
+             if( e )
+               return _cont->fail( e );
+             dispatch_continuation( _executor, _cont.release(), _desc );
+          }
+
+       private:
+          std::unique_ptr<then_continuation<Functor,T,R>> _cont;
+          thread*                                         _executor;
+          const char*                                     _desc;
+     };
+  }
   
   /**
    *  @brief a placeholder for the result of an asynchronous operation.
@@ -244,11 +391,36 @@ namespace fc {
        * The given completion handler will be called from some
        * arbitrary thread and should not 'block'. Generally
        * it should post an event or start a new async operation.
+       *
+       * Every handler that is added runs exactly once, right away
+       * if the future is ready already.
        */
       template<typename CompletionHandler>
       void on_complete( CompletionHandler&& c ) {
         m_prom->on_complete( fc::forward<CompletionHandler>(c) );
       }
+
+      /**
+       * @pre valid()
+       *
+       * @return a future for f(value), which is called once this future is
+       * ready, without parking a fiber on wait(). f runs inline on the thread
+       * that completes this future if executor is null or that thread,
+       * otherwise it is posted to executor. If this future fails, f is not
+       * called and the exception is passed on; an exception thrown by f
+       * fails the returned future.
+       */
+      template<typename Functor>
+      auto then( Functor&& f, thread* executor = nullptr, const char* desc FC_TASK_NAME_DEFAULT_ARG )
+        -> future<typename std::decay<decltype(f(std::declval<const T&>()))>::type> {
+        typedef typename std::decay<decltype(f(std::declval<const T&>()))>::type result_type;
+        typedef typename std::decay<Functor>::type functor_type;
+        typename promise<result_type>::ptr result( new promise<result_type>( desc ) );
+        on_complete( detail::then_handler<functor_type,T,result_type>(
+                       new detail::then_continuation<functor_type,T,result_type>( fc::forward<Functor>(f), result ),
+                       executor, desc ) );
+        return result;
+      }
     private:
       friend class thread;
       fc::shared_ptr<promise<T>> m_prom;
@@ -311,6 +483,19 @@ namespace fc {
         m_prom->on_complete( fc::forward<CompletionHandler>(c) );
       }
 
+      /** @see future<T>::then(), f takes no arguments */
+      template<typename Functor>
+      auto then( Functor&& f, thread* executor = nullptr, const char* desc FC_TASK_NAME_DEFAULT_ARG )
+        -> future<typename std::decay<decltype(f())>::type> {
+        typedef typename std::decay<decltype(f())>::type result_type;
+        typedef typename std::decay<Functor>::type functor_type;
+        typename promise<result_type>::ptr result( new promise<result_type>( desc ) );
+        on_complete( detail::then_handler<functor_type,void,result_type>(
+                       new detail::then_continuation<functor_type,void,result_type>( fc::forward<Functor>(f), result ),
+                       executor, desc ) );
+        return result;
+      }
+
     private:
       friend class thread;
       fc::shared_ptr<promise<void>> m_prom;
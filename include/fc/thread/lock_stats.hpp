@@ -0,0 +1,19 @@
+#pragma once
+#include <cstdint>
+
+namespace fc {
+
+   /**
+    *  Contention counters of a fiber-aware lock, or of one of its modes.
+    *  A snapshot is copied as a whole under the lock's internal spin lock,
+    *  so its counters agree with each other even while the lock is in use.
+    */
+   struct lock_stats
+   {
+      uint64_t acquisitions  = 0; ///< successful acquisitions, including the ones that had to wait
+      uint64_t contended     = 0; ///< acquisitions that had to block the calling fiber
+      uint64_t total_wait_us = 0; ///< time spent blocked by contended acquisitions
+      uint64_t max_wait_us   = 0;
+   };
+
+} // namespace fc
@@ -0,0 +1,45 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace fc {
+
+   /**
+    *  Usage counters of one size class of the object pool that backs
+    *  promises, tasks and fiber contexts.
+    *
+    *  The counters are collected per thread and published every few hundred
+    *  operations, so a snapshot may lag slightly behind. cache_hits / allocations
+    *  is the hit rate of the thread caches; an allocation that misses the cache
+    *  refills it with a batch from the depot or from a new slab.
+    */
+   struct object_pool_stats
+   {
+      size_t   block_size       = 0;
+      uint64_t allocations      = 0; ///< all allocations in this size class
+      uint64_t cache_hits       = 0; ///< allocations served from the calling thread's cache
+      uint64_t depot_batches    = 0; ///< batches of blocks a thread cache took from the shared depot
+      uint64_t slab_allocations = 0; ///< batches of blocks carved out of a new slab from the system allocator
+      uint64_t frees            = 0;
+   };
+
+   /** @return the counters of every size class, plus one entry with block_size 0
+    *          for objects that were too large for the pool
+    */
+   std::vector<object_pool_stats> get_object_pool_stats();
+
+   namespace detail {
+      /**
+       *  Size-class allocator with a per-thread cache. Blocks freed on another
+       *  thread go into that thread's cache, and move through a shared depot
+       *  in batches when a cache runs full or empty.
+       *
+       *  Objects that are larger than the biggest size class are passed on to
+       *  the global operator new.
+       */
+      void* pool_allocate( std::size_t size );
+      void  pool_free( void* p, std::size_t size );
+   }
+
+} // namespace fc
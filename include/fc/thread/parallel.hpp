@@ -26,27 +26,308 @@
 
 #include <fc/thread/task.hpp>
 #include <fc/thread/thread.hpp>
+#include <fc/thread/unique_lock.hpp>
 #include <fc/asio.hpp>
 
 #include <boost/atomic/atomic.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <algorithm>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
 
 namespace fc {
 
+   /** Settings of a named worker pool, see configure_worker_pool() */
+   struct worker_pool_options
+   {
+      uint16_t         threads = 0;    ///< 0 for as many threads as the asio service has
+      std::vector<int> cpus;           ///< pin the workers to these CPUs, empty for no pinning
+      int              numa_node = -1; ///< with no cpus given, pin the workers to the CPUs of this NUMA node
+   };
+
    namespace detail {
       class pool_impl;
 
       class worker_pool {
       public:
-         worker_pool();
+         worker_pool( const std::string& name, const worker_pool_options& options );
          ~worker_pool();
          void post( task_base* task );
+         uint16_t size()const;
+         const std::string& name()const;
       private:
           pool_impl*    my;
       };
 
+      /** @return the pool named "default", which serves the parallel algorithms */
       worker_pool& get_worker_pool();
+
+      /** @return the number of elements per chunk to use when count elements
+       *  are split over the worker pool
+       */
+      size_t default_grain_size( size_t count );
+
+      /** Shared state of a bulk operation that has been split into chunks.
+       *  Every chunk runs as one task on the worker pool. After the last chunk
+       *  has finished, done() is called with the first error (if any).
+       */
+      template<typename ChunkFunctor, typename DoneFunctor>
+      class chunked_operation
+      {
+      public:
+         chunked_operation( size_t chunks, ChunkFunctor c, DoneFunctor d )
+            : remaining(chunks), failed(false), chunk(std::move(c)), done(std::move(d)) {}
+
+         void run( size_t i )
+         {
+            if( !failed.load( boost::memory_order_relaxed ) ) // skip the work once a chunk has failed
+            {
+               try
+               {
+                  chunk( i );
+               }
+               catch( const fc::exception& e )
+               {
+                  fail( e.dynamic_copy_exception() );
+               }
+               catch( ... )
+               {
+                  fail( std::make_shared<unhandled_exception>( FC_LOG_MESSAGE( warn, "unhandled exception in parallel chunk" ) ) );
+               }
+            }
+            if( remaining.fetch_sub( 1, boost::memory_order_acq_rel ) == 1 )
+               done( error );
+         }
+
+      private:
+         void fail( const fc::exception_ptr& e )
+         {
+            if( !failed.exchange( true ) )
+               error = e;
+         }
+
+         boost::atomic<size_t> remaining;
+         boost::atomic<bool>   failed;
+         fc::exception_ptr     error;
+         ChunkFunctor          chunk;
+         DoneFunctor           done;
+      };
+
+      template<typename Operation>
+      struct chunk_runner {
+         chunk_runner( const std::shared_ptr<Operation>& o, size_t i ) : op(o), index(i) {}
+         void operator()() { op->run( index ); }
+         std::shared_ptr<Operation> op;
+         size_t                     index;
+      };
+
+      /** Calls chunk(i) for each i in [0,chunks) on the worker pool, then done(error).
+       *  The tasks are posted without futures, so the only allocations are the
+       *  shared state and one task per chunk.
+       */
+      template<typename ChunkFunctor, typename DoneFunctor>
+      void for_each_chunk( size_t chunks, ChunkFunctor&& chunk, DoneFunctor&& done, const char* desc )
+      {
+         typedef chunked_operation<typename fc::deduce<ChunkFunctor>::type,
+                                   typename fc::deduce<DoneFunctor>::type> operation;
+         typedef chunk_runner<operation> runner;
+         std::shared_ptr<operation> op = std::make_shared<operation>( chunks, fc::forward<ChunkFunctor>(chunk),
+                                                                      fc::forward<DoneFunctor>(done) );
+         for( size_t i = 0; i < chunks; i++ )
+            get_worker_pool().post( new fc::task<void,sizeof(runner)>( runner( op, i ), desc ) );
+      }
+
+      /** Completes a promise<void> from the result of a chunked operation */
+      struct complete_void {
+         explicit complete_void( const promise<void>::ptr& p ) : result(p) {}
+         void operator()( const fc::exception_ptr& e )
+         {
+            if( e )
+               result->set_exception( e );
+            else
+               result->set_value();
+         }
+         promise<void>::ptr result;
+      };
+
+      template<typename Functor>
+      struct for_range {
+         for_range( Functor f, size_t b, size_t e, size_t g ) : func(std::move(f)), begin(b), end(e), grain(g) {}
+         void operator()( size_t chunk )
+         {
+            const size_t last = std::min( end, begin + (chunk + 1) * grain );
+            for( size_t i = begin + chunk * grain; i < last; ++i )
+               func( i );
+         }
+         Functor func;
+         size_t  begin;
+         size_t  end;
+         size_t  grain;
+      };
+
+      template<typename InputIt, typename OutputIt, typename Functor>
+      struct transform_range {
+         transform_range( InputIt i, OutputIt o, Functor f ) : in(i), out(o), func(std::move(f)) {}
+         void operator()( size_t i ) { *(out + i) = func( *(in + i) ); }
+         InputIt  in;
+         OutputIt out;
+         Functor  func;
+      };
+
+      template<typename Iterator, typename T, typename BinaryOp>
+      class reduce_operation
+      {
+      public:
+         reduce_operation( Iterator f, size_t c, size_t g, T i, BinaryOp o, const char* d )
+            : first(f), count(c), grain(g), init(std::move(i)), op(std::move(o)), desc(d),
+              partials( (c + g - 1) / g ), result( new promise<T>( d ) ) {}
+
+         static future<T> start( const std::shared_ptr<reduce_operation>& self )
+         {
+            future<T> r( self->result );
+            if( !self->count )
+            {
+               self->result->set_value( std::move( self->init ) );
+               return r;
+            }
+            for_each_chunk( self->partials.size(),
+                            [self] ( size_t chunk ) { self->reduce_chunk( chunk ); },
+                            [self] ( const fc::exception_ptr& e ) { self->finish( e ); },
+                            self->desc );
+            return r;
+         }
+
+      private:
+         void reduce_chunk( size_t chunk )
+         {
+            const size_t last = std::min( count, (chunk + 1) * grain );
+            Iterator it = first + chunk * grain;
+            T acc = *it;
+            for( size_t i = chunk * grain + 1; i < last; ++i )
+               acc = op( std::move(acc), *++it );
+            partials[chunk] = std::move(acc);
+         }
+
+         void finish( const fc::exception_ptr& e )
+         {
+            if( e )
+            {
+               result->set_exception( e );
+               return;
+            }
+            try
+            {
+               T acc = std::move( init );
+               for( auto& partial : partials )
+                  acc = op( std::move(acc), std::move(*partial) );
+               result->set_value( std::move(acc) );
+            }
+            catch( const fc::exception& ex )
+            {
+               result->set_exception( ex.dynamic_copy_exception() );
+            }
+            catch( ... )
+            {
+               result->set_exception( std::make_shared<unhandled_exception>( FC_LOG_MESSAGE( warn, "unhandled exception in parallel_reduce" ) ) );
+            }
+         }
+
+         Iterator                    first;
+         size_t                      count;
+         size_t                      grain;
+         T                           init;
+         BinaryOp                    op;
+         const char*                 desc;
+         std::vector<optional<T>>    partials;
+         typename promise<T>::ptr    result;
+      };
+
+      /** Sorts every chunk in parallel, then merges neighbouring runs in
+       *  parallel rounds, doubling the run length each round.
+       */
+      template<typename Iterator, typename Compare>
+      class sort_operation
+      {
+      public:
+         sort_operation( Iterator f, size_t c, size_t g, Compare cmp, const char* d )
+            : first(f), count(c), grain(g), comp(std::move(cmp)), desc(d), result( new promise<void>( d ) ) {}
+
+         static future<void> start( const std::shared_ptr<sort_operation>& self )
+         {
+            future<void> r( self->result );
+            if( !self->count )
+            {
+               self->result->set_value();
+               return r;
+            }
+            for_each_chunk( (self->count + self->grain - 1) / self->grain,
+                            [self] ( size_t chunk ) {
+                               const size_t begin = chunk * self->grain;
+                               const size_t end = std::min( self->count, begin + self->grain );
+                               std::sort( self->first + begin, self->first + end, self->comp );
+                            },
+                            [self] ( const fc::exception_ptr& e ) { merge_round( self, self->grain, e ); },
+                            self->desc );
+            return r;
+         }
+
+      private:
+         /** Merges pairs of sorted runs of length width */
+         static void merge_round( const std::shared_ptr<sort_operation>& self, size_t width, const fc::exception_ptr& e )
+         {
+            if( e )
+            {
+               self->result->set_exception( e );
+               return;
+            }
+            if( width >= self->count )
+            {
+               self->result->set_value();
+               return;
+            }
+            for_each_chunk( (self->count + 2 * width - 1) / (2 * width),
+                            [self,width] ( size_t pair ) {
+                               const size_t begin = pair * 2 * width;
+                               const size_t middle = std::min( self->count, begin + width );
+                               const size_t end = std::min( self->count, begin + 2 * width );
+                               if( middle < end )
+                                  std::inplace_merge( self->first + begin, self->first + middle, self->first + end, self->comp );
+                            },
+                            [self,width] ( const fc::exception_ptr& e ) { merge_round( self, 2 * width, e ); },
+                            self->desc );
+         }
+
+         Iterator             first;
+         size_t               count;
+         size_t               grain;
+         Compare              comp;
+         const char*          desc;
+         promise<void>::ptr   result;
+      };
    }
 
+   /**
+    *  Creates a separate worker pool, e.g. "crypto" for signature checks
+    *  that must not compete with the threads of another pool. Pinned workers
+    *  allocate their task queues themselves, so that the queues are local to
+    *  their NUMA node. Fiber stacks come from the process wide stack cache
+    *  and may have been touched on another node. The pool named "default"
+    *  can be configured this way before its first use.
+    *
+    *  @throws assert_exception if a pool of that name exists already
+    *  @throws fc::exception if the workers cannot be pinned to the CPUs
+    */
+   void configure_worker_pool( const std::string& name, const worker_pool_options& options );
+
+   /**
+    *  @return the pool configured under name, to be passed to do_parallel()
+    *  @throws key_not_found_exception if there is no such pool
+    */
+   detail::worker_pool& get_worker_pool( const std::string& name );
+
    class serial_valve {
    private:
       class ticket_guard {
@@ -87,20 +368,237 @@ namespace fc {
       }
    };
 
+   namespace detail { struct lock_waiter; }
+
+   /**
+    *  Keeps the items of a pipeline in order through any number of ordered
+    *  stages, while the work between them runs in parallel, e.g. parallel
+    *  deserialize, parallel verify, ordered apply, parallel persist:
+    *
+    *  @code
+    *  fc::ordered_pipeline pipe( 1, 64 );
+    *  for( auto& block : blocks )
+    *     fc::do_parallel( [&block,t=pipe.enter()] () mutable {
+    *        verify( block );
+    *        t.in_order( 0, [&block] () { apply( block ); } );
+    *        persist( block );
+    *        t.leave();
+    *     } );
+    *  @endcode
+    *
+    *  Items are ordered by their calls to enter(), which suspends the caller
+    *  while max_in_flight items are in the pipeline, so a slow ordered stage
+    *  pushes back on the producer. Unlike serial_valve, an item costs no heap
+    *  allocation: the state of the items in flight lives in a ring that is
+    *  allocated once.
+    */
+   class ordered_pipeline {
+   public:
+      /** An item in the pipeline, it leaves the pipeline when it is destroyed */
+      class ticket {
+      public:
+         ticket( ticket&& o );
+         ticket& operator=( ticket&& o );
+         ~ticket();
+
+         /**
+          *  Waits until every earlier item has passed the given ordered
+          *  stage, then invokes f and passes the stage, also if f throws.
+          *  Stages must be entered in increasing order, skipped stages count
+          *  as passed.
+          *
+          *  @return the return value of f()
+          */
+         template<typename Functor>
+         auto in_order( uint32_t stage, Functor&& f ) -> decltype(f())
+         {
+            wait_for_turn( stage );
+            pass_guard guard( *this, stage );
+            return f();
+         }
+
+         void wait_for_turn( uint32_t stage );
+         /** Lets the next item into the given stage, and skips all stages before it */
+         void pass( uint32_t stage );
+
+         /**
+          *  Passes the remaining stages and leaves the pipeline, like the
+          *  destructor. Needed where the ticket outlives the item, e.g. in the
+          *  functor of a task whose future is kept.
+          */
+         void leave();
+
+         /** @return the position of this item in the order of the pipeline */
+         uint64_t sequence()const { return _seq; }
+
+      private:
+         friend class ordered_pipeline;
+         ticket( ordered_pipeline* pipe, uint64_t seq ) : _pipe(pipe), _seq(seq) {}
+         ticket( const ticket& ) = delete;
+         ticket& operator=( const ticket& ) = delete;
+
+         struct pass_guard {
+            pass_guard( ticket& t, uint32_t stage ) : _t(t), _stage(stage) {}
+            ~pass_guard() { _t.pass( _stage ); }
+            ticket&  _t;
+            uint32_t _stage;
+         };
+
+         ordered_pipeline* _pipe;
+         uint64_t          _seq;
+      };
+
+      /**
+       *  @param ordered_stages number of stages that items pass in order
+       *  @param max_in_flight  number of items that may be in the pipeline at once
+       */
+      ordered_pipeline( uint32_t ordered_stages, uint32_t max_in_flight );
+      /** Waits until all items have left the pipeline */
+      ~ordered_pipeline();
+
+      /**
+       *  Adds an item after all items that entered before. Suspends the
+       *  calling fiber while the pipeline is full.
+       *
+       *  @throws assert_exception if the pipeline is shutting down
+       */
+      ticket enter();
+
+      uint32_t ordered_stages()const { return uint32_t( _gates.size() ); }
+      uint32_t max_in_flight()const  { return uint32_t( _passed.size() ); }
+
+   private:
+      struct waiter_list
+      {
+         detail::lock_waiter* head = nullptr;
+         detail::lock_waiter* tail = nullptr;
+      };
+
+      // called with _lock held
+      void wait( waiter_list& list, detail::lock_waiter& w, fc::unique_lock<boost::mutex>& lock );
+      static void wake( detail::lock_waiter& w );
+      void advance();
+      void leave( uint64_t seq );
+
+      boost::mutex          _lock;        // never held across a context switch
+      uint64_t              _next = 0;    // sequence of the next item to enter
+      uint64_t              _oldest = 0;  // sequence of the oldest item that has not left
+      bool                  _closing = false;
+      std::vector<uint64_t> _gates;       // per stage, the sequence of the next item to pass it
+      std::vector<uint32_t> _passed;      // per slot of the ring, number of stages its item passed
+      std::vector<waiter_list> _stage_waiters;
+      waiter_list           _entrants;
+   };
+
    /**
     *  Calls function <code>f</code> in a separate thread and returns a future
     *  that can be used to wait on the result.
     *
     *  @param f the operation to perform
+    *  @param pool the worker pool that runs f, see get_worker_pool()
     */
    template<typename Functor>
-   auto do_parallel( Functor&& f, const char* desc FC_TASK_NAME_DEFAULT_ARG ) -> fc::future<decltype(f())> {
+   auto do_parallel( Functor&& f, const char* desc FC_TASK_NAME_DEFAULT_ARG,
+                     detail::worker_pool& pool = detail::get_worker_pool() ) -> fc::future<decltype(f())> {
       typedef decltype(f()) Result;
       typedef typename fc::deduce<Functor>::type FunctorType;
       fc::task<Result,sizeof(FunctorType)>* tsk =
          new fc::task<Result,sizeof(FunctorType)>( fc::forward<Functor>(f), desc );
       fc::future<Result> r(fc::shared_ptr< fc::promise<Result> >(tsk,true) );
-      detail::get_worker_pool().post( tsk );
+      pool.post( tsk );
       return r;
    }
+
+   /**
+    *  Calls <code>f(i)</code> for every i in [begin,end) on the worker pool.
+    *  The range is split into chunks of <code>grain</code> consecutive indices,
+    *  and each chunk runs as a single task. With grain 0 the chunk size is
+    *  chosen from the range size and the pool size, so that every worker gets
+    *  a few chunks to balance the load.
+    *
+    *  If any invocation throws, chunks that have not started yet are skipped
+    *  and the first exception is reported through the returned future.
+    *
+    *  @param f the operation to perform, must be safe to call concurrently
+    *  @return a future that becomes ready when all calls have finished
+    */
+   template<typename Functor>
+   future<void> parallel_for( size_t begin, size_t end, Functor&& f,
+                              const char* desc FC_TASK_NAME_DEFAULT_ARG, size_t grain = 0 )
+   {
+      promise<void>::ptr result( new promise<void>( desc ) );
+      if( begin >= end )
+      {
+         result->set_value();
+         return future<void>( result );
+      }
+      if( !grain )
+         grain = detail::default_grain_size( end - begin );
+      typedef typename fc::deduce<Functor>::type FunctorType;
+      detail::for_each_chunk( (end - begin + grain - 1) / grain,
+                              detail::for_range<FunctorType>( fc::forward<Functor>(f), begin, end, grain ),
+                              detail::complete_void( result ), desc );
+      return future<void>( result );
+   }
+
+   /**
+    *  Stores <code>f(*(first+i))</code> into <code>*(out+i)</code> for every
+    *  element in [first,last), using @ref parallel_for.
+    *  Both iterators must be random access, and out must point to a range
+    *  that is large enough.
+    */
+   template<typename InputIt, typename OutputIt, typename Functor>
+   future<void> parallel_transform( InputIt first, InputIt last, OutputIt out, Functor&& f,
+                                    const char* desc FC_TASK_NAME_DEFAULT_ARG, size_t grain = 0 )
+   {
+      typedef typename fc::deduce<Functor>::type FunctorType;
+      return parallel_for( 0, std::distance( first, last ),
+                           detail::transform_range<InputIt,OutputIt,FunctorType>( first, out, fc::forward<Functor>(f) ),
+                           desc, grain );
+   }
+
+   /**
+    *  Combines init and all elements of the random access range [first,last)
+    *  with <code>op</code>. Each chunk is reduced on the worker pool, then the
+    *  partial results are combined in order, so op must be associative but
+    *  need not be commutative.
+    *
+    *  @return a future holding the result
+    */
+   template<typename Iterator, typename T, typename BinaryOp>
+   future<T> parallel_reduce( Iterator first, Iterator last, T init, BinaryOp&& op,
+                              const char* desc FC_TASK_NAME_DEFAULT_ARG, size_t grain = 0 )
+   {
+      typedef typename fc::deduce<BinaryOp>::type OpType;
+      typedef detail::reduce_operation<Iterator,T,OpType> operation;
+      const size_t count = std::distance( first, last );
+      if( !grain )
+         grain = detail::default_grain_size( count );
+      return operation::start( std::make_shared<operation>( first, count, grain, std::move(init),
+                                                            fc::forward<BinaryOp>(op), desc ) );
+   }
+
+   /**
+    *  Sorts the random access range [first,last). Chunks are sorted on the
+    *  worker pool, then merged in parallel rounds. Like std::sort, the sort
+    *  is not stable.
+    */
+   template<typename Iterator, typename Compare>
+   future<void> parallel_sort( Iterator first, Iterator last, Compare&& comp,
+                               const char* desc FC_TASK_NAME_DEFAULT_ARG, size_t grain = 0 )
+   {
+      typedef typename fc::deduce<Compare>::type CompareType;
+      typedef detail::sort_operation<Iterator,CompareType> operation;
+      const size_t count = std::distance( first, last );
+      if( !grain )
+         grain = detail::default_grain_size( count );
+      return operation::start( std::make_shared<operation>( first, count, grain, fc::forward<Compare>(comp), desc ) );
+   }
+
+   template<typename Iterator>
+   future<void> parallel_sort( Iterator first, Iterator last, const char* desc FC_TASK_NAME_DEFAULT_ARG )
+   {
+      typedef typename std::iterator_traits<Iterator>::value_type value_type;
+      return parallel_sort( first, last, std::less<value_type>(), desc );
+   }
 }
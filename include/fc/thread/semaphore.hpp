@@ -0,0 +1,54 @@
+#pragma once
+#include <fc/thread/lock_stats.hpp>
+#include <fc/thread/spin_yield_lock.hpp>
+
+#include <cstdint>
+
+namespace fc {
+  namespace detail { struct lock_waiter; }
+
+  /**
+   *  @brief counting semaphore for fibers, e.g. to bound the number of
+   *  requests in flight
+   *
+   *  acquire() suspends only the calling fiber while not enough units are
+   *  available, and any fiber on any fc::thread may release units. Waiters
+   *  are served in arrival order, so a large request is not starved by a
+   *  stream of small ones.
+   */
+  class semaphore {
+    public:
+      explicit semaphore( uint64_t initial_count );
+      ~semaphore();
+
+      void acquire( uint64_t n = 1 );
+      bool try_acquire( uint64_t n = 1 );
+      void release( uint64_t n = 1 );
+
+      /** @return the units that can be acquired without waiting */
+      uint64_t   available()const;
+      lock_stats get_stats()const;
+
+    private:
+      void grant_waiters();
+
+      mutable fc::spin_yield_lock m_lock;
+      uint64_t                    m_count;
+      detail::lock_waiter*        m_head;
+      detail::lock_waiter*        m_tail;
+      lock_stats                  m_stats;
+  };
+
+  /** Holds units of a semaphore for the lifetime of the object */
+  class semaphore_guard {
+    public:
+      explicit semaphore_guard( semaphore& s, uint64_t n = 1 ) : _sem(s), _count(n) { _sem.acquire( _count ); }
+      ~semaphore_guard() { _sem.release( _count ); }
+    private:
+      semaphore_guard( const semaphore_guard& );
+      semaphore_guard& operator=( const semaphore_guard& );
+      semaphore& _sem;
+      uint64_t   _count;
+  };
+
+} // namespace fc
@@ -0,0 +1,79 @@
+#pragma once
+#include <fc/thread/lock_stats.hpp>
+#include <fc/thread/spin_yield_lock.hpp>
+#include <fc/thread/unique_lock.hpp>
+
+namespace fc {
+  namespace detail { struct lock_waiter; }
+
+  /**
+   *  @brief reader/writer lock for fibers
+   *
+   *  Like fc::mutex, blocking only suspends the calling fiber, so other
+   *  fibers of its thread keep running, and fibers on any fc::thread may
+   *  wait for the same lock. Ownership belongs to the fiber, the lock is
+   *  not recursive in either mode.
+   *
+   *  Waiters are queued in arrival order. When the lock becomes free it is
+   *  granted to the first waiter, together with all readers queued behind it
+   *  up to the next writer.
+   */
+  class shared_mutex {
+    public:
+      enum preference {
+        /** new readers queue behind waiting writers, so writers cannot starve */
+        prefer_writers,
+        /** readers join the current readers even while writers wait, which
+         *  maximizes read throughput but can starve writers */
+        prefer_readers
+      };
+
+      explicit shared_mutex( preference p = prefer_writers );
+      ~shared_mutex();
+
+      void lock();
+      bool try_lock();
+      void unlock();
+
+      void lock_shared();
+      bool try_lock_shared();
+      void unlock_shared();
+
+      lock_stats exclusive_stats()const;
+      lock_stats shared_stats()const;
+
+    private:
+      void wait( detail::lock_waiter& w, lock_stats& stats );
+      void enqueue( detail::lock_waiter& w );
+      void remove( detail::lock_waiter& w );
+      void grant_waiters();
+
+      mutable fc::spin_yield_lock m_lock;
+      const preference            m_preference;
+      uint64_t                    m_readers;         // fibers that hold the lock shared
+      bool                        m_writer;          // a fiber holds the lock exclusively
+      uint64_t                    m_waiting_writers;
+      detail::lock_waiter*        m_head;
+      detail::lock_waiter*        m_tail;
+      lock_stats                  m_exclusive_stats;
+      lock_stats                  m_shared_stats;
+  };
+
+  /** Holds a shared_mutex in shared mode for the lifetime of the object */
+  template<typename T>
+  class shared_lock {
+    public:
+      shared_lock( T& l, try_to_lock_t ):_lock(l) { _locked = _lock.try_lock_shared(); }
+      shared_lock( T& l ): _locked(false), _lock(l) { lock(); }
+      ~shared_lock()                               { if (_locked) unlock(); }
+      operator bool() const { return _locked; }
+      void unlock()                                { assert(_locked);  if (_locked) { _lock.unlock_shared(); _locked = false;} }
+      void lock()                                  { assert(!_locked); if (!_locked) { _lock.lock_shared(); _locked = true; } }
+    private:
+      shared_lock( const shared_lock& );
+      shared_lock& operator=( const shared_lock& );
+      bool _locked;
+      T&  _lock;
+  };
+
+} // namespace fc
@@ -25,6 +25,18 @@ namespace fc {
       void* get_task_specific_data(unsigned slot);
       void set_task_specific_data(unsigned slot, void* new_value, void(*cleanup)(void*));
       class idle_guard;
+
+      /** Intrusive entry of a scheduled task or a sleeping context in a thread's timing wheel */
+      struct timer_link
+      {
+         timer_link* prev    = nullptr;
+         timer_link* next    = nullptr;
+         int64_t     expires = 0;       // microseconds since the epoch
+         void*       owner   = nullptr; // the task_base or context that contains this link
+         uint8_t     level   = 0;
+         uint8_t     slot    = 0;
+         bool        linked  = false;
+      };
    }
 
   class task_base : virtual public promise_base {
@@ -38,9 +50,12 @@ namespace fc {
       uint64_t    _posted_num;
       priority    _prio;
       time_point  _when;
+      time_point  _posted_time; // creation time, tasks are posted right after they are created
       void        _set_active_context(context*);
       context*    _active_context;
       task_base*  _next;
+      detail::timer_link _timer;
+      thread*     _timer_thread; // set while the task waits in the timing wheel of this thread
 
       // support for task-specific data
       std::vector<detail::specific_data_info> *_task_specific_data;
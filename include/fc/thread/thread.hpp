@@ -7,10 +7,15 @@
 namespace fc {
   class time_point;
   class microseconds;
+  class variant;
+  class ordered_pipeline;
+  class variant_arena;
+  size_t get_fiber_stack_high_water_mark();
 
    namespace detail
    {
       class worker_pool;
+      class channel_base;
       void* get_thread_specific_data(unsigned slot);
       void set_thread_specific_data(unsigned slot, void* new_value, void(*cleanup)(void*));
       unsigned get_next_unused_task_storage_slot();
@@ -18,6 +23,13 @@ namespace fc {
       void set_task_specific_data(unsigned slot, void* new_value, void(*cleanup)(void*));
    }
 
+   /** How a fiber that is woken by a promise of its own thread gets to run */
+   enum class wake_policy
+   {
+      queue,         ///< it waits in the ready queue until the waking fiber yields
+      direct_handoff ///< the waking fiber switches to it right away, see thread::set_wake_policy()
+   };
+
    /** Instances of this class can be used to get notifications when a thread is
     *  (or is no longer) idle.
     */
@@ -74,6 +86,38 @@ namespace fc {
        *  async tasks and promises.
        */
       void    debug( const std::string& d );
+
+      /**
+       *  @brief snapshot of the scheduler counters of this thread.
+       *
+       *  Lists the current and peak depth of the ready and task queues, the
+       *  number of blocked contexts, context switches and the time spent
+       *  parked while idle, plus histograms of post-to-start latency and run
+       *  time for every task description. While the fiber watchdog runs it
+       *  also counts the slices over budget, see fiber_watchdog.hpp. May be
+       *  called from any thread.
+       */
+      variant get_stats()const;
+
+      /**
+       *  With wake_policy::direct_handoff, setting a promise that another
+       *  fiber of this thread waits on switches straight to that fiber, and
+       *  the fiber that set the promise continues once the woken one yields,
+       *  behind the fibers that were ready already. This saves a trip through
+       *  the ready queue in request/response exchanges between fibers.
+       *
+       *  A handoff only happens when no ready fiber has a higher priority than
+       *  the woken one, the woken fiber's priority is not below the current
+       *  one, no exception is being handled, and after at most a few
+       *  consecutive handoffs the ready queue gets its turn. The switch
+       *  happens once the promise's completion handlers (then(), when_all()
+       *  and the like) have run, and never from the scheduler itself, e.g.
+       *  when a timeout sets a promise. The default is
+       *  wake_policy::queue, because code that sets a promise must tolerate
+       *  being suspended there. May be called from any thread.
+       */
+      void        set_wake_policy( wake_policy p );
+      wake_policy get_wake_policy()const;
      
      
       /**
@@ -152,7 +196,12 @@ namespace fc {
       friend class task_base;
       friend class thread_d;
       friend class mutex;
+      friend class shared_mutex;
+      friend class semaphore;
+      friend class ordered_pipeline;
+      friend class variant_arena;
       friend class detail::worker_pool;
+      friend class detail::channel_base;
       friend void* detail::get_thread_specific_data(unsigned slot);
       friend void detail::set_thread_specific_data(unsigned slot, void* new_value, void(*cleanup)(void*));
       friend unsigned detail::get_next_unused_task_storage_slot();
@@ -165,10 +214,17 @@ namespace fc {
       friend void usleep(const microseconds&);
       friend void sleep_until(const time_point&);
       friend void exec();
+      friend size_t get_fiber_stack_high_water_mark();
       friend int wait_any( std::vector<promise_base::ptr>&& v, const microseconds& );
       friend int wait_any_until( std::vector<promise_base::ptr>&& v, const time_point& tp );
       void wait_until( promise_base::ptr && v, const time_point& tp );
-      void notify( const promise_base::ptr& v );
+      /**
+       *  @param defer_handoff leave a direct handoff to hand_off_deferred(), so
+       *         the caller can finish its own work first
+       *  @return true if a handoff was deferred
+       */
+      bool notify( const promise_base::ptr& v, bool defer_handoff = false );
+      void hand_off_deferred();
 
       void yield(bool reschedule=true);
       void sleep_until( const time_point& t );
@@ -179,6 +235,7 @@ namespace fc {
       void async_task( task_base* t, const priority& p, const time_point& tp );
 
       void notify_task_has_been_canceled();
+      void cancel_scheduled_task( task_base* t );
       void unblock(fc::context* c);
 
       class thread_d* my;
@@ -199,6 +256,21 @@ namespace fc {
     */
    void sleep_until( const time_point& tp );
 
+   /** Data structures a thread can use for scheduled tasks, sleeping fibers and waits with a timeout */
+   enum class timer_backend
+   {
+      heap,        ///< binary heaps, exact timing with O(log n) insert and O(n) cancel
+      timing_wheel ///< hierarchical timing wheel with 1ms ticks, O(1) insert and cancel
+   };
+
+   /**
+    *  Selects the timer backend of threads created after this call, existing
+    *  threads keep theirs. The fc::thread of the main thread is created on first
+    *  use of fc::thread::current(). The default is timer_backend::heap.
+    */
+   void          set_default_timer_backend( timer_backend b );
+   timer_backend get_default_timer_backend();
+
    /**
     *  Enters the main loop processing tasks until quit() is called.
     */
@@ -0,0 +1,145 @@
+#pragma once
+#include <fc/thread/future.hpp>
+
+#include <boost/atomic.hpp>
+
+#include <memory>
+#include <vector>
+
+namespace fc {
+
+   namespace detail {
+      template<typename T>
+      struct when_all_state
+      {
+         when_all_state( size_t n, const char* desc )
+         : values(n), remaining(n), failed(false), result( new promise<std::vector<T>>( desc ) ) {}
+
+         /** Called once per input, the last one to arrive publishes the results */
+         void completed( const fc::exception_ptr& e )
+         {
+            if( e && !failed.exchange( true ) )
+               result->set_exception( e );
+            if( remaining.fetch_sub( 1, boost::memory_order_acq_rel ) != 1 || failed.load() )
+               return;
+            std::vector<T> out;
+            out.reserve( values.size() );
+            for( auto& v : values )
+               out.push_back( std::move(*v) );
+            result->set_value( std::move(out) );
+         }
+
+         std::vector<fc::optional<T>>             values;
+         boost::atomic<size_t>                    remaining;
+         boost::atomic<bool>                      failed;
+         typename promise<std::vector<T>>::ptr    result;
+      };
+
+      struct when_all_void_state
+      {
+         when_all_void_state( size_t n, const char* desc )
+         : remaining(n), failed(false), result( new promise<void>( desc ) ) {}
+
+         void completed( const fc::exception_ptr& e )
+         {
+            if( e && !failed.exchange( true ) )
+               result->set_exception( e );
+            if( remaining.fetch_sub( 1, boost::memory_order_acq_rel ) == 1 && !failed.load() )
+               result->set_value();
+         }
+
+         boost::atomic<size_t>   remaining;
+         boost::atomic<bool>     failed;
+         promise<void>::ptr      result;
+      };
+
+      struct when_any_state
+      {
+         explicit when_any_state( const char* desc ) : done(false), result( new promise<size_t>( desc ) ) {}
+
+         void completed( size_t index )
+         {
+            if( !done.exchange( true ) )
+               result->set_value( index );
+         }
+
+         boost::atomic<bool>   done;
+         promise<size_t>::ptr  result;
+      };
+   }
+
+   /**
+    *  @return a future for the results of all futures, in their order. It
+    *  fails with the first exception as soon as any of the futures fails.
+    *
+    *  The result is completed from the completion handlers of the futures,
+    *  which costs an atomic decrement per future, so a fiber that waits for
+    *  all of them is woken only once. The futures are not canceled if one of
+    *  them fails.
+    */
+   template<typename T>
+   future<std::vector<T>> when_all( const std::vector<future<T>>& futures, const char* desc = "when_all" )
+   {
+      auto state = std::make_shared<detail::when_all_state<T>>( futures.size(), desc );
+      future<std::vector<T>> result( state->result );
+      if( futures.empty() )
+         state->result->set_value( std::vector<T>() );
+      for( size_t i = 0; i < futures.size(); ++i )
+      {
+         future<T> f( futures[i] );
+         f.on_complete( [state, i]( const T& v, const fc::exception_ptr& e ) {
+            if( !e )
+               state->values[i] = v;
+            state->completed( e );
+         });
+      }
+      return result;
+   }
+
+   inline future<void> when_all( const std::vector<future<void>>& futures, const char* desc = "when_all" )
+   {
+      auto state = std::make_shared<detail::when_all_void_state>( futures.size(), desc );
+      future<void> result( state->result );
+      if( futures.empty() )
+         state->result->set_value();
+      for( const future<void>& input : futures )
+      {
+         future<void> f( input );
+         f.on_complete( [state]( const fc::exception_ptr& e ) { state->completed( e ); } );
+      }
+      return result;
+   }
+
+   /**
+    *  @return a future for the index of the first of futures to become
+    *  ready, whether it succeeded or failed. The others keep running.
+    *  @pre !futures.empty()
+    */
+   template<typename T>
+   future<size_t> when_any( const std::vector<future<T>>& futures, const char* desc = "when_any" )
+   {
+      FC_ASSERT( !futures.empty(), "when_any needs at least one future" );
+      auto state = std::make_shared<detail::when_any_state>( desc );
+      future<size_t> result( state->result );
+      for( size_t i = 0; i < futures.size() && !state->done.load( boost::memory_order_relaxed ); ++i )
+      {
+         future<T> f( futures[i] );
+         f.on_complete( [state, i]( const T&, const fc::exception_ptr& ) { state->completed( i ); } );
+      }
+      return result;
+   }
+
+   inline future<size_t> when_any( const std::vector<future<void>>& futures, const char* desc = "when_any" )
+   {
+      FC_ASSERT( !futures.empty(), "when_any needs at least one future" );
+      auto state = std::make_shared<detail::when_any_state>( desc );
+      future<size_t> result( state->result );
+      for( size_t i = 0; i < futures.size() && !state->done.load( boost::memory_order_relaxed ); ++i )
+      {
+         future<void> f( futures[i] );
+         f.on_complete( [state, i]( const fc::exception_ptr& ) { state->completed( i ); } );
+      }
+      return result;
+   }
+
+} // namespace fc
@@ -6,6 +6,7 @@
 #include <set>
 #include <unordered_map>
 #include <unordered_set>
+#include <utility>
 #include <vector>
 
 #include <string.h> // memset
@@ -66,6 +67,7 @@ namespace fc
 
    template<typename... T> void to_variant( const static_variant<T...>& s, variant& v, uint32_t max_depth );
    template<typename... T> void from_variant( const variant& v, static_variant<T...>& s, uint32_t max_depth );
+   template<typename... T> void from_variant( variant&& v, static_variant<T...>& s, uint32_t max_depth );
 
    void to_variant( const uint8_t& var,   variant& vo, uint32_t max_depth = 1 );
    void from_variant( const variant& var, uint8_t& vo, uint32_t max_depth = 1 );
@@ -91,10 +93,13 @@ namespace fc
 
    void to_variant( const variant_object& var, variant& vo,        uint32_t max_depth );
    void from_variant( const variant& var,      variant_object& vo, uint32_t max_depth );
+   void from_variant( variant&& var,           variant_object& vo, uint32_t max_depth );
    void to_variant( const mutable_variant_object& var, variant& vo,   uint32_t max_depth );
    void from_variant( const variant& var, mutable_variant_object& vo, uint32_t max_depth );
+   void from_variant( variant&& var,      mutable_variant_object& vo, uint32_t max_depth );
    void to_variant( const std::vector<char>& var, variant& vo,   uint32_t max_depth = 1 );
    void from_variant( const variant& var, std::vector<char>& vo, uint32_t max_depth = 1 );
+   void from_variant( variant&& var,      std::vector<char>& vo, uint32_t max_depth = 1 );
 
    template<typename K, typename T>
    void to_variant( const std::unordered_map<K,T>& var, variant& vo,   uint32_t max_depth );
@@ -111,6 +116,8 @@ namespace fc
    template<typename K, typename T>
    void from_variant( const variant& var, std::map<K,T>& vo, uint32_t max_depth );
    template<typename K, typename T>
+   void from_variant( variant&& var, std::map<K,T>& vo, uint32_t max_depth );
+   template<typename K, typename T>
    void to_variant( const std::multimap<K,T>& var,   variant& vo, uint32_t max_depth );
    template<typename K, typename T>
    void from_variant( const variant& var, std::multimap<K,T>& vo, uint32_t max_depth );
@@ -135,6 +142,8 @@ namespace fc
    void to_variant( const std::set<T>& var,  variant& vo,  uint32_t max_depth );
    template<typename T>
    void from_variant( const variant& var, std::set<T>& vo, uint32_t max_depth );
+   template<typename T>
+   void from_variant( variant&& var, std::set<T>& vo, uint32_t max_depth );
 
    void to_variant( const time_point& var,   variant& vo, uint32_t max_depth );
    void from_variant( const variant& var, time_point& vo, uint32_t max_depth );
@@ -164,6 +173,8 @@ namespace fc
    void to_variant( const std::pair<A,B>& t,   variant& v, uint32_t max_depth );
    template<typename A, typename B>
    void from_variant( const variant& v, std::pair<A,B>& p, uint32_t max_depth );
+   template<typename A, typename B>
+   void from_variant( variant&& v, std::pair<A,B>& p, uint32_t max_depth );
 
    /**
     * @brief stores null, int64, uint64, double, bool, string, std::vector<variant>,
@@ -312,13 +323,27 @@ namespace fc
          *  types.
          */
         template<typename T>
-        T as( uint32_t max_depth )const
+        T as( uint32_t max_depth )const &
         {
            T tmp;
            from_variant( *this, tmp, max_depth );
            return tmp;
         }
 
+        /**
+         *  Converts a variant that is about to die, moving its strings, arrays and
+         *  the values of its objects into the result instead of copying them, where
+         *  from_variant( variant&&, T&, uint32_t ) is overloaded for the types involved.
+         *  This variant is left valid, but with an unspecified value.
+         */
+        template<typename T>
+        T as( uint32_t max_depth ) &&
+        {
+           T tmp;
+           from_variant( std::move(*this), tmp, max_depth );
+           return tmp;
+        }
+
         template<typename T>
         void as( T& v, uint32_t max_depth )const
         {
@@ -356,9 +381,12 @@ namespace fc
   
    /** @ingroup Serializable */
    void from_variant( const variant& var,  std::string& vo, uint32_t max_depth = 1 );
+   void from_variant( variant&& var,       std::string& vo, uint32_t max_depth = 1 );
    /** @ingroup Serializable */
    void from_variant( const variant& var,  variants& vo, uint32_t max_depth );
+   void from_variant( variant&& var,       variants& vo, uint32_t max_depth );
    void from_variant( const variant& var,  variant& vo,  uint32_t max_depth );
+   void from_variant( variant&& var,       variant& vo,  uint32_t max_depth );
    /** @ingroup Serializable */
    void from_variant( const variant& var,  int64_t& vo,  uint32_t max_depth = 1 );
    /** @ingroup Serializable */
@@ -382,6 +410,17 @@ namespace fc
       }
    }
    template<typename T>
+   void from_variant( variant&& var, optional<T>& vo, uint32_t max_depth )
+   {
+      if( var.is_null() ) vo = optional<T>();
+      else
+      {
+          _FC_ASSERT( max_depth > 0, "Recursion depth exceeded!" );
+          vo = T();
+          from_variant( std::move(var), *vo, max_depth - 1 );
+      }
+   }
+   template<typename T>
    void to_variant( const std::unordered_set<T>& var, variant& vo, uint32_t max_depth )
    {
        _FC_ASSERT( max_depth > 0, "Recursion depth exceeded!" );
@@ -442,6 +481,15 @@ namespace fc
       for( auto item : vars )
          vo.insert( item.as< std::pair<K,T> >( max_depth - 1 ) );
    }
+   template<typename K, typename T>
+   void from_variant( variant&& var, std::map<K, T>& vo, uint32_t max_depth )
+   {
+      _FC_ASSERT( max_depth > 0, "Recursion depth exceeded!" );
+      variants& vars = var.get_array();
+      vo.clear();
+      for( variant& item : vars )
+         vo.insert( std::move(item).as< std::pair<K,T> >( max_depth - 1 ) );
+   }
 
    template<typename K, typename T>
    void to_variant( const std::multimap<K, T>& var, variant& vo, uint32_t max_depth )
@@ -483,6 +531,15 @@ namespace fc
       for( const auto& item : vars )
          vo.insert( item.as<T>( max_depth - 1 ) );
    }
+   template<typename T>
+   void from_variant( variant&& var, std::set<T>& vo, uint32_t max_depth )
+   {
+      _FC_ASSERT( max_depth > 0, "Recursion depth exceeded!" );
+      variants& vars = var.get_array();
+      vo.clear();
+      for( variant& item : vars )
+         vo.insert( std::move(item).as<T>( max_depth - 1 ) );
+   }
 
    /** @ingroup Serializable */
    template<typename T>
@@ -519,6 +576,16 @@ namespace fc
       for( const auto& item : vars )
          dest.push_back( item.as<T>( max_depth - 1 ) );
    }
+   template<typename T>
+   void from_variant( variant&& var, std::vector<T>& dest, uint32_t max_depth )
+   {
+      _FC_ASSERT( max_depth > 0, "Recursion depth exceeded!" );
+      variants& vars = var.get_array();
+      dest.clear();
+      dest.reserve( vars.size() );
+      for( variant& item : vars )
+         dest.push_back( std::move(item).as<T>( max_depth - 1 ) );
+   }
 
    /** @ingroup Serializable */
    template<typename T>
@@ -552,6 +619,16 @@ namespace fc
       if( vars.size() > 1 )
          p.second = vars[1].as<B>( max_depth - 1 );
    }
+   template<typename A, typename B>
+   void from_variant( variant&& v, std::pair<A,B>& p, uint32_t max_depth )
+   {
+      _FC_ASSERT( max_depth > 0, "Recursion depth exceeded!" );
+      variants& vars = v.get_array();
+      if( vars.size() > 0 )
+         p.first  = std::move(vars[0]).as<A>( max_depth - 1 );
+      if( vars.size() > 1 )
+         p.second = std::move(vars[1]).as<B>( max_depth - 1 );
+   }
 
 
    template<typename T>
@@ -0,0 +1,112 @@
+#pragma once
+#include <cstddef>
+#include <new>
+#include <utility>
+
+namespace fc
+{
+   class variant_arena;
+
+   namespace detail
+   {
+      struct arena_block;
+
+      /** @return whether the current fiber has a variant_arena */
+      bool  in_variant_arena();
+      /**
+       *  @pre in_variant_arena()
+       *  @return memory from the variant_arena of the current fiber, or from the
+       *          heap if size is too large for its blocks
+       */
+      void* arena_allocate( size_t size );
+      /** Releases memory of arena_allocate(), also after its arena has gone out of scope */
+      void  arena_deallocate( void* p );
+
+      /**
+       *  Allocator for the shared storage of variant_object. It uses the
+       *  variant_arena of the fiber that created it, if there is one, and the
+       *  heap otherwise.
+       */
+      template<typename T>
+      struct variant_allocator
+      {
+         typedef T value_type;
+
+         variant_allocator() : _arena( in_variant_arena() ) {}
+         template<typename U>
+         variant_allocator( const variant_allocator<U>& a ) : _arena( a._arena ) {}
+
+         T* allocate( size_t n )
+         {
+            return static_cast<T*>( _arena ? arena_allocate( n * sizeof(T) ) : ::operator new( n * sizeof(T) ) );
+         }
+         void deallocate( T* p, size_t )
+         {
+            if( _arena )
+               arena_deallocate( p );
+            else
+               ::operator delete( p );
+         }
+
+         template<typename U>
+         bool operator==( const variant_allocator<U>& a )const { return _arena == a._arena; }
+         template<typename U>
+         bool operator!=( const variant_allocator<U>& a )const { return _arena != a._arena; }
+
+      private:
+         template<typename U>
+         friend struct variant_allocator;
+
+         bool _arena;
+      };
+   }
+
+   /**
+    *  @brief Bump allocation for variant trees that die together
+    *
+    *  While a variant_arena is alive, the std::string, variants and
+    *  variant_object nodes that variants of the current fiber put on the heap,
+    *  and the entry lists that variant_objects share, are carved out of large
+    *  blocks instead of being allocated one by one, e.g. for everything that
+    *  json::from_string() builds for one RPC request. Other fibers and threads
+    *  are not affected.
+    *
+    *  The arena does not own the buffers inside of those nodes: the characters
+    *  of strings longer than std::string keeps inline, and the elements of
+    *  arrays and of the entry lists. variants and variant_object hand them out
+    *  as std::string and std::vector with the default allocator, so they still
+    *  come from the heap and are freed one by one with their nodes.
+    *
+    *  A block is released as soon as the arena has moved on and everything
+    *  carved out of it has been destroyed. Values that outlive the arena, or
+    *  that are destroyed on another thread, thus stay valid; they only keep
+    *  their block alive.
+    *
+    *  @code
+    *     fc::variant_arena arena;
+    *     const fc::variant request = fc::json::from_string( message );
+    *     ...
+    *  @endcode
+    */
+   class variant_arena
+   {
+      public:
+         explicit variant_arena( size_t block_size = 64 * 1024 );
+         ~variant_arena();
+
+         variant_arena( const variant_arena& ) = delete;
+         variant_arena& operator=( const variant_arena& ) = delete;
+
+      private:
+         friend bool  detail::in_variant_arena();
+         friend void* detail::arena_allocate( size_t size );
+
+         static variant_arena* current();
+         void*                 allocate( size_t size );
+
+         size_t               _block_size;
+         detail::arena_block* _block;  // the one being filled
+         variant_arena*       _outer;  // of the same fiber
+   };
+
+} // namespace fc
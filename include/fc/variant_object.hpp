@@ -1,10 +1,18 @@
 #pragma once
 #include <fc/variant.hpp>
+#include <fc/variant_arena.hpp>
 #include <fc/shared_ptr.hpp>
 
+#include <atomic>
+
 namespace fc
 {
    class mutable_variant_object;
+
+   namespace detail
+   {
+      class key_index;
+   }
    
    /**
     *  @ingroup Serializable
@@ -14,8 +22,8 @@ namespace fc
     *  Keys are kept in the order they are inserted.
     *  This dictionary implements copy-on-write
     *
-    *  @note This class is not optimized for random-access on large
-    *        sets of key-value pairs.
+    *  @note Objects of 16 or more keys get a hash index on their first find(),
+    *        which the copies share.
     */
    class variant_object
    {
@@ -68,7 +76,7 @@ namespace fc
        
       template<typename T>
       variant_object( string key, T&& val )
-      :_key_value( std::make_shared<std::vector<entry> >() )
+      :_key_value( make_entries() )
       {
          *this = variant_object( std::move(key), variant(forward<T>(val)) );
       }
@@ -85,13 +93,36 @@ namespace fc
       variant_object& operator=( const mutable_variant_object& );
 
    private:
-      std::shared_ptr< std::vector< entry > > _key_value;
+      /** The entries that copies share, with their index once find() needed one */
+      struct entries : public std::vector< entry >
+      {
+         entries() : index( nullptr ) {}
+         entries( const entries& e ) : std::vector< entry >( e ), index( nullptr ) {}
+         explicit entries( const std::vector< entry >& e ) : std::vector< entry >( e ), index( nullptr ) {}
+         explicit entries( std::vector< entry >&& e ) : std::vector< entry >( std::move(e) ), index( nullptr ) {}
+         ~entries();
+
+         /** Drops the index after the entries have changed */
+         void reindex();
+
+         mutable std::atomic< const detail::key_index* > index;
+      };
+
+      /** @return entries from the variant_arena of the fiber if there is one */
+      template<typename... Args>
+      static std::shared_ptr< entries > make_entries( Args&&... args )
+      {
+         return std::allocate_shared< entries >( detail::variant_allocator< entries >(), std::forward<Args>(args)... );
+      }
+
+      std::shared_ptr< entries > _key_value;
       friend class mutable_variant_object;
    };
    /** @ingroup Serializable */
    void to_variant( const variant_object& var, variant& vo, uint32_t max_depth = 1 );
    /** @ingroup Serializable */
    void from_variant( const variant& var, variant_object& vo, uint32_t max_depth = 1 );
+   void from_variant( variant&& var, variant_object& vo, uint32_t max_depth = 1 );
 
 
   /**
@@ -102,8 +133,10 @@ namespace fc
    *  Keys are kept in the order they are inserted.
    *  This dictionary implements copy-on-write
    *
-   *  @note This class is not optimized for random-access on large
-   *        sets of key-value pairs.
+   *  @note Objects of 16 or more keys maintain a hash index, so that lookups
+   *        and set() do not scan. Keys must not be changed or reordered
+   *        through the iterators of find() or end(); the index is dropped
+   *        and rebuilt when needed after a call of the non-const begin().
    */
    class mutable_variant_object
    {
@@ -189,7 +222,7 @@ namespace fc
 
       template<typename T>
       explicit mutable_variant_object( T&& v )
-      :_key_value( new std::vector<entry>() )
+      :mutable_variant_object()
       {
           *this = variant(fc::forward<T>(v)).get_object();
       }
@@ -200,7 +233,7 @@ namespace fc
       mutable_variant_object( string key, variant val );
       template<typename T>
       mutable_variant_object( string key, T&& val )
-      :_key_value( new std::vector<entry>() )
+      :mutable_variant_object()
       {
          set( std::move(key), variant(forward<T>(val)) );
       }
@@ -208,12 +241,21 @@ namespace fc
       mutable_variant_object( mutable_variant_object&& );
       mutable_variant_object( const mutable_variant_object& );
       mutable_variant_object( const variant_object& );
+      /** Takes over the entries of obj, unless copies of it share them */
+      mutable_variant_object( variant_object&& );
+      ~mutable_variant_object();
 
       mutable_variant_object& operator=( mutable_variant_object&& );
       mutable_variant_object& operator=( const mutable_variant_object& );
       mutable_variant_object& operator=( const variant_object& );
    private:
+      /** Builds the index or drops it, depending on the size */
+      void reindex();
+      /** Adds the last entry to the index */
+      void appended();
+
       std::unique_ptr< std::vector< entry > > _key_value;
+      std::unique_ptr< detail::key_index >    _index;
       friend class variant_object;
    };
 
@@ -255,5 +297,6 @@ namespace fc
    void to_variant( const mutable_variant_object& var, variant& vo, uint32_t max_depth = 1 );
    /** @ingroup Serializable */
    void from_variant( const variant& var, mutable_variant_object& vo, uint32_t max_depth = 1 );
+   void from_variant( variant&& var, mutable_variant_object& vo, uint32_t max_depth = 1 );
 
 } // namespace fc
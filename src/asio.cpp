@@ -1,5 +1,7 @@
 #include <fc/asio.hpp>
 #include <fc/thread/thread.hpp>
+#include <fc/thread/affinity.hpp>
+#include <fc/thread/fiber_trace.hpp>
 #include <boost/thread.hpp>
 #include <fc/log/logger.hpp>
 #include <fc/exception/exception.hpp>
@@ -19,6 +21,8 @@ namespace fc {
       void read_write_handler::operator()(const boost::system::error_code& ec, size_t bytes_transferred)
       {
         // assert(false); // to detect anywhere we're not passing in a shared buffer
+        fc::detail::trace( fc::detail::trace_event_kind::asio_completion, _completion_promise->get_desc(),
+                           _completion_promise.get(), nullptr, bytes_transferred );
         if( !ec )
           _completion_promise->set_value(bytes_transferred);
         else if( ec == boost::asio::error::eof  )
@@ -33,6 +37,8 @@ namespace fc {
       {}
       void read_write_handler_with_buffer::operator()(const boost::system::error_code& ec, size_t bytes_transferred)
       {
+        fc::detail::trace( fc::detail::trace_event_kind::asio_completion, _completion_promise->get_desc(),
+                           _completion_promise.get(), nullptr, bytes_transferred );
         if( !ec )
           _completion_promise->set_value(bytes_transferred);
         else if( ec == boost::asio::error::eof  )
@@ -47,6 +53,7 @@ namespace fc {
         }
         void error_handler( const promise<void>::ptr& p,
                               const boost::system::error_code& ec ) {
+            fc::detail::trace( fc::detail::trace_event_kind::asio_completion, p->get_desc(), p.get(), nullptr );
             if( !ec )
               p->set_value();
             else
@@ -107,6 +114,12 @@ namespace fc {
 
     uint16_t default_io_service_scope::get_num_threads() { return num_io_threads; }
 
+    std::vector<int> default_io_service_scope::io_cpus;
+
+    void default_io_service_scope::set_cpu_affinity(const std::vector<int>& cpus) {
+       io_cpus = cpus;
+    }
+
     /***
      * Default constructor
      */
@@ -127,6 +140,17 @@ namespace fc {
           asio_threads.push_back( new boost::thread( [i,this]()
                 {
                  fc::thread::current().set_name( "fc::asio worker #" + fc::to_string(i) );
+                 if( !io_cpus.empty() )
+                 {
+                    try
+                    {
+                       fc::set_current_thread_affinity( io_cpus );
+                    }
+                    catch (const fc::exception& e)
+                    {
+                       elog("Cannot pin asio worker #${i}: ${e}", ("i",i)("e",e));
+                    }
+                 }
                  
                  BOOST_SCOPE_EXIT(void)
                  {
@@ -0,0 +1,411 @@
+#include "file_io.hpp"
+
+#include <fc/exception/exception.hpp>
+#include <fc/filesystem.hpp>
+#include <fc/log/logger.hpp>
+
+#include <boost/atomic.hpp>
+#include <boost/filesystem/path.hpp>
+#include <boost/thread.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+# include <io.h>
+#else
+# include <unistd.h>
+#endif
+
+#if defined(__linux__) && defined(__has_include)
+# if __has_include(<linux/io_uring.h>)
+#  include <linux/io_uring.h>
+#  ifdef IORING_REGISTER_PROBE // IORING_OP_READ and IORING_OP_WRITE came with it
+#   define FC_HAS_IO_URING 1
+#   include <sys/mman.h>
+#   include <sys/syscall.h>
+#  endif
+# endif
+#endif
+
+namespace fc {
+   namespace detail {
+      namespace {
+         /** The data of a read or write that runs elsewhere. It belongs to the request, so that a
+          *  fiber that is canceled while it waits leaves nothing dangling behind. */
+         struct file_request
+         {
+            int                  fd;
+            uint64_t             offset;
+            bool                 write;
+            std::vector<char>    data;
+            promise<size_t>::ptr done; // completed by the io_uring reaper
+         };
+         typedef std::shared_ptr<file_request> file_request_ptr;
+
+         size_t blocking_read( int fd, char* buf, size_t len, uint64_t offset )
+         {
+            while( true )
+            {
+#ifdef _WIN32
+               _lseeki64( fd, offset, SEEK_SET );
+               const int r = _read( fd, buf, unsigned( std::min<size_t>( len, 1u << 30 ) ) );
+#else
+               ssize_t r = ::pread( fd, buf, len, off_t( offset ) );
+               if( r < 0 && errno == ESPIPE ) // pipes and character devices only read in sequence
+                  r = ::read( fd, buf, len );
+#endif
+               if( r >= 0 )
+                  return size_t( r );
+               if( errno != EINTR )
+                  FC_THROW_EXCEPTION( fc::exception, "error reading file: ${e}", ("e",strerror(errno)) );
+            }
+         }
+
+         /** @return the number of bytes written, which may be less than len */
+         size_t blocking_write( int fd, const char* buf, size_t len, uint64_t offset )
+         {
+            while( true )
+            {
+#ifdef _WIN32
+               _lseeki64( fd, offset, SEEK_SET );
+               const int r = _write( fd, buf, unsigned( std::min<size_t>( len, 1u << 30 ) ) );
+#else
+               const ssize_t r = ::pwrite( fd, buf, len, off_t( offset ) );
+#endif
+               if( r >= 0 )
+                  return size_t( r );
+               if( errno != EINTR )
+                  FC_THROW_EXCEPTION( fc::exception, "error writing file: ${e}", ("e",strerror(errno)) );
+            }
+         }
+
+         size_t run_blocking( const file_request& r )
+         {
+            return r.write ? blocking_write( r.fd, r.data.data(), r.data.size(), r.offset )
+                           : blocking_read( r.fd, const_cast<char*>( r.data.data() ), r.data.size(), r.offset );
+         }
+
+         size_t run_in_pool( const file_request_ptr& r )
+         {
+            return fc::do_parallel( [r] () { return run_blocking( *r ); }, "file io", file_io_pool() ).wait();
+         }
+
+#ifdef FC_HAS_IO_URING
+         /**
+          *  One ring for the process. Fibers submit under a lock, a reaper
+          *  thread waits for the completions and fulfills their promises.
+          */
+         class uring
+         {
+         public:
+            static const unsigned entries = 256;
+
+            /** @return null if the kernel cannot do reads and writes through io_uring */
+            static uring* create()
+            {
+               io_uring_params params;
+               memset( &params, 0, sizeof(params) );
+               const int fd = int( syscall( __NR_io_uring_setup, entries, &params ) );
+               if( fd < 0 )
+                  return nullptr;
+               std::unique_ptr<uring> u( new uring( fd, params ) );
+               if( !u->map() || !u->supports( IORING_OP_READ ) || !u->supports( IORING_OP_WRITE ) )
+                  return nullptr;
+               u->reaper = new boost::thread( [u_ptr = u.get()] () { u_ptr->reap(); } );
+               return u.release();
+            }
+
+            /** @return false if the ring is full */
+            bool submit( const file_request_ptr& r )
+            {
+               boost::mutex::scoped_lock lock( submit_lock );
+               if( in_flight.load() >= params.cq_entries )
+                  return false;
+               const unsigned tail = *sq_tail;
+               const unsigned head = __atomic_load_n( sq_head, __ATOMIC_ACQUIRE );
+               if( tail - head >= *sq_entries )
+                  return false;
+               const unsigned index = tail & *sq_mask;
+               io_uring_sqe& sqe = sqes[index];
+               memset( &sqe, 0, sizeof(sqe) );
+               sqe.opcode = r->write ? IORING_OP_WRITE : IORING_OP_READ;
+               sqe.fd = r->fd;
+               sqe.off = r->offset;
+               sqe.addr = reinterpret_cast<uint64_t>( r->data.data() );
+               sqe.len = unsigned( r->data.size() );
+               sqe.user_data = reinterpret_cast<uint64_t>( new file_request_ptr( r ) );
+               sq_array[index] = index;
+               __atomic_store_n( sq_tail, tail + 1, __ATOMIC_RELEASE );
+               ++in_flight;
+               while( syscall( __NR_io_uring_enter, fd, 1, 0, 0, nullptr, 0 ) < 0 && errno == EINTR );
+               return true;
+            }
+
+            /** Only create() destroys a ring, if it cannot be used; its reaper does not run yet */
+            ~uring()
+            {
+               if( sqes )
+                  munmap( sqes, params.sq_entries * sizeof(io_uring_sqe) );
+               if( cq_ring && cq_ring != sq_ring )
+                  munmap( cq_ring, cq_ring_size );
+               if( sq_ring )
+                  munmap( sq_ring, sq_ring_size );
+               ::close( fd );
+            }
+
+         private:
+            uring( int f, const io_uring_params& p ) : fd( f ), params( p ), in_flight( 0 ) {}
+
+            bool map()
+            {
+               sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+               cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+               if( params.features & IORING_FEAT_SINGLE_MMAP )
+                  sq_ring_size = cq_ring_size = std::max( sq_ring_size, cq_ring_size );
+               // the destructor unmaps whatever was mapped if this fails half way
+               void* m = mmap( nullptr, sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                               fd, IORING_OFF_SQ_RING );
+               if( m == MAP_FAILED )
+                  return false;
+               sq_ring = cq_ring = m;
+               if( !( params.features & IORING_FEAT_SINGLE_MMAP ) )
+               {
+                  m = mmap( nullptr, cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                            fd, IORING_OFF_CQ_RING );
+                  if( m == MAP_FAILED )
+                     return false;
+                  cq_ring = m;
+               }
+               m = mmap( nullptr, params.sq_entries * sizeof(io_uring_sqe), PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES );
+               if( m == MAP_FAILED )
+                  return false;
+               sqes = static_cast<io_uring_sqe*>( m );
+
+               char* sq = static_cast<char*>( sq_ring );
+               sq_head    = reinterpret_cast<unsigned*>( sq + params.sq_off.head );
+               sq_tail    = reinterpret_cast<unsigned*>( sq + params.sq_off.tail );
+               sq_mask    = reinterpret_cast<unsigned*>( sq + params.sq_off.ring_mask );
+               sq_entries = reinterpret_cast<unsigned*>( sq + params.sq_off.ring_entries );
+               sq_array   = reinterpret_cast<unsigned*>( sq + params.sq_off.array );
+               char* cq = static_cast<char*>( cq_ring );
+               cq_head    = reinterpret_cast<unsigned*>( cq + params.cq_off.head );
+               cq_tail    = reinterpret_cast<unsigned*>( cq + params.cq_off.tail );
+               cq_mask    = reinterpret_cast<unsigned*>( cq + params.cq_off.ring_mask );
+               cqes       = reinterpret_cast<io_uring_cqe*>( cq + params.cq_off.cqes );
+               return true;
+            }
+
+            bool supports( int op )
+            {
+               const size_t size = sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op);
+               std::vector<char> buffer( size, 0 );
+               io_uring_probe* probe = reinterpret_cast<io_uring_probe*>( buffer.data() );
+               if( syscall( __NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, 256 ) < 0 )
+                  return false;
+               return op <= probe->last_op && ( probe->ops[op].flags & IO_URING_OP_SUPPORTED );
+            }
+
+            void reap()
+            {
+               while( true )
+               {
+                  if( syscall( __NR_io_uring_enter, fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0 ) < 0
+                      && errno != EINTR )
+                  {
+                     elog( "io_uring_enter failed: ${e}", ("e",strerror(errno)) );
+                     return;
+                  }
+                  unsigned head = *cq_head;
+                  const unsigned tail = __atomic_load_n( cq_tail, __ATOMIC_ACQUIRE );
+                  for( ; head != tail; ++head )
+                  {
+                     const io_uring_cqe& cqe = cqes[head & *cq_mask];
+                     std::unique_ptr<file_request_ptr> r( reinterpret_cast<file_request_ptr*>( cqe.user_data ) );
+                     if( cqe.res >= 0 )
+                        (*r)->done->set_value( size_t( cqe.res ) );
+                     else
+                        (*r)->done->set_exception( std::make_shared<fc::exception>(
+                           FC_LOG_MESSAGE( error, "file io failed: ${e}", ("e",strerror(-cqe.res)) ) ) );
+                     --in_flight;
+                  }
+                  __atomic_store_n( cq_head, head, __ATOMIC_RELEASE );
+               }
+            }
+
+            int                      fd;
+            io_uring_params          params;
+            boost::mutex             submit_lock;
+            boost::atomic<unsigned>  in_flight;
+            boost::thread*           reaper = nullptr;
+
+            void*         sq_ring = nullptr;
+            void*         cq_ring = nullptr;
+            size_t        sq_ring_size;
+            size_t        cq_ring_size;
+            io_uring_sqe* sqes = nullptr;
+            unsigned*     sq_head;
+            unsigned*     sq_tail;
+            unsigned*     sq_mask;
+            unsigned*     sq_entries;
+            unsigned*     sq_array;
+            unsigned*     cq_head;
+            unsigned*     cq_tail;
+            unsigned*     cq_mask;
+            io_uring_cqe* cqes;
+         };
+
+         // never destroyed, its reaper thread runs until the process exits
+         uring* get_uring()
+         {
+            static uring* ring = uring::create();
+            return ring;
+         }
+#endif
+
+         boost::atomic<file_io_backend>& current_backend()
+         {
+            static boost::atomic<file_io_backend> backend( file_io_backend::blocking );
+            return backend;
+         }
+
+         /** Runs r elsewhere and suspends the calling fiber until it is done */
+         size_t run_async( file_io_backend backend, const file_request_ptr& r )
+         {
+#ifdef FC_HAS_IO_URING
+            if( backend == file_io_backend::io_uring )
+            {
+               r->done.reset( new promise<size_t>( "file io" ) );
+               if( get_uring()->submit( r ) )
+                  return future<size_t>( r->done ).wait();
+            }
+#endif
+            return run_in_pool( r );
+         }
+      } // anonymous namespace
+
+      worker_pool& file_io_pool()
+      {
+         static worker_pool& pool = [] () -> worker_pool& {
+            try
+            {
+               return fc::get_worker_pool( "file io" );
+            }
+            catch( const key_not_found_exception& ) {}
+            worker_pool_options options;
+            options.threads = 2;
+            try
+            {
+               fc::configure_worker_pool( "file io", options );
+            }
+            catch( const assert_exception& ) {} // somebody was faster
+            return fc::get_worker_pool( "file io" );
+         }();
+         return pool;
+      }
+
+      int file_open( const fc::path& path, int flags )
+      {
+         const boost::filesystem::path& bfp = path;
+#ifdef _WIN32
+         const int fd = _wopen( bfp.c_str(), flags | _O_BINARY, _S_IREAD | _S_IWRITE );
+#else
+         int fd;
+         do
+            fd = ::open( bfp.c_str(), flags | O_CLOEXEC, 0666 );
+         while( fd < 0 && errno == EINTR );
+#endif
+         return fd;
+      }
+
+      void file_close( int fd )
+      {
+#ifdef _WIN32
+         _close( fd );
+#else
+         ::close( fd );
+#endif
+      }
+
+      uint64_t file_size( int fd )
+      {
+         return file_stat( fd ).size;
+      }
+
+      file_status file_stat( int fd )
+      {
+#ifdef _WIN32
+         struct _stat64 st;
+         FC_ASSERT( _fstat64( fd, &st ) == 0, "fstat failed" );
+         const unsigned type = st.st_mode & _S_IFMT;
+         return file_status{ uint64_t( st.st_size ), type == _S_IFREG, type == _S_IFDIR };
+#else
+         struct stat st;
+         FC_ASSERT( ::fstat( fd, &st ) == 0, "fstat failed: ${e}", ("e",strerror(errno)) );
+         return file_status{ uint64_t( st.st_size ), S_ISREG( st.st_mode ), S_ISDIR( st.st_mode ) };
+#endif
+      }
+
+      size_t file_read( file_io_backend backend, int fd, char* buf, size_t len, uint64_t offset )
+      {
+         if( backend == file_io_backend::blocking || !len )
+            return blocking_read( fd, buf, len, offset );
+         file_request_ptr r( new file_request() );
+         r->fd = fd;
+         r->offset = offset;
+         r->write = false;
+         r->data.resize( len );
+         const size_t n = run_async( backend, r );
+         memcpy( buf, r->data.data(), n );
+         return n;
+      }
+
+      void file_write( file_io_backend backend, int fd, const char* buf, size_t len, uint64_t offset )
+      {
+         while( len > 0 )
+         {
+            size_t n;
+            if( backend == file_io_backend::blocking )
+               n = blocking_write( fd, buf, len, offset );
+            else
+            {
+               file_request_ptr r( new file_request() );
+               r->fd = fd;
+               r->offset = offset;
+               r->write = true;
+               r->data.assign( buf, buf + len );
+               n = run_async( backend, r );
+            }
+            FC_ASSERT( n > 0, "unable to write to file" );
+            buf += n;
+            len -= n;
+            offset += n;
+         }
+      }
+   } // namespace detail
+
+   file_io_backend set_file_io_backend( file_io_backend backend )
+   {
+#ifdef FC_HAS_IO_URING
+      if( backend == file_io_backend::io_uring && !detail::get_uring() )
+         backend = file_io_backend::thread_pool;
+#else
+      if( backend == file_io_backend::io_uring )
+         backend = file_io_backend::thread_pool;
+#endif
+      detail::current_backend().store( backend );
+      return backend;
+   }
+
+   file_io_backend get_file_io_backend()
+   {
+      return detail::current_backend().load();
+   }
+
+} // namespace fc
@@ -0,0 +1,41 @@
+#pragma once
+#include <fc/io/fstream.hpp>
+#include <fc/thread/parallel.hpp>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace fc { namespace detail {
+
+   /**
+    *  @return a descriptor for path, opened with the flags of open(2), or -1 if
+    *          the file cannot be opened, which file streams report like std::fstream
+    */
+   int      file_open( const fc::path& path, int flags );
+   void     file_close( int fd );
+   uint64_t file_size( int fd );
+
+   /** What fstat(2) tells about a descriptor */
+   struct file_status
+   {
+      uint64_t size;      ///< 0 for pipes, character devices and most files under /proc
+      bool     regular;   ///< only regular files are read at an offset by the async backends
+      bool     directory;
+   };
+   file_status file_stat( int fd );
+
+   /**
+    *  Reads up to len bytes at offset. The async backends suspend only the
+    *  calling fiber.
+    *
+    *  @return the number of bytes read, 0 at the end of the file
+    */
+   size_t file_read( file_io_backend backend, int fd, char* buf, size_t len, uint64_t offset );
+
+   /** @return the worker pool named "file io", configured with two threads if nobody did before */
+   worker_pool& file_io_pool();
+
+   /** Writes all len bytes at offset, or at the end of a file opened for appending */
+   void   file_write( file_io_backend backend, int fd, const char* buf, size_t len, uint64_t offset );
+
+} } // namespace fc::detail
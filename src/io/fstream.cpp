@@ -1,25 +1,79 @@
-
-#include <fstream>
-#include <sstream>
+#include <algorithm>
+#include <cstring>
 
 #include <fc/filesystem.hpp>
 #include <fc/exception/exception.hpp>
 #include <fc/io/fstream.hpp>
 #include <fc/log/logger.hpp>
 
-#include <boost/filesystem/path.hpp>
-#include <boost/filesystem/fstream.hpp>
+#include <fcntl.h>
+
+#include "file_io.hpp"
 
 using namespace std;
 
 namespace fc {
+   namespace {
+      const size_t buffer_size = 64 * 1024;
+   }
+
    class ofstream::impl : public fc::retainable {
       public:
-         boost::filesystem::ofstream ofs;
+         impl() : fd(-1), pos(0), backend( file_io_backend::blocking ) {}
+         ~impl()
+         {
+            if( fd < 0 )
+               return;
+            try
+            {
+               // may run while an exception unwinds, where fibers must not be suspended
+               backend = file_io_backend::blocking;
+               flush();
+            }
+            catch( ... ) {}
+            detail::file_close( fd );
+         }
+
+         void flush()
+         {
+            if( buffer.empty() )
+               return;
+            detail::file_write( backend, fd, buffer.data(), buffer.size(), pos );
+            pos += buffer.size();
+            buffer.clear();
+         }
+
+         int             fd;
+         uint64_t        pos;
+         file_io_backend backend;
+         std::string     buffer;
    };
    class ifstream::impl : public fc::retainable {
       public:
-         boost::filesystem::ifstream ifs;
+         impl() : fd(-1), pos(0), begin(0), end(0), at_eof(false), backend( file_io_backend::blocking ) {}
+         ~impl()
+         {
+            if( fd >= 0 )
+               detail::file_close( fd );
+         }
+
+         /** @return the number of bytes read directly into buf or the buffer, 0 at the end of the file */
+         size_t fill( char* buf, size_t len )
+         {
+            const size_t n = detail::file_read( backend, fd, buf, len, pos );
+            pos += n;
+            if( !n )
+               at_eof = true;
+            return n;
+         }
+
+         int             fd;
+         uint64_t        pos;       // of the end of the buffered data
+         size_t          begin;     // of the unread part of buffer
+         size_t          end;
+         bool            at_eof;
+         file_io_backend backend;
+         std::vector<char> buffer;
    };
 
    ofstream::ofstream()
@@ -29,12 +83,29 @@ namespace fc {
    :my( new impl() ) { this->open( file, m ); }
    ofstream::~ofstream(){}
 
-   void ofstream::open( const fc::path& file, std::ios_base::openmode m ) {
-     const boost::filesystem::path& bfp = file; 
-     my->ofs.open( bfp, std::ios_base::out | std::ios_base::binary | m );
+   void ofstream::open( const fc::path& file, std::ios_base::openmode m, file_io_backend backend ) {
+     close();
+     int flags = O_WRONLY | O_CREAT;
+     if( m & std::ios_base::app )
+        flags |= O_APPEND;
+     else if( ( m & std::ios_base::trunc ) || !( m & std::ios_base::in ) )
+        flags |= O_TRUNC;
+     my->fd = detail::file_open( file, flags );
+     my->pos = my->fd >= 0 && ( m & ( std::ios_base::app | std::ios_base::ate ) ) ? detail::file_size( my->fd ) : 0;
+     my->backend = backend;
    }
    size_t ofstream::writesome( const char* buf, size_t len ) {
-        my->ofs.write(buf,len);
+        if( my->fd < 0 ) // like std::ofstream, a stream that failed to open drops what is written
+           return len;
+        if( my->buffer.size() + len > buffer_size )
+           my->flush();
+        if( len >= buffer_size )
+        {
+           detail::file_write( my->backend, my->fd, buf, len, my->pos );
+           my->pos += len;
+        }
+        else
+           my->buffer.append( buf, len );
         return len;
    }
    size_t ofstream::writesome(const std::shared_ptr<const char>& buffer, size_t len, size_t offset)
@@ -43,13 +114,28 @@ namespace fc {
    }
 
    void   ofstream::put( char c ) {
-        my->ofs.put(c);
+        writesome( &c, 1 );
    }
    void   ofstream::close() {
-        my->ofs.close();
+        if( my->fd < 0 )
+           return;
+        try
+        {
+           my->flush();
+        }
+        catch( ... )
+        {
+           my->buffer.clear();
+           detail::file_close( my->fd );
+           my->fd = -1;
+           throw;
+        }
+        detail::file_close( my->fd );
+        my->fd = -1;
    }
    void   ofstream::flush() {
-        my->ofs.flush();
+        if( my->fd >= 0 )
+           my->flush();
    }
 
    ifstream::ifstream()
@@ -62,22 +148,36 @@ namespace fc {
    ifstream::~ifstream(){}
 
    void ifstream::open( const fc::path& file, int m ) {
-     const boost::filesystem::path& bfp = file; 
-      my->ifs.open( bfp, std::ios::binary );
+      close();
+      my->fd = detail::file_open( file, O_RDONLY );
+      my->pos = 0;
+      my->begin = my->end = 0;
+      my->at_eof = my->fd < 0; // like std::ifstream, a file that cannot be opened reads as empty
+      my->backend = get_file_io_backend();
    }
 
    size_t ifstream::readsome( char* buf, size_t len ) {
-      auto s = size_t(my->ifs.readsome( buf, len ));
-      if( s <= 0 ) 
+      if( my->fd < 0 )
+         FC_THROW_EXCEPTION( eof_exception, "" );
+      if( my->begin == my->end )
       {
-         read( buf, 1 );
-         s = 1;
-         if (len > 1)
+         if( len >= buffer_size )
          {
-            s += size_t(my->ifs.readsome( &buf[1], len - 1));
+            const size_t n = my->fill( buf, len );
+            if( !n )
+               FC_THROW_EXCEPTION( eof_exception, "" );
+            return n;
          }
+         my->buffer.resize( buffer_size );
+         my->begin = 0;
+         my->end = my->fill( my->buffer.data(), buffer_size );
+         if( !my->end )
+            FC_THROW_EXCEPTION( eof_exception, "" );
       }
-      return s;
+      const size_t n = std::min( len, my->end - my->begin );
+      memcpy( buf, my->buffer.data() + my->begin, n );
+      my->begin += n;
+      return n;
    }
    size_t ifstream::readsome(const std::shared_ptr<char>& buffer, size_t max, size_t offset)
    {
@@ -85,33 +185,71 @@ namespace fc {
    }
 
    ifstream& ifstream::read( char* buf, size_t len ) {
-      if (eof())
-        FC_THROW_EXCEPTION( eof_exception , "");
-      my->ifs.read(buf,len);
-      if (my->ifs.gcount() < int64_t(len))
-        FC_THROW_EXCEPTION( eof_exception , "");
+      while( len > 0 )
+      {
+         const size_t n = readsome( buf, len );
+         buf += n;
+         len -= n;
+      }
       return *this;
    }
    ifstream& ifstream::seekg( size_t p, seekdir d ) {
+      if( my->fd < 0 )
+         return *this;
+      const uint64_t current = my->pos - ( my->end - my->begin );
       switch( d ) {
-        case beg: my->ifs.seekg( p, std::ios_base::beg ); return *this;
-        case cur: my->ifs.seekg( p, std::ios_base::cur ); return *this;
-        case end: my->ifs.seekg( p, std::ios_base::end ); return *this;
+        case beg: my->pos = p; break;
+        case cur: my->pos = current + p; break;
+        case end: my->pos = detail::file_size( my->fd ) + p; break;
       }
+      my->begin = my->end = 0;
+      my->at_eof = false;
       return *this;
    }
-   void   ifstream::close() { return my->ifs.close(); }
+   void   ifstream::close() {
+      if( my->fd >= 0 )
+         detail::file_close( my->fd );
+      my->fd = -1;
+   }
 
-   bool   ifstream::eof()const { return !my->ifs.good(); }
+   bool   ifstream::eof()const { return my->at_eof && my->begin == my->end; }
 
    void read_file_contents( const fc::path& filename, std::string& result )
    {
-      const boost::filesystem::path& bfp = filename;
-      boost::filesystem::ifstream f( bfp, std::ios::in | std::ios::binary );
-      // don't use fc::stringstream here as we need something with override for << rdbuf()
-      std::stringstream ss;
-      ss << f.rdbuf();
-      result = ss.str();
+      const int fd = detail::file_open( filename, O_RDONLY );
+      if( fd < 0 ) // the contents of a file that cannot be opened are empty, as before
+      {
+         result.clear();
+         return;
+      }
+      try
+      {
+         const detail::file_status status = detail::file_stat( fd );
+         size_t n = 0;
+         if( !status.directory ) // a directory reads as empty, as it did through std::ifstream
+         {
+            const file_io_backend backend = status.regular ? get_file_io_backend() : file_io_backend::blocking;
+            // the size is only a hint, /proc files and pipes report 0; one byte more saves
+            // growing the buffer for the read that finds the end of a regular file
+            result.resize( size_t( std::max<uint64_t>( status.size + 1, 4096 ) ) );
+            while( true )
+            {
+               if( n == result.size() )
+                  result.resize( 2 * n );
+               const size_t r = detail::file_read( backend, fd, &result[n], result.size() - n, n );
+               if( !r )
+                  break;
+               n += r;
+            }
+         }
+         result.resize( n );
+      }
+      catch( ... )
+      {
+         detail::file_close( fd );
+         throw;
+      }
+      detail::file_close( fd );
    }
-  
-} // namespace fc 
+
+} // namespace fc
@@ -5,6 +5,7 @@
 #include <fc/io/fstream.hpp>
 #include <fc/io/sstream.hpp>
 #include <fc/log/logger.hpp>
+#include <fc/time.hpp>
 #include <cstdint>
 #include <iostream>
 #include <fstream>
@@ -474,79 +475,121 @@ namespace fc
       } FC_RETHROW_EXCEPTIONS( warn, "", ("str",utf8_str) )
    }
 
+   namespace
+   {
+      /** @return how c is written inside of a JSON string, nullptr if as it is */
+      const char* escape_sequence( char c )
+      {
+         switch( c )
+         {
+            case '\b': return "\\b";  // \x08
+            case '\f': return "\\f";  // \x0c
+            case '\n': return "\\n";  // \x0a
+            case '\r': return "\\r";  // \x0d
+            case '\t': return "\\t";  // \x09
+            case '\\': return "\\\\";
+            case '\"': return "\\\"";
+            case '\x00': return "\\u0000";
+            case '\x01': return "\\u0001";
+            case '\x02': return "\\u0002";
+            case '\x03': return "\\u0003";
+            case '\x04': return "\\u0004";
+            case '\x05': return "\\u0005";
+            case '\x06': return "\\u0006";
+            case '\x07': return "\\u0007"; // \a is not valid JSON
+            case '\x0b': return "\\u000b";
+            case '\x0e': return "\\u000e";
+            case '\x0f': return "\\u000f";
+
+            case '\x10': return "\\u0010";
+            case '\x11': return "\\u0011";
+            case '\x12': return "\\u0012";
+            case '\x13': return "\\u0013";
+            case '\x14': return "\\u0014";
+            case '\x15': return "\\u0015";
+            case '\x16': return "\\u0016";
+            case '\x17': return "\\u0017";
+            case '\x18': return "\\u0018";
+            case '\x19': return "\\u0019";
+            case '\x1a': return "\\u001a";
+            case '\x1b': return "\\u001b";
+            case '\x1c': return "\\u001c";
+            case '\x1d': return "\\u001d";
+            case '\x1e': return "\\u001e";
+            case '\x1f': return "\\u001f";
+
+            default:
+               return nullptr;
+         }
+      }
+
+      /** Appends to a string what to_stream() writes */
+      class string_appender
+      {
+         public:
+            explicit string_appender( std::string& s ):_s(s){}
+
+            void write( const char* buf, size_t len ) { _s.append( buf, len ); }
+
+            string_appender& operator<<( char c )               { _s += c; return *this; }
+            string_appender& operator<<( const char* s )        { _s += s; return *this; }
+            string_appender& operator<<( const std::string& s ) { _s += s; return *this; }
+            string_appender& operator<<( int64_t v )
+            {
+               if( v < 0 )
+               {
+                  _s += '-';
+                  return *this << uint64_t( 0 ) - uint64_t( v );
+               }
+               return *this << uint64_t( v );
+            }
+            string_appender& operator<<( uint64_t v )
+            {
+               char digits[20];
+               char* p = digits + sizeof(digits);
+               do
+               {
+                  *--p = char( '0' + v % 10 );
+                  v /= 10;
+               } while( v );
+               _s.append( p, digits + sizeof(digits) - p );
+               return *this;
+            }
+
+         private:
+            std::string& _s;
+      };
+   }
+
    /**
     *  Convert '\t', '\a', '\n', '\\' and '"'  to "\t\a\n\\\""
     *
     *  All other characters are printed as UTF8.
     */
-   void escape_string( const string& str, ostream& os )
+   template<typename T>
+   void escape_string( const string& str, T& os )
    {
       os << '"';
-      for( auto itr = str.begin(); itr != str.end(); ++itr )
+      const char* unwritten = str.data();
+      const char* const end = str.data() + str.size();
+      for( const char* itr = unwritten; itr != end; ++itr )
       {
-         switch( *itr )
+         if( const char* escaped = escape_sequence( *itr ) )
          {
-            case '\b':        // \x08
-               os << "\\b";
-               break;
-            case '\f':        // \x0c
-               os << "\\f";
-               break;
-            case '\n':        // \x0a
-               os << "\\n";
-               break;
-            case '\r':        // \x0d
-               os << "\\r";
-               break;
-            case '\t':        // \x09
-               os << "\\t";
-               break;
-            case '\\':
-               os << "\\\\";
-               break;
-            case '\"':
-               os << "\\\"";
-               break;
-            case '\x00': os << "\\u0000"; break;
-            case '\x01': os << "\\u0001"; break;
-            case '\x02': os << "\\u0002"; break;
-            case '\x03': os << "\\u0003"; break;
-            case '\x04': os << "\\u0004"; break;
-            case '\x05': os << "\\u0005"; break;
-            case '\x06': os << "\\u0006"; break;
-            case '\x07': os << "\\u0007"; break; // \a is not valid JSON
-         // case '\x08': os << "\\u0008"; break; // \b
-         // case '\x09': os << "\\u0009"; break; // \t
-         // case '\x0a': os << "\\u000a"; break; // \n
-            case '\x0b': os << "\\u000b"; break;
-         // case '\x0c': os << "\\u000c"; break; // \f
-         // case '\x0d': os << "\\u000d"; break; // \r
-            case '\x0e': os << "\\u000e"; break;
-            case '\x0f': os << "\\u000f"; break;
-
-            case '\x10': os << "\\u0010"; break;
-            case '\x11': os << "\\u0011"; break;
-            case '\x12': os << "\\u0012"; break;
-            case '\x13': os << "\\u0013"; break;
-            case '\x14': os << "\\u0014"; break;
-            case '\x15': os << "\\u0015"; break;
-            case '\x16': os << "\\u0016"; break;
-            case '\x17': os << "\\u0017"; break;
-            case '\x18': os << "\\u0018"; break;
-            case '\x19': os << "\\u0019"; break;
-            case '\x1a': os << "\\u001a"; break;
-            case '\x1b': os << "\\u001b"; break;
-            case '\x1c': os << "\\u001c"; break;
-            case '\x1d': os << "\\u001d"; break;
-            case '\x1e': os << "\\u001e"; break;
-            case '\x1f': os << "\\u001f"; break;
-
-            default:
-               os << *itr;
+            if( itr != unwritten )
+               os.write( unwritten, itr - unwritten );
+            os << escaped;
+            unwritten = itr + 1;
          }
       }
+      if( end != unwritten )
+         os.write( unwritten, end - unwritten );
       os << '"';
    }
+   void escape_string( const string& str, ostream& os )
+   {
+      escape_string<ostream>( str, os );
+   }
    ostream& json::to_stream( ostream& out, const std::string& str )
    {
         escape_string( str, out );
@@ -637,9 +680,267 @@ namespace fc
 
    std::string   json::to_string( const variant& v, output_formatting format, uint32_t max_depth )
    {
-      fc::stringstream ss;
-      fc::to_stream( ss, v, format, max_depth );
-      return ss.str();
+      std::string result;
+      string_appender out( result );
+      fc::to_stream( out, v, format, max_depth );
+      return result;
+   }
+
+   json_writer::json_writer( std::string& out, json::output_formatting format, uint32_t max_depth )
+   :_out( out ), _format( format ), _max_depth( max_depth )
+   {
+   }
+
+   json_writer& json_writer::write( const variant& v )
+   {
+      write_variant( v, _max_depth );
+      return *this;
+   }
+
+   void json_writer::write( const std::string& v, uint32_t depth, uint32_t stream_depth )
+   {
+      FC_ASSERT( stream_depth > 0, "Too many nested objects!" );
+      string_appender out( _out );
+      escape_string( v, out );
+   }
+
+   void json_writer::write( const std::vector<char>& v, uint32_t depth, uint32_t stream_depth )
+   {
+      // written as hex, like to_variant() does
+      write_variant( variant( v, depth ), stream_depth );
+   }
+
+   void json_writer::write_variant( const variant& v, uint32_t stream_depth )
+   {
+      string_appender out( _out );
+      fc::to_stream( out, v, _format, stream_depth );
+   }
+
+   namespace
+   {
+      /** Lets the parsers above read the text of a json_reader */
+      class json_cursor
+      {
+         public:
+            json_cursor( const char*& pos, const char* end ):_pos(pos),_end(end){}
+
+            char peek()const
+            {
+               if( _pos == _end )
+                  FC_THROW_EXCEPTION( eof_exception, "" );
+               return *_pos;
+            }
+            char get()
+            {
+               const char c = peek();
+               ++_pos;
+               return c;
+            }
+
+         private:
+            const char*&      _pos;
+            const char* const _end;
+      };
+
+      /** Whether c may follow a number that number_from_stream() reads as an integer */
+      bool ends_integer( char c )
+      {
+         switch( c )
+         {
+            case ',':
+            case ']':
+            case '}':
+            case ' ':
+            case '\t':
+            case '\n':
+            case '\r':
+               return true;
+            default:
+               return false;
+         }
+      }
+   }
+
+   json_reader::json_reader( const std::string& in, json::parse_type ptype, uint32_t max_depth )
+   :_pos( in.data() ), _end( in.data() + in.size() ), _ptype( ptype ), _max_depth( max_depth )
+   {
+      FC_ASSERT( supports( ptype ), "json_reader does not support JSON parser type ${ptype}", ("ptype", ptype) );
+   }
+
+   bool json_reader::supports( json::parse_type ptype )
+   {
+      switch( ptype )
+      {
+         case json::legacy_parser:
+#ifdef WITH_EXOTIC_JSON_PARSERS
+         case json::legacy_parser_with_string_doubles:
+#endif
+         case json::broken_nul_parser:
+            return true;
+         default:
+            return false;
+      }
+   }
+
+   void json_reader::read( std::string& v, uint32_t depth, uint32_t parse_depth )
+   {
+      if( begin_value( parse_depth ) != '"' )
+         return read_through_variant( v, depth, parse_depth );
+      read_string( v );
+   }
+
+   void json_reader::read( time_point& v, uint32_t depth, uint32_t parse_depth )
+   {
+      if( begin_value( parse_depth ) != '"' )
+         return read_through_variant( v, depth, parse_depth );
+      read_string( _key );
+      v = time_point::from_iso_string( _key );
+   }
+
+   void json_reader::read( time_point_sec& v, uint32_t depth, uint32_t parse_depth )
+   {
+      if( begin_value( parse_depth ) != '"' )
+         return read_through_variant( v, depth, parse_depth );
+      read_string( _key );
+      v = time_point_sec::from_iso_string( _key );
+   }
+
+   char json_reader::begin_value( uint32_t parse_depth )
+   {
+      if( parse_depth == 0 )
+         FC_THROW_EXCEPTION( parse_error_exception, "Too many nested items in JSON input!" );
+      json_cursor in( _pos, _end );
+      skip_white_space( in );
+      return in.peek();
+   }
+
+   variant json_reader::read_variant( uint32_t parse_depth )
+   {
+      const char c = begin_value( parse_depth );
+      if( c == '"' )
+      {
+         std::string s;
+         read_string( s );
+         return variant( std::move( s ) );
+      }
+
+      // integers of up to 18 digits, which cannot overflow, are converted in place
+      const char* const digits = _pos + ( c == '-' ? 1 : 0 );
+      const char* p = digits;
+      uint64_t value = 0;
+      while( p != _end && p - digits < 18 && *p >= '0' && *p <= '9' )
+         value = value * 10 + uint64_t( *p++ - '0' );
+      if( p != digits && ( p == _end || ends_integer( *p ) ) )
+      {
+         _pos = p;
+         if( c == '-' )
+            return variant( -int64_t( value ) );
+         return variant( value );
+      }
+
+      json_cursor in( _pos, _end );
+      switch( _ptype )
+      {
+#ifdef WITH_EXOTIC_JSON_PARSERS
+         case json::legacy_parser_with_string_doubles:
+            return variant_from_stream<json_cursor, json::legacy_parser_with_string_doubles>( in, parse_depth );
+#endif
+         case json::broken_nul_parser:
+            return variant_from_stream<json_cursor, json::broken_nul_parser>( in, parse_depth );
+         default:
+            return variant_from_stream<json_cursor, json::legacy_parser>( in, parse_depth );
+      }
+   }
+
+   void json_reader::read_string( std::string& s )
+   {
+      // the same exceptions as stringFromStream(), running out of input is an eof_exception
+      if( _pos == _end )
+         FC_THROW_EXCEPTION( eof_exception, "" );
+      if( *_pos != '"' )
+         FC_THROW_EXCEPTION( parse_error_exception, "Expected '\"' but read '${char}'", ("char", string( _pos, _pos + 1 )) );
+      const char* p = _pos + 1;
+      s.clear();
+      while( true )
+      {
+         const char* run = p;
+         while( p != _end && *p != '"' && *p != '\\' && *p != 0x04 )
+            ++p;
+         s.append( run, p );
+         if( p == _end )
+            FC_THROW_EXCEPTION( eof_exception, "EOF before closing '\"' in string '${token}'", ("token", s) );
+         if( *p == 0x04 )
+            FC_THROW_EXCEPTION( parse_error_exception, "EOF before closing '\"' in string '${token}'", ("token", s) );
+         if( *p == '"' )
+            break;
+         if( ++p == _end )
+            FC_THROW_EXCEPTION( eof_exception, "Stream ended with '\\'" );
+         switch( *p )
+         {
+            case 't':  s += '\t'; break;
+            case 'n':  s += '\n'; break;
+            case 'r':  s += '\r'; break;
+            default:   s += *p;
+         }
+         ++p;
+      }
+      _pos = p + 1;
+   }
+
+   bool json_reader::next_key()
+   {
+      json_cursor in( _pos, _end );
+      while( true )
+      {
+         switch( in.peek() )
+         {
+            case '}':
+               in.get();
+               return false;
+            case ',':
+            case ' ':
+            case '\t':
+            case '\n':
+            case '\r':
+               in.get();
+               break;
+            default:
+               read_string( _key );
+               skip_white_space( in );
+               if( in.peek() != ':' )
+                  FC_THROW_EXCEPTION( parse_error_exception, "Expected ':' after key \"${key}\"", ("key", _key) );
+               in.get();
+               return true;
+         }
+      }
+   }
+
+   void json_reader::unexpected_eof( const fc::eof_exception& e )
+   {
+      FC_THROW_EXCEPTION( parse_error_exception, "Unexpected EOF: ${e}", ("e", e.to_detail_string() ) );
+   }
+
+   bool json_reader::next_element()
+   {
+      json_cursor in( _pos, _end );
+      while( true )
+      {
+         switch( in.peek() )
+         {
+            case ']':
+               in.get();
+               return false;
+            case ',':
+            case ' ':
+            case '\t':
+            case '\n':
+            case '\r':
+               in.get();
+               break;
+            default:
+               return true;
+         }
+      }
    }
 
 
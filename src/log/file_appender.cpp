@@ -2,6 +2,7 @@
 #include <fc/io/fstream.hpp>
 #include <fc/log/file_appender.hpp>
 #include <fc/reflect/variant.hpp>
+#include <fc/thread/parallel.hpp>
 #include <fc/thread/scoped_lock.hpp>
 #include <fc/thread/thread.hpp>
 #include <fc/variant.hpp>
@@ -11,6 +12,8 @@
 #include <sstream>
 #include <iostream>
 
+#include "../io/file_io.hpp"
+
 namespace fc {
 
    class file_appender::impl : public fc::retainable
@@ -19,11 +22,74 @@ namespace fc {
          config                     cfg;
          ofstream                   out;
          boost::mutex               slock;
+         /**
+          *  set unless the file io backend is blocking, then the lines are written on the "file io"
+          *  pool. out itself always uses the blocking backend: a pool thread is already off the
+          *  callers' threads, and the synchronous mode writes under slock.
+          */
+         const bool                 async;
 
       private:
          future<void>               _rotation_task;
          time_point_sec             _current_file_start_time;
 
+         // the members below are guarded by slock and used only if async
+         std::string                _pending;
+         fc::path                   _reopen_path;
+         bool                       _reopen = false;
+         bool                       _writing = false;
+         future<void>               _writer;
+
+         void open_log_file( const fc::path& log_filename )
+         {
+            const fc::path& link_filename = cfg.filename;
+            remove_all(link_filename);  // on windows, you can't delete the link while the underlying file is opened for writing
+            out.open( log_filename, std::ios_base::out | std::ios_base::app, file_io_backend::blocking );
+            create_hard_link(log_filename, link_filename);
+         }
+
+         /** Writes and reopens for the async mode until there is nothing left to do */
+         void write_pending()
+         {
+            std::string lines;
+            fc::path reopen_path;
+            while( true )
+            {
+               bool reopen;
+               {
+                  fc::scoped_lock<boost::mutex> lock( slock );
+                  lines.clear();
+                  lines.swap( _pending );
+                  reopen = _reopen;
+                  _reopen = false;
+                  reopen_path = _reopen_path;
+                  if( lines.empty() && !reopen )
+                  {
+                     _writing = false;
+                     return;
+                  }
+               }
+               try
+               {
+                  if( !lines.empty() )
+                  {
+                     out.writesome( lines.data(), lines.size() );
+                     if( cfg.flush )
+                        out.flush();
+                  }
+                  if( reopen )
+                  {
+                     out.close();
+                     open_log_file( reopen_path );
+                  }
+               }
+               catch( ... )
+               {
+                  std::cerr << "error writing log file: " << cfg.filename.preferred_string() << "\n";
+               }
+            }
+         }
+
          time_point_sec get_file_start_time( const time_point_sec& timestamp, const microseconds& interval )
          {
              int64_t interval_seconds = interval.to_seconds();
@@ -32,7 +98,7 @@ namespace fc {
          }
 
       public:
-         impl( const config& c) : cfg( c )
+         impl( const config& c) : cfg( c ), async( get_file_io_backend() != file_io_backend::blocking )
          {
             try
             {
@@ -45,7 +111,7 @@ namespace fc {
 
                   rotate_files( true );
                } else {
-                  out.open( cfg.filename, std::ios_base::out | std::ios_base::app);
+                  out.open( cfg.filename, std::ios_base::out | std::ios_base::app, file_io_backend::blocking );
                }
             }
             catch( ... )
@@ -59,12 +125,44 @@ namespace fc {
             try
             {
               _rotation_task.cancel_and_wait("file_appender is destructing");
+              future<void> writer( [this] () {
+                 fc::scoped_lock<boost::mutex> lock( slock );
+                 return future<void>( _writer );
+              }() );
+              if( writer.valid() )
+                 writer.wait();
             }
             catch( ... )
             {
             }
          }
 
+         void write( const std::string& line )
+         {
+            fc::scoped_lock<boost::mutex> lock( slock );
+            if( async )
+            {
+               // never suspends the caller, which may be handling an exception
+               _pending += line;
+               start_writer();
+               return;
+            }
+            out << line;
+            if( cfg.flush )
+               out.flush();
+         }
+
+      private:
+         /** Makes sure that a writer takes care of _pending and _reopen, slock must be held */
+         void start_writer()
+         {
+            if( _writing )
+               return;
+            _writing = true;
+            _writer = fc::do_parallel( [this] () { write_pending(); }, "file_appender", detail::file_io_pool() );
+         }
+
+      public:
          void rotate_files( bool initializing = false )
          {
              FC_ASSERT( cfg.rotate );
@@ -87,12 +185,21 @@ namespace fc {
                        return;
                    }
 
-                   out.flush();
-                   out.close();
+                   if( async )
+                   {
+                       _reopen_path = log_filename;
+                       _reopen = true;
+                       start_writer();
+                   }
+                   else
+                   {
+                       out.flush();
+                       out.close();
+                       open_log_file( log_filename );
+                   }
                }
-               remove_all(link_filename);  // on windows, you can't delete the link while the underlying file is opened for writing
-               out.open( log_filename, std::ios_base::out | std::ios_base::app );
-               create_hard_link(log_filename, link_filename);
+               else
+                   open_log_file( log_filename );
              }
 
              /* Delete old log files */
@@ -175,12 +282,9 @@ namespace fc {
       std::string message = fc::format_string( m.get_format(), m.get_data(), my->cfg.max_object_depth );
       line << message.c_str();
 
-      {
-        fc::scoped_lock<boost::mutex> lock( my->slock );
-        my->out << line.str() << "\t\t\t" << m.get_context().get_file() << ":" << m.get_context().get_line_number() << "\n";
-        if( my->cfg.flush )
-          my->out.flush();
-      }
+      line << "\t\t\t" << m.get_context().get_file() << ":" << m.get_context().get_line_number() << "\n";
+
+      my->write( line.str() );
    }
 
 } // fc
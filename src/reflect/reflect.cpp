@@ -0,0 +1,41 @@
+#include <fc/reflect/reflect.hpp>
+#include <fc/exception/exception.hpp>
+
+namespace fc
+{
+   reflected_member_table::reflected_member_table( std::vector<reflected_member> members )
+   :_members( std::move(members) )
+   {
+      FC_ASSERT( _members.size() < 0x7fffffff );
+      size_t capacity = 8;
+      while( capacity < 2 * _members.size() )
+         capacity *= 2;
+      _slots.assign( capacity, 0 );
+      _first.resize( _members.size() );
+      for( uint32_t i = 0; i < _members.size(); ++i )
+      {
+         const reflected_member& m = _members[i];
+         size_t slot = m.hash & ( capacity - 1 );
+         while( _slots[slot] && !( _members[ _slots[slot] - 1 ].hash == m.hash
+                                   && strcmp( _members[ _slots[slot] - 1 ].name, m.name ) == 0 ) )
+            slot = ( slot + 1 ) & ( capacity - 1 );
+         if( !_slots[slot] )
+            _slots[slot] = i + 1;
+         _first[i] = _slots[slot] - 1;
+      }
+   }
+
+   size_t reflected_member_table::index_of( const char* name, size_t length )const
+   {
+      const uint64_t hash = reflected_name_hash( name, length );
+      const size_t mask = _slots.size() - 1;
+      for( size_t slot = hash & mask; _slots[slot]; slot = ( slot + 1 ) & mask )
+      {
+         const reflected_member& m = _members[ _slots[slot] - 1 ];
+         if( m.hash == hash && m.length == length && memcmp( m.name, name, length ) == 0 )
+            return _slots[slot] - 1;
+      }
+      return _members.size();
+   }
+
+} // namespace fc
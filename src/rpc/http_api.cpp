@@ -94,7 +94,7 @@ void http_api_connection::on_request( const fc::http::request& req, const fc::ht
 
       if( var_obj.contains( "method" ) )
       {
-         auto call = var.as<fc::rpc::request>(_max_conversion_depth);
+         auto call = std::move(var).as<fc::rpc::request>(_max_conversion_depth);
          try
          {
             try
@@ -93,7 +93,7 @@ std::string websocket_api_connection::on_message(
 
       if( var_obj.contains( "method" ) )
       {
-         auto call = var.as<fc::rpc::request>(_max_conversion_depth);
+         auto call = std::move(var).as<fc::rpc::request>(_max_conversion_depth);
          exception_ptr optexcept;
          try
          {
@@ -143,7 +143,7 @@ std::string websocket_api_connection::on_message(
       }
       else
       {
-         auto reply = var.as<fc::rpc::response>(_max_conversion_depth);
+         auto reply = std::move(var).as<fc::rpc::response>(_max_conversion_depth);
          _rpc_state.handle_reply( reply );
       }
    }
@@ -1,23 +1,61 @@
 #include <fc/shared_ptr.hpp>
+#include <boost/assert.hpp>
 #include <boost/atomic.hpp>
 #include <boost/memory_order.hpp>
 #include <assert.h>
 
 namespace fc {
+#ifndef NDEBUG
+  namespace {
+    /** @return an address that is unique to the calling thread */
+    const void* current_thread_tag() {
+#ifdef _MSC_VER
+      static __declspec(thread) char tag = 0;
+#else
+      static __thread char tag = 0;
+#endif
+      return &tag;
+    }
+  }
+#endif
+
   retainable::retainable()
-  :_ref_count(1) { 
+  :_ref_count(1),_single_threaded(false) { 
      static_assert( sizeof(_ref_count) == sizeof(boost::atomic<int32_t>), "failed to reserve enough space" );
   }
 
+  void retainable::set_single_threaded() {
+    _single_threaded = true;
+#ifndef NDEBUG
+    _owner = current_thread_tag();
+#endif
+  }
+
   retainable::~retainable() { 
     assert( _ref_count <= 0 );
     assert( _ref_count == 0 );
   }
   void retainable::retain() {
+    if( _single_threaded ) {
+#ifndef NDEBUG
+      BOOST_ASSERT( _owner == current_thread_tag() );
+#endif
+      _ref_count = _ref_count + 1;
+      return;
+    }
     ((boost::atomic<int32_t>*)&_ref_count)->fetch_add(1, boost::memory_order_relaxed );
   }
 
   void retainable::release() {
+    if( _single_threaded ) {
+#ifndef NDEBUG
+      BOOST_ASSERT( _owner == current_thread_tag() );
+#endif
+      _ref_count = _ref_count - 1;
+      if( 0 == _ref_count )
+        delete this;
+      return;
+    }
         boost::atomic_thread_fence(boost::memory_order_acquire);
     if( 1 == ((boost::atomic<int32_t>*)&_ref_count)->fetch_sub(1, boost::memory_order_release ) ) {
         delete this;
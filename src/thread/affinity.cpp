@@ -0,0 +1,59 @@
+#include <fc/thread/affinity.hpp>
+#include <fc/exception/exception.hpp>
+
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#ifdef __linux__
+# include <pthread.h>
+# include <sched.h>
+#endif
+
+namespace fc {
+
+   void set_current_thread_affinity( const std::vector<int>& cpus )
+   {
+#ifdef __linux__
+      cpu_set_t set;
+      CPU_ZERO( &set );
+      if( cpus.empty() )
+      {
+         for( int cpu = 0; cpu < CPU_SETSIZE; ++cpu )
+            CPU_SET( cpu, &set );
+      }
+      for( int cpu : cpus )
+      {
+         FC_ASSERT( cpu >= 0 && cpu < CPU_SETSIZE, "invalid CPU number ${cpu}", ("cpu",cpu) );
+         CPU_SET( cpu, &set );
+      }
+      const int err = pthread_setaffinity_np( pthread_self(), sizeof(set), &set );
+      FC_ASSERT( err == 0, "setting the CPU affinity failed: ${err}", ("err",err) );
+#endif
+   }
+
+   std::vector<int> numa_node_cpus( int node )
+   {
+      std::vector<int> cpus;
+#ifdef __linux__
+      // e.g. "0-7,16-23"
+      std::ifstream in( "/sys/devices/system/node/node" + std::to_string( node ) + "/cpulist" );
+      std::string range;
+      while( std::getline( in, range, ',' ) )
+      {
+         std::istringstream parse( range );
+         int first = -1, last = -1;
+         char dash = 0;
+         parse >> first;
+         if( parse >> dash >> last )
+            FC_ASSERT( dash == '-' && last >= first, "bad cpulist of NUMA node ${n}", ("n",node) );
+         else
+            last = first;
+         for( int cpu = first; cpu >= 0 && cpu <= last; ++cpu )
+            cpus.push_back( cpu );
+      }
+#endif
+      return cpus;
+   }
+
+} // namespace fc
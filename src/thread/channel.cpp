@@ -0,0 +1,62 @@
+#include <fc/thread/channel.hpp>
+#include <fc/thread/thread.hpp>
+#include "context.hpp"
+#include "lock_waiter.hpp"
+#include "thread_d.hpp"
+
+namespace fc { namespace detail {
+
+  channel_base::channel_base()
+  {
+    m_senders.head = m_senders.tail = nullptr;
+    m_receivers.head = m_receivers.tail = nullptr;
+  }
+
+  channel_base::~channel_base()
+  {
+    BOOST_ASSERT( !m_senders.head && !m_receivers.head && "Attempt to free channel while others are blocking on it." );
+  }
+
+  void channel_base::wait( waiter_list& list, fc::unique_lock<fc::spin_yield_lock>& lock )
+  {
+    lock_waiter w;
+    fc::thread& t = fc::thread::current();
+    if( !t.my->current )
+      t.my->current = new fc::context( &t );
+    w.ctx = t.my->current;
+    w.ctx->waiting_on_lock = true;
+    push_waiter( list.head, list.tail, w );
+    lock.unlock();
+
+    std::exception_ptr e; // relocking may yield, so the exception is moved out of the catch block
+    try
+    {
+      t.yield(false);
+    }
+    catch( ... )
+    {
+      e = std::current_exception();
+    }
+    w.ctx->waiting_on_lock = false;
+    lock_after_wait( lock, e );
+    if( !e )
+      return;
+    // a notification that reached this fiber must not get lost
+    if( !remove_waiter( list.head, list.tail, w ) )
+      notify( list, 1 );
+    std::rethrow_exception( e );
+  }
+
+  void channel_base::notify( waiter_list& list, size_t n )
+  {
+    while( n-- && list.head )
+    {
+      lock_waiter* w = pop_waiter( list.head, list.tail );
+      fc::context* c = w->ctx;
+      w->granted = true; // w may go out of scope as soon as its fiber resumes
+      if( c->claim_lock_wakeup() )
+        c->ctx_thread->my->unblock( c );
+    }
+  }
+
+} } // namespace fc::detail
@@ -1,9 +1,12 @@
 #pragma once
 #include <fc/thread/thread.hpp>
+#include <fc/thread/object_pool.hpp>
 #include <fc/exception/exception.hpp>
+#include <algorithm>
 #include <vector>
 
 #include <boost/version.hpp>
+#include <boost/atomic.hpp>
 
 #define BOOST_COROUTINES_NO_DEPRECATION_WARNING // Boost 1.61
 #define BOOST_COROUTINE_NO_DEPRECATION_WARNING // Boost 1.62
@@ -18,19 +21,10 @@
   #include <boost/coroutine/stack_allocator.hpp>
   namespace bc  = boost::context::detail;
   namespace bco = boost::coroutines;
-  typedef bco::stack_allocator stack_allocator;
 #elif BOOST_VERSION >= 105400
 # include <boost/coroutine/stack_context.hpp>
   namespace bc  = boost::context;
   namespace bco = boost::coroutines;
-# if BOOST_VERSION >= 105600 && !defined(NDEBUG)
-#  include <boost/assert.hpp>
-#  include <boost/coroutine/protected_stack_allocator.hpp>
-  typedef bco::protected_stack_allocator stack_allocator;
-# else
-#  include <boost/coroutine/stack_allocator.hpp>
-  typedef bco::stack_allocator stack_allocator;
-# endif
 
 #elif BOOST_VERSION >= 105300
   #include <boost/coroutine/stack_allocator.hpp>
@@ -43,10 +37,30 @@
   namespace bco = boost::coroutine;
 #endif
 
+#if BOOST_VERSION >= 105400
+namespace fc { namespace detail {
+  /**
+   *  Takes fiber stacks from the process-wide cache, see fc/thread/fiber_stack.hpp.
+   *  Stateless, so every thread_d can hold its own instance.
+   */
+  struct fiber_stack_allocator {
+    void allocate( bco::stack_context& ctx );
+    void deallocate( bco::stack_context& ctx );
+    /**
+     *  Measures the stack depth reached so far and adds it to the process-wide maximum.
+     *  @return the depth, or 0 unless fiber_stack_config::track_high_water_mark is set
+     */
+    size_t record_high_water_mark( bco::stack_context& ctx );
+  };
+} }
+typedef fc::detail::fiber_stack_allocator stack_allocator;
+#endif
+
 namespace fc {
   class thread;
   class promise_base;
   class task_base;
+  class variant_arena;
 
   /**
    *  maintains information associated with each context such as
@@ -69,8 +83,10 @@ namespace fc {
     context( context_fn sf, stack_allocator& alloc, fc::thread* t )
     : caller_context(0),
       stack_alloc(&alloc),
+      stack_high_water_mark(0),
       next_blocked(0), 
       next_blocked_mutex(0), 
+      waiting_on_lock(false),
       next(0), 
       ctx_thread(t),
       canceled(false),
@@ -79,15 +95,14 @@ namespace fc {
 #endif
       complete(false),
       cur_task(0),
-      context_posted_num(0)
+      context_posted_num(0),
+      arena(nullptr)
     {
 #if BOOST_VERSION >= 105600
-     size_t stack_size = FC_CONTEXT_STACK_SIZE;
-     alloc.allocate(stack_ctx, stack_size);
+     alloc.allocate(stack_ctx);
      my_context = bc::make_fcontext( stack_ctx.sp, stack_ctx.size, sf); 
 #elif BOOST_VERSION >= 105400
-     size_t stack_size = FC_CONTEXT_STACK_SIZE;
-     alloc.allocate(stack_ctx, stack_size);
+     alloc.allocate(stack_ctx);
      my_context = bc::make_fcontext( stack_ctx.sp, stack_ctx.size, sf);
 #elif BOOST_VERSION >= 105300
      size_t stack_size = FC_CONTEXT_STACK_SIZE;
@@ -99,6 +114,7 @@ namespace fc {
      my_context.fc_stack.limit = static_cast<char*>( my_context.fc_stack.base) - stack_size;
      make_fcontext( &my_context, sf );
 #endif
+     timer.owner = this;
     }
 
     context( fc::thread* t) :
@@ -109,8 +125,10 @@ namespace fc {
 #endif
      caller_context(0),
      stack_alloc(0),
+     stack_high_water_mark(0),
      next_blocked(0), 
      next_blocked_mutex(0), 
+     waiting_on_lock(false),
      next(0), 
      ctx_thread(t),
      canceled(false),
@@ -119,8 +137,14 @@ namespace fc {
 #endif
      complete(false),
      cur_task(0),
-     context_posted_num(0)
-    {}
+     context_posted_num(0),
+     arena(nullptr)
+    {
+     timer.owner = this;
+    }
+
+    static void* operator new( std::size_t size ) { return detail::pool_allocate( size ); }
+    static void  operator delete( void* p, std::size_t size ) { detail::pool_free( p, size ); }
 
     ~context() {
 #if BOOST_VERSION >= 105600
@@ -153,6 +177,7 @@ namespace fc {
       resume_time = fc::time_point();
       next_blocked = nullptr;
       next_blocked_mutex = nullptr;
+      waiting_on_lock = false;
       next = nullptr;
       complete = false;
     }
@@ -225,6 +250,26 @@ namespace fc {
 
     bool is_complete()const { return complete; }
 
+    /**
+     *  Called by a lock that grants this context's wait and by task_base::cancel(),
+     *  possibly on different threads. Only the first caller may unblock the context.
+     */
+    bool claim_lock_wakeup()
+    {
+      bool expected = true;
+      return waiting_on_lock.compare_exchange_strong( expected, false );
+    }
+
+    /** @return the deepest use of this context's stack so far, see fiber_stack_config::track_high_water_mark */
+    size_t record_stack_high_water_mark()
+    {
+#if BOOST_VERSION >= 105400
+      if( stack_alloc )
+        stack_high_water_mark = std::max( stack_high_water_mark, stack_alloc->record_high_water_mark( stack_ctx ) );
+#endif
+      return stack_high_water_mark;
+    }
+
 
 
 #if BOOST_VERSION >= 105300 && BOOST_VERSION < 105600
@@ -234,13 +279,16 @@ namespace fc {
 #endif
     fc::context*                caller_context;
     stack_allocator*            stack_alloc;
+    size_t                       stack_high_water_mark; // measured while fiber stack tracking is enabled
     priority                     prio;
     //promise_base*              prom; 
     std::vector<blocked_promise> blocking_prom;
     time_point                   resume_time;
+    detail::timer_link           timer;       // entry in the sleep wheel, if the thread uses one
    // time_point                   ready_time; // time that this context was put on ready queue
     fc::context*                next_blocked;
     fc::context*                next_blocked_mutex;
+    boost::atomic<bool>          waiting_on_lock; // blocked in a shared_mutex, semaphore or channel
     fc::context*                next;
     fc::thread*                 ctx_thread;
     bool                         canceled;
@@ -250,6 +298,7 @@ namespace fc {
     bool                         complete;
     task_base*                   cur_task;
     uint64_t                     context_posted_num; // serial number set each tiem the context is added to the ready list
+    variant_arena*               arena;       // the innermost variant_arena of the fiber
   };
 
 } // naemspace fc 
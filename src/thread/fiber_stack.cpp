@@ -0,0 +1,287 @@
+#include <fc/thread/fiber_stack.hpp>
+#include <fc/exception/exception.hpp>
+#include "thread_d.hpp"
+
+#include <boost/atomic.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <vector>
+
+#ifdef _WIN32
+# include <windows.h>
+#else
+# include <sys/mman.h>
+# include <unistd.h>
+#endif
+
+namespace fc {
+   namespace detail {
+      namespace {
+         const size_t min_stack_size = 16 * 1024;
+         const size_t huge_page_size = 2 * 1024 * 1024;
+
+         /** Kept at the top of every stack, so that a stack can be unmapped without knowing its config */
+         struct stack_header
+         {
+            char*  mapping;
+            size_t mapping_size;
+            size_t stack_size;
+            bool   guard_page;
+            bool   huge_pages;
+         };
+
+         size_t page_size()
+         {
+#ifdef _WIN32
+            SYSTEM_INFO info;
+            GetSystemInfo( &info );
+            static const size_t size = info.dwPageSize;
+#else
+            static const size_t size = sysconf( _SC_PAGESIZE );
+#endif
+            return size;
+         }
+
+         size_t round_up( size_t n, size_t multiple ) { return (n + multiple - 1) / multiple * multiple; }
+
+         struct stack_cache
+         {
+            boost::mutex              lock;
+            fiber_stack_config        config;
+            boost::atomic<bool>       track{false}; // copy of config.track_high_water_mark, read without the lock
+            std::vector<stack_header*> idle;
+            uint64_t                  allocations = 0;
+            uint64_t                  reuses = 0;
+            uint64_t                  in_use = 0;
+            size_t                    high_water_mark = 0;
+
+            bool matches_config( const stack_header* h )const
+            {
+               return h->stack_size == round_up( config.stack_size, page_size() )
+                      && h->guard_page == config.guard_page && h->huge_pages == config.huge_pages;
+            }
+         };
+
+         // never destroyed, contexts may be released during static destruction
+         stack_cache& get_stack_cache()
+         {
+            static stack_cache* cache = new stack_cache();
+            return *cache;
+         }
+
+         /** Maps a stack with a header at its top. The lock is not held, so config is a copy. */
+         stack_header* map_stack( const fiber_stack_config& config )
+         {
+            const size_t page = page_size();
+            const size_t stack_size = round_up( config.stack_size, page );
+            const size_t guard = config.guard_page ? page : 0;
+            size_t mapping_size = round_up( stack_size + sizeof(stack_header), page ) + guard;
+            char* mapping = nullptr;
+#ifdef _WIN32
+            mapping = static_cast<char*>( VirtualAlloc( 0, mapping_size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE ) );
+            FC_ASSERT( mapping, "unable to allocate a fiber stack of ${n} bytes", ("n",mapping_size) );
+            DWORD old_protection;
+            if( guard && !VirtualProtect( mapping, guard, PAGE_READWRITE | PAGE_GUARD, &old_protection ) )
+            {
+               VirtualFree( mapping, 0, MEM_RELEASE );
+               FC_THROW( "unable to protect the guard page of a fiber stack" );
+            }
+#else
+# ifdef MAP_HUGETLB
+            // a guard page cannot be protected within a huge page, and a smaller stack would be rounded up to one
+            if( config.huge_pages && !guard && mapping_size >= huge_page_size )
+            {
+               const size_t huge_size = round_up( mapping_size, huge_page_size );
+               void* p = mmap( 0, huge_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0 );
+               if( p != MAP_FAILED )
+               {
+                  mapping = static_cast<char*>( p );
+                  mapping_size = huge_size;
+               }
+            }
+# endif
+            if( !mapping )
+            {
+               void* p = mmap( 0, mapping_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+               FC_ASSERT( p != MAP_FAILED, "unable to allocate a fiber stack of ${n} bytes", ("n",mapping_size) );
+               mapping = static_cast<char*>( p );
+# ifdef MADV_HUGEPAGE
+               if( config.huge_pages )
+                  madvise( mapping, mapping_size, MADV_HUGEPAGE );
+# endif
+            }
+            if( guard && mprotect( mapping, guard, PROT_NONE ) != 0 )
+            {
+               const int error = errno;
+               munmap( mapping, mapping_size );
+               FC_THROW( "unable to protect the guard page of a fiber stack: ${e}", ("e",strerror(error)) );
+            }
+#endif
+            stack_header* h = reinterpret_cast<stack_header*>( mapping + mapping_size ) - 1;
+            h->mapping = mapping;
+            h->mapping_size = mapping_size;
+            h->stack_size = stack_size;
+            h->guard_page = config.guard_page;
+            h->huge_pages = config.huge_pages;
+            return h;
+         }
+
+         void unmap_stack( stack_header* h )
+         {
+#ifdef _WIN32
+            VirtualFree( h->mapping, 0, MEM_RELEASE );
+#else
+            munmap( h->mapping, h->mapping_size );
+#endif
+         }
+
+         const char* stack_bottom( const stack_header* h ) { return reinterpret_cast<const char*>( h ) - h->stack_size; }
+
+         /**
+          *  Fresh stacks are zero-filled, and reused ones are cleared again while
+          *  tracking is enabled, so the lowest non-zero word marks the deepest
+          *  point the stack has reached since it was handed to its context.
+          */
+         size_t measure_high_water_mark( const stack_header* h )
+         {
+            const uint64_t* word = reinterpret_cast<const uint64_t*>( stack_bottom( h ) );
+            const uint64_t* top = reinterpret_cast<const uint64_t*>( h );
+            while( word < top && !*word )
+               ++word;
+            return reinterpret_cast<const char*>( top ) - reinterpret_cast<const char*>( word );
+         }
+
+         /** Zeroes the part of a reused stack that its previous context dirtied */
+         void clear_stack( stack_header* h )
+         {
+            const size_t used = measure_high_water_mark( h );
+            memset( reinterpret_cast<char*>( h ) - used, 0, used );
+         }
+      }
+
+      void fiber_stack_allocator::allocate( bco::stack_context& ctx )
+      {
+         stack_cache& cache = get_stack_cache();
+         stack_header* h = nullptr;
+         fiber_stack_config config;
+         {
+            boost::unique_lock<boost::mutex> lock( cache.lock );
+            if( !cache.idle.empty() )
+            {
+               h = cache.idle.back();
+               cache.idle.pop_back();
+               ++cache.reuses;
+            }
+            else
+               ++cache.allocations;
+            ++cache.in_use;
+            config = cache.config;
+         }
+         if( !h )
+         {
+            try
+            {
+               h = map_stack( config );
+            }
+            catch( ... )
+            {
+               boost::unique_lock<boost::mutex> lock( cache.lock );
+               --cache.allocations;
+               --cache.in_use;
+               throw;
+            }
+         }
+         else if( cache.track.load( boost::memory_order_relaxed ) )
+            clear_stack( h );
+         ctx.sp = h;
+         ctx.size = h->stack_size;
+      }
+
+      void fiber_stack_allocator::deallocate( bco::stack_context& ctx )
+      {
+         stack_header* h = static_cast<stack_header*>( ctx.sp );
+         stack_cache& cache = get_stack_cache();
+         const size_t used = cache.track.load( boost::memory_order_relaxed ) ? measure_high_water_mark( h ) : 0;
+         {
+            boost::unique_lock<boost::mutex> lock( cache.lock );
+            --cache.in_use;
+            cache.high_water_mark = std::max( cache.high_water_mark, used );
+            if( cache.matches_config( h ) && cache.idle.size() < cache.config.max_cached )
+            {
+               cache.idle.push_back( h );
+               h = nullptr;
+            }
+         }
+         if( h )
+            unmap_stack( h );
+      }
+
+      size_t fiber_stack_allocator::record_high_water_mark( bco::stack_context& ctx )
+      {
+         stack_cache& cache = get_stack_cache();
+         if( !cache.track.load( boost::memory_order_relaxed ) )
+            return 0;
+         const size_t used = measure_high_water_mark( static_cast<const stack_header*>( ctx.sp ) );
+         boost::unique_lock<boost::mutex> lock( cache.lock );
+         cache.high_water_mark = std::max( cache.high_water_mark, used );
+         return used;
+      }
+   } // namespace detail
+
+   void set_fiber_stack_config( const fiber_stack_config& cfg )
+   {
+      FC_ASSERT( cfg.stack_size >= detail::min_stack_size, "fiber stacks must have at least ${min} bytes",
+                 ("min",detail::min_stack_size) );
+      detail::stack_cache& cache = detail::get_stack_cache();
+      std::vector<detail::stack_header*> stale;
+      {
+         boost::unique_lock<boost::mutex> lock( cache.lock );
+         cache.config = cfg;
+         cache.track.store( cfg.track_high_water_mark );
+         for( detail::stack_header* h : cache.idle )
+            if( !cache.matches_config( h ) )
+               stale.push_back( h );
+         cache.idle.erase( std::remove_if( cache.idle.begin(), cache.idle.end(),
+                                           [&cache] ( detail::stack_header* h ) { return !cache.matches_config( h ); } ),
+                           cache.idle.end() );
+         while( cache.idle.size() > cache.config.max_cached )
+         {
+            stale.push_back( cache.idle.back() );
+            cache.idle.pop_back();
+         }
+      }
+      for( detail::stack_header* h : stale )
+         detail::unmap_stack( h );
+   }
+
+   fiber_stack_config get_fiber_stack_config()
+   {
+      detail::stack_cache& cache = detail::get_stack_cache();
+      boost::unique_lock<boost::mutex> lock( cache.lock );
+      return cache.config;
+   }
+
+   size_t get_fiber_stack_high_water_mark()
+   {
+      fc::context* c = thread::current().my->current;
+      return c ? c->record_stack_high_water_mark() : 0;
+   }
+
+   fiber_stack_stats get_fiber_stack_stats()
+   {
+      detail::stack_cache& cache = detail::get_stack_cache();
+      boost::unique_lock<boost::mutex> lock( cache.lock );
+      fiber_stack_stats stats;
+      stats.stack_size = detail::round_up( cache.config.stack_size, detail::page_size() );
+      stats.allocations = cache.allocations;
+      stats.reuses = cache.reuses;
+      stats.in_use = cache.in_use;
+      stats.cached = cache.idle.size();
+      stats.high_water_mark = cache.high_water_mark;
+      return stats;
+   }
+
+} // namespace fc
@@ -0,0 +1,267 @@
+#include <fc/thread/fiber_trace.hpp>
+#include <fc/thread/thread.hpp>
+#include <fc/exception/exception.hpp>
+#include <fc/filesystem.hpp>
+#include <fc/io/json.hpp>
+#include <fc/variant_object.hpp>
+
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/tss.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace fc {
+   thread*& current_thread();
+
+   namespace detail {
+      boost::atomic<bool> fiber_trace_enabled( false );
+
+      namespace {
+         struct trace_event
+         {
+            int64_t          time;  // microseconds since the epoch
+            const char*      name;
+            const void*      id;
+            const void*      fiber;
+            uint64_t         arg;
+            trace_event_kind kind;
+         };
+
+         /**
+          *  Written only by its own thread. The reader copies events without
+          *  synchronization and then drops the ones that were overwritten in
+          *  the meantime.
+          */
+         struct trace_buffer
+         {
+            std::vector<trace_event> events;   // size is a power of two
+            boost::atomic<uint64_t>  head{0};  // number of events ever written
+            uint64_t                 begin = 0; // first event of the current trace
+            uint64_t                 generation = 0;
+            std::string              thread_name;
+            boost::atomic<bool>      retired{false};
+         };
+
+         struct trace_registry
+         {
+            boost::mutex               lock;
+            std::vector<trace_buffer*> buffers;
+            size_t                     capacity = 0;
+            boost::atomic<uint64_t>    generation{0};
+            int64_t                    start_time = 0;
+         };
+
+         // never destroyed, threads may record events during static destruction
+         trace_registry& get_trace_registry()
+         {
+            static trace_registry* registry = new trace_registry();
+            return *registry;
+         }
+
+         trace_buffer*& current_buffer()
+         {
+#ifdef _MSC_VER
+            static __declspec(thread) trace_buffer* b = NULL;
+#else
+            static __thread trace_buffer* b = NULL;
+#endif
+            return b;
+         }
+
+         /** Buffers outlive their thread until the next trace starts, so that its events can still be saved */
+         void retire_buffer( trace_buffer* b )
+         {
+            b->retired.store( true );
+            current_buffer() = nullptr;
+         }
+
+         size_t round_up_to_power_of_two( size_t n )
+         {
+            size_t p = 1;
+            while( p < n )
+               p <<= 1;
+            return p;
+         }
+
+         /** Brings the buffer of this thread up to date with the current trace, called on the slow path only */
+         trace_buffer* sync_buffer( trace_buffer* b )
+         {
+            trace_registry& registry = get_trace_registry();
+            boost::unique_lock<boost::mutex> lock( registry.lock );
+            if( !b )
+            {
+               b = new trace_buffer();
+               thread* t = current_thread();
+               b->thread_name = t ? t->name() : "thread " + std::to_string( registry.buffers.size() );
+               registry.buffers.push_back( b );
+               // never destroyed, so that it can still be used during static destruction
+               static boost::thread_specific_ptr<trace_buffer>* cleanup =
+                  new boost::thread_specific_ptr<trace_buffer>( &retire_buffer );
+               cleanup->reset( b );
+               current_buffer() = b;
+            }
+            if( b->events.size() != registry.capacity )
+            {
+               b->events.assign( registry.capacity, trace_event() );
+               b->head.store( 0 );
+            }
+            b->begin = b->head.load( boost::memory_order_relaxed );
+            b->generation = registry.generation.load( boost::memory_order_relaxed );
+            return b;
+         }
+
+         std::string to_id( const void* p )
+         {
+            char buf[2 + 2 * sizeof(void*) + 1];
+            std::snprintf( buf, sizeof(buf), "0x%llx", (unsigned long long)(uintptr_t)p );
+            return buf;
+         }
+
+         /** Turns the events of one thread into chrome trace events, fibers become the threads of process pid */
+         void convert_events( const std::vector<trace_event>& events, const std::string& thread_name, int pid,
+                              int64_t start_time, variants& out )
+         {
+            std::map<const void*, int> fiber_ids; // tid 0 is the thread outside of any fiber
+            std::set<int> running;
+            auto tid_of = [&]( const void* fiber ) -> int {
+               if( !fiber )
+                  return 0;
+               auto ins = fiber_ids.insert( std::make_pair( fiber, int(fiber_ids.size()) + 1 ) );
+               if( ins.second )
+                  out.push_back( mutable_variant_object( "ph", "M" )( "name", "thread_name" )( "pid", pid )( "tid", ins.first->second )
+                                 ( "args", mutable_variant_object( "name", "fiber " + std::to_string( ins.first->second ) ) ) );
+               return ins.first->second;
+            };
+            auto event = [&]( const char* ph, const char* name, int64_t time, int tid ) {
+               return mutable_variant_object( "ph", ph )( "name", name )( "pid", pid )( "tid", tid )( "ts", time - start_time );
+            };
+
+            out.push_back( mutable_variant_object( "ph", "M" )( "name", "process_name" )( "pid", pid )
+                           ( "args", mutable_variant_object( "name", thread_name ) ) );
+            int64_t last_time = start_time;
+            for( const trace_event& e : events )
+            {
+               last_time = e.time;
+               const int tid = tid_of( e.fiber );
+               switch( e.kind )
+               {
+                  case trace_event_kind::context_switch:
+                  {
+                     if( running.erase( tid ) )
+                        out.push_back( event( "E", "running", e.time, tid ) );
+                     const int next = tid_of( e.id );
+                     if( running.insert( next ).second )
+                        out.push_back( event( "B", "running", e.time, next ) );
+                     break;
+                  }
+                  case trace_event_kind::task_start:
+                  case trace_event_kind::task_end:
+                     out.push_back( event( e.kind == trace_event_kind::task_start ? "b" : "e", e.name, e.time, tid )
+                                    ( "cat", "task" )( "id", to_id( e.id ) ) );
+                     break;
+                  case trace_event_kind::wait:
+                     out.push_back( event( "i", "wait", e.time, tid )( "s", "t" )
+                                    ( "args", mutable_variant_object( "promise", e.name )( "id", to_id( e.id ) ) ) );
+                     break;
+                  case trace_event_kind::wake:
+                     out.push_back( event( "i", "wake", e.time, tid )( "s", "t" )
+                                    ( "args", mutable_variant_object( "promise", e.name )( "id", to_id( e.id ) ) ) );
+                     // ends the arrow from the asio completion, if there was one
+                     out.push_back( event( "f", "completion", e.time, tid )( "cat", "promise" )( "id", to_id( e.id ) )( "bp", "e" ) );
+                     break;
+                  case trace_event_kind::asio_completion:
+                     out.push_back( event( "i", "asio completion", e.time, tid )( "s", "t" )
+                                    ( "args", mutable_variant_object( "promise", e.name )( "bytes", e.arg ) ) );
+                     out.push_back( event( "s", "completion", e.time, tid )( "cat", "promise" )( "id", to_id( e.id ) ) );
+                     break;
+               }
+            }
+            for( int tid : running )
+               out.push_back( event( "E", "running", last_time, tid ) );
+         }
+      }
+
+      void record_trace_event( trace_event_kind kind, const char* name, const void* id,
+                               const void* fiber, uint64_t arg )
+      {
+         trace_buffer* b = current_buffer();
+         if( !b || b->generation != get_trace_registry().generation.load( boost::memory_order_relaxed ) )
+            b = sync_buffer( b );
+         const uint64_t h = b->head.load( boost::memory_order_relaxed );
+         trace_event& e = b->events[h & (b->events.size() - 1)];
+         e.time  = time_point::now().time_since_epoch().count();
+         e.name  = name ? name : "?";
+         e.id    = id;
+         e.fiber = fiber;
+         e.arg   = arg;
+         e.kind  = kind;
+         b->head.store( h + 1, boost::memory_order_release );
+      }
+   } // namespace detail
+
+   void start_fiber_trace( size_t events_per_thread )
+   {
+      FC_ASSERT( events_per_thread > 0 );
+      detail::trace_registry& registry = detail::get_trace_registry();
+      boost::unique_lock<boost::mutex> lock( registry.lock );
+      registry.buffers.erase( std::remove_if( registry.buffers.begin(), registry.buffers.end(),
+                                              []( detail::trace_buffer* b ) {
+                                                 if( !b->retired.load() )
+                                                    return false;
+                                                 delete b;
+                                                 return true;
+                                              } ),
+                              registry.buffers.end() );
+      registry.capacity = detail::round_up_to_power_of_two( events_per_thread );
+      registry.start_time = time_point::now().time_since_epoch().count();
+      registry.generation.fetch_add( 1 );
+      detail::fiber_trace_enabled.store( true );
+   }
+
+   void stop_fiber_trace()
+   {
+      detail::fiber_trace_enabled.store( false );
+   }
+
+   variant get_fiber_trace()
+   {
+      detail::trace_registry& registry = detail::get_trace_registry();
+      variants trace_events;
+      boost::unique_lock<boost::mutex> lock( registry.lock );
+      const uint64_t generation = registry.generation.load();
+      int pid = 0;
+      for( detail::trace_buffer* b : registry.buffers )
+      {
+         // threads that did not record anything since the trace started still hold old events
+         if( b->generation != generation )
+            continue;
+         const uint64_t capacity = b->events.size();
+         const uint64_t head = b->head.load( boost::memory_order_acquire );
+         uint64_t first = std::max( b->begin, head > capacity ? head - capacity : 0 );
+         std::vector<detail::trace_event> events;
+         events.reserve( head - first );
+         for( uint64_t i = first; i < head; ++i )
+            events.push_back( b->events[i & (capacity - 1)] );
+         // the copies above must not be reordered past the check below
+         boost::atomic_thread_fence( boost::memory_order_acquire );
+         // events before head_after - capacity were overwritten, and the writer may be at that one
+         const uint64_t head_after = b->head.load( boost::memory_order_relaxed );
+         if( head_after + 1 > capacity + first )
+            events.erase( events.begin(), events.begin() + std::min<uint64_t>( head_after + 1 - capacity - first, events.size() ) );
+         detail::convert_events( events, b->thread_name, ++pid, registry.start_time, trace_events );
+      }
+      return mutable_variant_object( "traceEvents", variant( std::move(trace_events) ) )
+                                   ( "displayTimeUnit", "ms" );
+   }
+
+   void save_fiber_trace( const fc::path& file )
+   {
+      json::save_to_file( get_fiber_trace(), file, false, json::legacy_generator );
+   }
+
+} // namespace fc
@@ -0,0 +1,407 @@
+#include <fc/thread/fiber_watchdog.hpp>
+#include <fc/thread/thread.hpp>
+#include <fc/exception/exception.hpp>
+#include <fc/log/logger.hpp>
+#include <fc/variant_object.hpp>
+
+#include <boost/thread.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/tss.hpp>
+#include <boost/version.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#if defined(__linux__) && BOOST_VERSION / 100 >= 1065
+# define FC_WATCHDOG_SAMPLES_STACKS 1
+# include <boost/stacktrace.hpp>
+# include <pthread.h>
+# include <signal.h>
+#endif
+
+namespace fc {
+   thread*& current_thread();
+
+   namespace detail {
+      boost::atomic<bool> fiber_watchdog_enabled( false );
+
+      namespace {
+         /** The slice that an OS thread is running, written by that thread only */
+         struct slice_slot
+         {
+            boost::atomic<int64_t>     start{0};       // microseconds since the epoch, 0 while idle
+            boost::atomic<const char*> desc{nullptr};
+            boost::atomic<uint64_t>    number{0};      // slices started, the monitor reports each one once
+            uint64_t                   reported = 0;   // used by the monitor only
+            std::string                thread_name;
+            boost::atomic<bool>        retired{false};
+            bool                       sampled = false; // guarded by the lock, the thread may not exit while set
+#ifdef FC_WATCHDOG_SAMPLES_STACKS
+            pthread_t                  os_thread;
+#endif
+         };
+
+         struct long_slice
+         {
+            std::string              thread_name;
+            std::string              desc;
+            int64_t                  duration_us;
+            time_point               when;
+            bool                     running;
+            std::vector<std::string> stack;
+         };
+
+         /** A long slice to be logged by the monitor thread */
+         struct warning
+         {
+            std::string thread_name;
+            std::string desc;
+            int64_t     duration_us;
+            bool        running;
+            uint64_t    suppressed;
+         };
+
+         struct watchdog_state
+         {
+            boost::mutex                     lock;  // guards everything but the atomics
+            std::vector<slice_slot*>         slots;
+            boost::atomic<int64_t>           budget_us{0};
+            fiber_watchdog_options           options;
+            std::deque<long_slice>           history;
+            time_point                       last_log;
+            uint64_t                         suppressed = 0;
+            std::vector<warning>             warnings;
+
+            // logs the warnings, and reports running slices if options.monitor is set
+            boost::thread*                   monitor = nullptr;
+            boost::condition_variable        wake;
+            boost::atomic<bool>              monitor_stop{false};
+            boost::condition_variable        sample_done; // wakes threads that wait to retire their slot
+         };
+
+         // never destroyed, threads may switch fibers during static destruction
+         watchdog_state& get_watchdog()
+         {
+            static watchdog_state* state = new watchdog_state();
+            return *state;
+         }
+
+         slice_slot*& current_slot()
+         {
+#ifdef _MSC_VER
+            static __declspec(thread) slice_slot* s = NULL;
+#else
+            static __thread slice_slot* s = NULL;
+#endif
+            return s;
+         }
+
+         /** Slots outlive their thread, the monitor frees them */
+         void retire_slot( slice_slot* s )
+         {
+            watchdog_state& w = get_watchdog();
+            boost::unique_lock<boost::mutex> lock( w.lock );
+            while( s->sampled ) // the monitor is about to signal this thread
+               w.sample_done.wait( lock );
+            s->retired.store( true );
+            current_slot() = nullptr;
+         }
+
+         slice_slot* register_slot()
+         {
+            slice_slot* s = new slice_slot();
+            thread* t = current_thread();
+            s->thread_name = t ? t->name() : "?";
+#ifdef FC_WATCHDOG_SAMPLES_STACKS
+            s->os_thread = pthread_self();
+#endif
+            watchdog_state& w = get_watchdog();
+            {
+               boost::unique_lock<boost::mutex> lock( w.lock );
+               w.slots.push_back( s );
+            }
+            // never destroyed, so that it can still be used during static destruction
+            static boost::thread_specific_ptr<slice_slot>* cleanup =
+               new boost::thread_specific_ptr<slice_slot>( &retire_slot );
+            cleanup->reset( s );
+            current_slot() = s;
+            return s;
+         }
+
+         /**
+          *  Called with w.lock held, possibly from within the scheduler, so the
+          *  warning is only queued for the monitor thread.
+          *
+          *  @return true if a warning was queued
+          */
+         bool report( watchdog_state& w, long_slice&& r )
+         {
+            bool queued = false;
+            if( w.options.log_interval.count() > 0 )
+            {
+               if( r.when - w.last_log >= w.options.log_interval )
+               {
+                  w.warnings.push_back( warning{ r.thread_name, r.desc, r.duration_us, r.running, w.suppressed } );
+                  w.last_log = r.when;
+                  w.suppressed = 0;
+                  queued = true;
+               }
+               else
+                  ++w.suppressed;
+            }
+            w.history.push_front( std::move(r) );
+            while( w.history.size() > w.options.history )
+               w.history.pop_back();
+            return queued;
+         }
+
+         /** Called with w.lock held, which is released while the appenders run */
+         void log_warnings( watchdog_state& w, boost::unique_lock<boost::mutex>& lock )
+         {
+            if( w.warnings.empty() )
+               return;
+            std::vector<warning> warnings;
+            warnings.swap( w.warnings );
+            lock.unlock();
+            for( const warning& r : warnings )
+               wlog( "${task} on thread ${thread} ${state} for ${ms} ms without yielding${more}",
+                     ("task",r.desc)("thread",r.thread_name)("state",r.running ? "is running" : "ran")
+                     ("ms",r.duration_us / 1000)
+                     ("more",r.suppressed ? " (" + std::to_string( r.suppressed ) + " more since the last warning)" : "") );
+            lock.lock();
+         }
+
+#ifdef FC_WATCHDOG_SAMPLES_STACKS
+         char                 sample_buffer[8192];
+         volatile sig_atomic_t sample_requested = 0;
+         volatile sig_atomic_t sample_taken = 0;
+         struct sigaction     previous_action;
+
+         void sample_signal_handler( int )
+         {
+            if( !sample_requested )
+               return;
+            sample_requested = 0;
+            boost::stacktrace::safe_dump_to( sample_buffer, sizeof(sample_buffer) );
+            sample_taken = 1;
+         }
+
+         /** Called without w.lock, s->sampled keeps the thread of s from exiting */
+         std::vector<std::string> sample_stack( slice_slot* s )
+         {
+            std::vector<std::string> frames;
+            sample_taken = 0;
+            sample_requested = 1;
+            if( pthread_kill( s->os_thread, SIGPROF ) != 0 )
+               return frames;
+            for( int i = 0; i < 500 && !sample_taken; ++i )
+               boost::this_thread::sleep_for( boost::chrono::microseconds(100) );
+            sample_requested = 0;
+            if( !sample_taken )
+               return frames;
+            std::stringstream ss;
+            ss << boost::stacktrace::stacktrace::from_dump( sample_buffer, sizeof(sample_buffer) );
+            std::string line;
+            while( std::getline( ss, line ) )
+               frames.push_back( line );
+            return frames;
+         }
+#endif
+
+         /** Called with w.lock held */
+         void free_retired_slots( watchdog_state& w )
+         {
+            w.slots.erase( std::remove_if( w.slots.begin(), w.slots.end(), []( slice_slot* s ) {
+                              if( !s->retired.load() )
+                                 return false;
+                              delete s;
+                              return true;
+                           } ),
+                           w.slots.end() );
+         }
+
+         /**
+          *  Reports slices that are over budget while they are still running. Called with w.lock
+          *  held, which is released while stacks are sampled so that end_slice() is not held up.
+          */
+         void check_running_slices( watchdog_state& w, boost::unique_lock<boost::mutex>& lock )
+         {
+            const int64_t budget = w.budget_us.load();
+            const time_point now = time_point::now();
+            std::vector<std::pair<slice_slot*, long_slice>> found;
+            for( slice_slot* s : w.slots )
+            {
+               const uint64_t number = s->number.load();
+               const int64_t start = s->start.load();
+               if( !start || s->reported == number || now.time_since_epoch().count() - start <= budget )
+                  continue;
+               s->reported = number;
+               long_slice r;
+               r.thread_name = s->thread_name;
+               const char* desc = s->desc.load();
+               r.desc = desc ? desc : "?";
+               r.duration_us = now.time_since_epoch().count() - start;
+               r.when = now;
+               r.running = true;
+               found.emplace_back( s, std::move(r) );
+            }
+#ifdef FC_WATCHDOG_SAMPLES_STACKS
+            if( w.options.sample_stacks && !found.empty() )
+            {
+               // w.slots may change meanwhile, but these slots stay until they are no longer sampled
+               for( auto& f : found )
+                  f.first->sampled = true;
+               lock.unlock();
+               for( auto& f : found )
+                  f.second.stack = sample_stack( f.first );
+               lock.lock();
+               for( auto& f : found )
+                  f.first->sampled = false;
+               w.sample_done.notify_all();
+            }
+#endif
+            for( auto& f : found )
+               report( w, std::move(f.second) );
+         }
+
+         /** Logs the queued warnings, and checks the running slices if options.monitor is set */
+         void run_monitor()
+         {
+            watchdog_state& w = get_watchdog();
+            boost::unique_lock<boost::mutex> lock( w.lock );
+            while( !w.monitor_stop.load() )
+            {
+               if( w.warnings.empty() ) // else more were queued while the appenders ran
+               {
+                  if( w.options.monitor )
+                     w.wake.wait_for( lock, boost::chrono::microseconds( std::max<int64_t>( w.budget_us.load() / 2, 1000 ) ) );
+                  else
+                     w.wake.wait( lock );
+               }
+               free_retired_slots( w );
+               if( w.options.monitor && !w.monitor_stop.load() )
+                  check_running_slices( w, lock );
+               log_warnings( w, lock );
+            }
+            log_warnings( w, lock );
+         }
+
+         void stop_monitor( watchdog_state& w )
+         {
+            if( !w.monitor )
+               return;
+            {
+               boost::unique_lock<boost::mutex> lock( w.lock );
+               w.monitor_stop.store( true );
+               w.wake.notify_all();
+            }
+            w.monitor->join();
+            delete w.monitor;
+            w.monitor = nullptr;
+#ifdef FC_WATCHDOG_SAMPLES_STACKS
+            if( w.options.monitor && w.options.sample_stacks )
+               sigaction( SIGPROF, &previous_action, nullptr );
+#endif
+         }
+      }
+
+      int64_t end_slice( const char* next_desc )
+      {
+         slice_slot* s = current_slot();
+         if( !s )
+            s = register_slot();
+         watchdog_state& w = get_watchdog();
+         const int64_t now = time_point::now().time_since_epoch().count();
+         const int64_t start = s->start.load( boost::memory_order_relaxed );
+         int64_t over_budget = 0;
+         if( start && now - start > w.budget_us.load( boost::memory_order_relaxed ) )
+         {
+            over_budget = now - start;
+            long_slice r;
+            r.thread_name = s->thread_name;
+            const char* desc = s->desc.load( boost::memory_order_relaxed );
+            r.desc = desc ? desc : "?";
+            r.duration_us = over_budget;
+            r.when = time_point( microseconds( now ) );
+            r.running = false;
+            bool queued;
+            {
+               boost::unique_lock<boost::mutex> lock( w.lock );
+               queued = report( w, std::move(r) );
+            }
+            if( queued )
+               w.wake.notify_one();
+         }
+         s->desc.store( next_desc, boost::memory_order_relaxed );
+         s->start.store( next_desc ? now : 0, boost::memory_order_relaxed );
+         s->number.store( s->number.load( boost::memory_order_relaxed ) + 1, boost::memory_order_release );
+         return over_budget;
+      }
+   } // namespace detail
+
+   void start_fiber_watchdog( const fiber_watchdog_options& options )
+   {
+      FC_ASSERT( options.slice_budget.count() > 0, "the slice budget must be positive" );
+      stop_fiber_watchdog();
+      detail::watchdog_state& w = detail::get_watchdog();
+      {
+         boost::unique_lock<boost::mutex> lock( w.lock );
+         w.options = options;
+         w.budget_us.store( options.slice_budget.count() );
+         w.history.clear();
+         w.suppressed = 0;
+         detail::free_retired_slots( w );
+         // slices that started before are not timed, their start is unknown
+         for( detail::slice_slot* s : w.slots )
+            s->start.store( 0 );
+      }
+      if( options.monitor || options.log_interval.count() > 0 )
+      {
+#ifdef FC_WATCHDOG_SAMPLES_STACKS
+         if( options.monitor && options.sample_stacks )
+         {
+            struct sigaction action;
+            memset( &action, 0, sizeof(action) );
+            action.sa_handler = &detail::sample_signal_handler;
+            action.sa_flags = SA_RESTART;
+            sigemptyset( &action.sa_mask );
+            sigaction( SIGPROF, &action, &detail::previous_action );
+         }
+#endif
+         w.monitor_stop.store( false );
+         w.monitor = new boost::thread( &detail::run_monitor );
+      }
+      detail::fiber_watchdog_enabled.store( true );
+   }
+
+   void stop_fiber_watchdog()
+   {
+      detail::fiber_watchdog_enabled.store( false );
+      detail::stop_monitor( detail::get_watchdog() );
+   }
+
+   variant get_long_slices()
+   {
+      detail::watchdog_state& w = detail::get_watchdog();
+      boost::unique_lock<boost::mutex> lock( w.lock );
+      variants result;
+      result.reserve( w.history.size() );
+      for( const detail::long_slice& r : w.history )
+      {
+         variants stack;
+         for( const std::string& frame : r.stack )
+            stack.push_back( frame );
+         result.push_back( mutable_variant_object( "thread", r.thread_name )( "task", r.desc )
+                           ( "duration_us", r.duration_us )( "time", variant( r.when ) )
+                           ( "running", r.running )( "stack", variant( std::move(stack) ) ) );
+      }
+      return variant( std::move(result) );
+   }
+
+} // namespace fc
@@ -3,14 +3,32 @@
 #include <fc/thread/thread.hpp>
 #include <fc/thread/unique_lock.hpp>
 #include <fc/exception/exception.hpp>
+#include <fc/log/logger.hpp>
 
 #include <boost/assert.hpp>
+#include <boost/exception/all.hpp>
 
 
 namespace fc {
 
+  namespace {
+    /** Takes the spin lock of a promise, unless the promise is single_thread */
+    class promise_lock {
+      public:
+        promise_lock( spin_yield_lock& l, const thread* owner ) : _lock( owner ? nullptr : &l ) {
+          if( _lock ) _lock->lock();
+        }
+        ~promise_lock() { if( _lock ) _lock->unlock(); }
+      private:
+        promise_lock( const promise_lock& );
+        promise_lock& operator=( const promise_lock& );
+        spin_yield_lock* _lock;
+    };
+  }
+
   promise_base::promise_base( const char* desc )
   :_ready(false),
+   _owner(nullptr),
    _blocked_thread(nullptr),
    _blocked_fiber_count(0),
    _timeout(time_point::maximum()),
@@ -22,6 +40,26 @@ namespace fc {
    _compl(nullptr)
   { }
 
+  promise_base::promise_base( single_thread_t, const char* desc )
+  :_ready(false),
+   _owner(&thread::current()),
+   _blocked_thread(nullptr),
+   _blocked_fiber_count(0),
+   _timeout(time_point::maximum()),
+   _canceled(false),
+#ifndef NDEBUG
+   _cancellation_reason(nullptr),
+#endif
+   _desc(desc),
+   _compl(nullptr)
+  {
+    set_single_threaded();
+  }
+
+  void promise_base::_check_owner()const {
+    BOOST_ASSERT( !_owner || _owner == &thread::current() );
+  }
+
   const char* promise_base::get_desc()const{
     return _desc; 
   }
@@ -37,7 +75,8 @@ namespace fc {
     return _ready;
   }
   bool promise_base::error()const {
-    { synchronized(_spin_yield) 
+    _check_owner();
+    { promise_lock lock( _spin_yield, _owner );
       return _exceptp != nullptr;
     }
   }
@@ -54,7 +93,8 @@ namespace fc {
        _wait_until( time_point::now() + timeout_us );
   }
   void promise_base::_wait_until( const time_point& timeout_us ){
-    { synchronized(_spin_yield) 
+    _check_owner();
+    { promise_lock lock( _spin_yield, _owner );
       if( _ready ) {
         if( _exceptp ) 
           _exceptp->dynamic_rethrow_exception();
@@ -110,22 +150,30 @@ namespace fc {
      _blocked_thread = &thread::current();
   }
   void promise_base::_dequeue_thread(){ 
-    synchronized(_spin_yield)
+    promise_lock lock( _spin_yield, _owner );
     if (!--_blocked_fiber_count)
       _blocked_thread = nullptr;
   }
-  void promise_base::_notify(){
+  thread* promise_base::_notify(){
     // copy _blocked_thread into a local so that if the thread unblocks (e.g., 
     // because of a timeout) before we get a chance to notify it, we won't be
     // calling notify on a null pointer
     thread* blocked_thread;
-    { synchronized(_spin_yield)
+    { promise_lock lock( _spin_yield, _owner );
       blocked_thread = _blocked_thread;
     }
-    if( blocked_thread ) 
-      blocked_thread->notify(ptr(this,true));
+    if( blocked_thread && blocked_thread->notify( ptr(this,true), true ) )
+      return blocked_thread;
+    return nullptr;
+  }
+  promise_base::~promise_base() {
+    // handlers of a promise that never completed
+    while( _compl ) {
+      detail::completion_handler* next = _compl->next;
+      delete _compl;
+      _compl = next;
+    }
   }
-  promise_base::~promise_base() { }
   void promise_base::_set_timeout(){
     if( _ready ) 
       return;
@@ -134,20 +182,77 @@ namespace fc {
   void promise_base::_set_value(const void* s){
  //   slog( "%p == %d", &_ready, int(_ready));
 //    BOOST_ASSERT( !_ready );
-    { synchronized(_spin_yield) 
+    _check_owner();
+    detail::completion_handler* handlers;
+    { promise_lock lock( _spin_yield, _owner );
       if (_ready) //don't allow promise to be set more than once
         return;
       _ready = true;
+      // handlers added from now on run right away, so each one runs once
+      handlers = _compl;
+      _compl = nullptr;
+    }
+    // a direct handoff to the woken fiber waits until the handlers have run
+    struct deferred_handoff {
+      thread* t;
+      ~deferred_handoff() { if( t ) t->hand_off_deferred(); }
+    } handoff{ _notify() };
+
+    // handlers were pushed to the front, run them in the order they were added
+    detail::completion_handler* in_order = nullptr;
+    while( handlers ) {
+      detail::completion_handler* next = handlers->next;
+      handlers->next = in_order;
+      in_order = handlers;
+      handlers = next;
     }
-    _notify();
-    if( nullptr != _compl ) {
-      _compl->on_complete(s,_exceptp);
+    while( in_order ) {
+      std::unique_ptr<detail::completion_handler> h( in_order );
+      in_order = in_order->next;
+      h->on_complete(s,_exceptp);
     }
   }
-  void promise_base::_on_complete( detail::completion_handler* c ) {
-    { synchronized(_spin_yield) 
-        delete _compl; 
-        _compl = c;
+  bool promise_base::_on_complete( detail::completion_handler* c ) {
+    _check_owner();
+    { promise_lock lock( _spin_yield, _owner );
+      if( _ready )
+        return false;
+      c->next = _compl;
+      _compl = c;
+    }
+    return true;
+  }
+
+  namespace detail {
+    continuation::~continuation() {
+      // the posted task was dropped, e.g. because the executor quit
+      if( !_target->ready() )
+        _target->set_exception( std::make_shared<canceled_exception>( FC_LOG_MESSAGE(error, "continuation was never run") ) );
+    }
+
+    void continuation::run() {
+      try
+      {
+        invoke();
+      }
+      catch ( const exception& e )
+      {
+        _target->set_exception( e.dynamic_copy_exception() );
+      }
+      catch ( ... )
+      {
+        _target->set_exception( std::make_shared<unhandled_exception>( FC_LOG_MESSAGE( warn, "unhandled exception: ${diagnostic}", ("diagnostic",boost::current_exception_diagnostic_information()) ) ) );
+      }
+    }
+
+    void dispatch_continuation( thread* executor, continuation* c, const char* desc ) {
+      std::unique_ptr<continuation> cont( c );
+      if( !executor || executor->is_current() ) {
+        cont->run();
+        return;
+      }
+      cont->keep_input();
+      executor->async( [cont = std::move(cont)]() { cont->run(); }, desc );
     }
   }
 }
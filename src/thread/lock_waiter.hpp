@@ -0,0 +1,103 @@
+#pragma once
+#include <fc/thread/lock_stats.hpp>
+#include <fc/thread/unique_lock.hpp>
+#include <fc/time.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <exception>
+
+namespace fc {
+  struct context;
+
+  namespace detail {
+
+    /**
+     *  Lives on the stack of a fiber that waits for a shared_mutex or a
+     *  semaphore, and is linked into the lock's FIFO of waiters while the
+     *  lock's spin_yield_lock is held.
+     */
+    struct lock_waiter
+    {
+      fc::context* ctx     = nullptr;
+      lock_waiter* next    = nullptr;
+      uint64_t     count   = 0;     // 0 for exclusive ownership of a shared_mutex, else shared ownership or semaphore units
+      bool         granted = false;
+    };
+
+    inline void push_waiter( lock_waiter*& head, lock_waiter*& tail, lock_waiter& w )
+    {
+      w.next = nullptr;
+      if( tail )
+        tail->next = &w;
+      else
+        head = &w;
+      tail = &w;
+    }
+
+    inline lock_waiter* pop_waiter( lock_waiter*& head, lock_waiter*& tail )
+    {
+      lock_waiter* w = head;
+      head = w->next;
+      if( !head )
+        tail = nullptr;
+      w->next = nullptr;
+      return w;
+    }
+
+    /** @return true if w was still queued */
+    inline bool remove_waiter( lock_waiter*& head, lock_waiter*& tail, lock_waiter& w )
+    {
+      lock_waiter* prev = nullptr;
+      for( lock_waiter* i = head; i; prev = i, i = i->next )
+        if( i == &w )
+        {
+          if( prev )
+            prev->next = w.next;
+          else
+            head = w.next;
+          if( tail == &w )
+            tail = prev;
+          w.next = nullptr;
+          return true;
+        }
+      return false;
+    }
+
+    /**
+     *  Takes the lock again after its waiter resumed. Yielding for the lock
+     *  throws once the fiber is canceled; that exception is kept in e instead,
+     *  so the waiter still gives back what it may have been granted.
+     */
+    template<typename Lock>
+    void lock_after_wait( fc::unique_lock<Lock>& lock, std::exception_ptr& e )
+    {
+      while( !lock )
+      {
+        try
+        {
+          lock.lock();
+        }
+        catch( ... )
+        {
+          if( !e )
+            e = std::current_exception();
+        }
+      }
+    }
+
+    inline void record_acquisition( lock_stats& stats )
+    {
+      ++stats.acquisitions;
+    }
+
+    inline void record_wait( lock_stats& stats, const time_point& since )
+    {
+      const uint64_t us = std::max<int64_t>( 0, (time_point::now() - since).count() );
+      ++stats.contended;
+      stats.total_wait_us += us;
+      stats.max_wait_us = std::max( stats.max_wait_us, us );
+    }
+
+  } // namespace detail
+} // namespace fc
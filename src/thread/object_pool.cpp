@@ -0,0 +1,275 @@
+#include <fc/thread/object_pool.hpp>
+#include <fc/thread/spin_lock.hpp>
+#include <fc/thread/unique_lock.hpp>
+
+#include <boost/atomic.hpp>
+#include <boost/thread/tss.hpp>
+
+#include <new>
+
+namespace fc {
+   namespace detail {
+      namespace {
+         const size_t   size_classes[] = { 64, 128, 256, 512, 1024, 2048 };
+         const unsigned num_size_classes = sizeof(size_classes) / sizeof(size_classes[0]);
+         const uint32_t batch_size = 32;            // blocks moved between a thread cache and the depot at once
+         const uint32_t max_cached = 2 * batch_size; // per size class and thread
+         const uint32_t publish_interval = 256;     // operations between publishing a thread's counters
+
+         struct free_block
+         {
+            free_block* next;
+            // only used by the first block of a batch in the depot
+            free_block* next_batch;
+            uint32_t    batch_count;
+         };
+
+         /** Batches of free blocks shared by all threads, and the published counters */
+         struct depot
+         {
+            fc::spin_lock            lock;
+            free_block*              batches = nullptr;
+            boost::atomic<uint64_t>  allocations{0};
+            boost::atomic<uint64_t>  cache_hits{0};
+            boost::atomic<uint64_t>  depot_batches{0};
+            boost::atomic<uint64_t>  slab_allocations{0};
+            boost::atomic<uint64_t>  frees{0};
+         };
+
+         depot* get_depots()
+         {
+            static depot depots[num_size_classes + 1]; // the last one only counts oversized objects
+            return depots;
+         }
+
+         struct class_cache
+         {
+            free_block* head = nullptr;
+            uint32_t    count = 0;
+            uint32_t    pending = 0;
+            uint64_t    allocations = 0;
+            uint64_t    cache_hits = 0;
+            uint64_t    frees = 0;
+         };
+
+         struct thread_cache
+         {
+            class_cache classes[num_size_classes];
+         };
+
+#ifndef FC_DISABLE_OBJECT_POOL
+         thread_cache*& current_cache()
+         {
+#ifdef _MSC_VER
+            static __declspec(thread) thread_cache* c = NULL;
+#else
+            static __thread thread_cache* c = NULL;
+#endif
+            return c;
+         }
+
+         bool& cache_released()
+         {
+#ifdef _MSC_VER
+            static __declspec(thread) bool released = false;
+#else
+            static __thread bool released = false;
+#endif
+            return released;
+         }
+
+         unsigned size_class( std::size_t size )
+         {
+            unsigned i = 0;
+            while( i < num_size_classes && size_classes[i] < size )
+               ++i;
+            return i;
+         }
+
+         void publish( class_cache& c, depot& d )
+         {
+            d.allocations.fetch_add( c.allocations, boost::memory_order_relaxed );
+            d.cache_hits.fetch_add( c.cache_hits, boost::memory_order_relaxed );
+            d.frees.fetch_add( c.frees, boost::memory_order_relaxed );
+            c.allocations = c.cache_hits = c.frees = 0;
+            c.pending = 0;
+         }
+
+         void push_batch( depot& d, free_block* batch, uint32_t count )
+         {
+            batch->batch_count = count;
+            synchronized( d.lock )
+            batch->next_batch = d.batches;
+            d.batches = batch;
+         }
+
+         free_block* pop_batch( depot& d )
+         {
+            synchronized( d.lock )
+            free_block* batch = d.batches;
+            if( batch )
+               d.batches = batch->next_batch;
+            return batch;
+         }
+
+         /** Moves batch_size blocks from the cache to the depot */
+         void flush_batch( class_cache& c, depot& d )
+         {
+            free_block* batch = c.head;
+            free_block* last = batch;
+            for( uint32_t i = 1; i < batch_size; i++ )
+               last = last->next;
+            c.head = last->next;
+            last->next = nullptr;
+            c.count -= batch_size;
+            push_batch( d, batch, batch_size );
+         }
+
+         /** @return a list of free blocks from the depot or from a new slab, and its length in count */
+         free_block* refill( unsigned cls, depot& d, uint32_t& count )
+         {
+            free_block* batch = pop_batch( d );
+            if( batch )
+            {
+               d.depot_batches.fetch_add( 1, boost::memory_order_relaxed );
+               count = batch->batch_count;
+               return batch;
+            }
+            count = batch_size;
+            d.slab_allocations.fetch_add( 1, boost::memory_order_relaxed );
+            char* slab = static_cast<char*>( ::operator new( batch_size * size_classes[cls] ) );
+            for( uint32_t i = 0; i < batch_size; i++ )
+               reinterpret_cast<free_block*>( slab + i * size_classes[cls] )->next =
+                  i + 1 < batch_size ? reinterpret_cast<free_block*>( slab + (i + 1) * size_classes[cls] ) : nullptr;
+            return reinterpret_cast<free_block*>( slab );
+         }
+
+         void release_cache( thread_cache* cache )
+         {
+            depot* depots = get_depots();
+            for( unsigned i = 0; i < num_size_classes; i++ )
+            {
+               class_cache& c = cache->classes[i];
+               while( c.count >= batch_size )
+                  flush_batch( c, depots[i] );
+               if( c.head )
+                  push_batch( depots[i], c.head, c.count );
+               publish( c, depots[i] );
+            }
+            delete cache;
+            current_cache() = nullptr;
+            cache_released() = true;
+         }
+
+         thread_cache* get_cache()
+         {
+            thread_cache* cache = current_cache();
+            if( cache || cache_released() )
+               return cache;
+            // never destroyed, so that it can still be used during static destruction
+            static boost::thread_specific_ptr<thread_cache>* cleanup =
+               new boost::thread_specific_ptr<thread_cache>( &release_cache );
+            cache = new thread_cache();
+            cleanup->reset( cache );
+            current_cache() = cache;
+            return cache;
+         }
+#endif
+      }
+
+      void* pool_allocate( std::size_t size )
+      {
+#ifdef FC_DISABLE_OBJECT_POOL
+         return ::operator new( size );
+#else
+         const unsigned cls = size_class( size );
+         depot& d = get_depots()[cls];
+         thread_cache* cache = cls < num_size_classes ? get_cache() : nullptr;
+         if( !cache )
+         {
+            d.allocations.fetch_add( 1, boost::memory_order_relaxed );
+            if( cls < num_size_classes ) // the thread is exiting, bypass the cache
+            {
+               uint32_t count;
+               free_block* b = refill( cls, d, count );
+               if( b->next )
+                  push_batch( d, b->next, count - 1 );
+               return b;
+            }
+            return ::operator new( size );
+         }
+
+         class_cache& c = cache->classes[cls];
+         ++c.allocations;
+         if( c.head )
+            ++c.cache_hits;
+         else
+         {
+            c.head = refill( cls, d, c.count );
+         }
+         free_block* b = c.head;
+         c.head = b->next;
+         --c.count;
+         if( ++c.pending >= publish_interval )
+            publish( c, d );
+         return b;
+#endif
+      }
+
+      void pool_free( void* p, std::size_t size )
+      {
+         if( !p )
+            return;
+#ifdef FC_DISABLE_OBJECT_POOL
+         ::operator delete( p );
+#else
+         const unsigned cls = size_class( size );
+         depot& d = get_depots()[cls];
+         thread_cache* cache = cls < num_size_classes ? get_cache() : nullptr;
+         if( !cache )
+         {
+            d.frees.fetch_add( 1, boost::memory_order_relaxed );
+            if( cls < num_size_classes )
+            {
+               free_block* b = static_cast<free_block*>( p );
+               b->next = nullptr;
+               push_batch( d, b, 1 );
+            }
+            else
+               ::operator delete( p );
+            return;
+         }
+
+         class_cache& c = cache->classes[cls];
+         ++c.frees;
+         free_block* b = static_cast<free_block*>( p );
+         b->next = c.head;
+         c.head = b;
+         if( ++c.count > max_cached )
+            flush_batch( c, d );
+         if( ++c.pending >= publish_interval )
+            publish( c, d );
+#endif
+      }
+   }
+
+   std::vector<object_pool_stats> get_object_pool_stats()
+   {
+      std::vector<object_pool_stats> result;
+      result.reserve( detail::num_size_classes + 1 );
+      detail::depot* depots = detail::get_depots();
+      for( unsigned i = 0; i <= detail::num_size_classes; i++ )
+      {
+         object_pool_stats stats;
+         stats.block_size = i < detail::num_size_classes ? detail::size_classes[i] : 0;
+         stats.allocations = depots[i].allocations.load( boost::memory_order_relaxed );
+         stats.cache_hits = depots[i].cache_hits.load( boost::memory_order_relaxed );
+         stats.depot_batches = depots[i].depot_batches.load( boost::memory_order_relaxed );
+         stats.slab_allocations = depots[i].slab_allocations.load( boost::memory_order_relaxed );
+         stats.frees = depots[i].frees.load( boost::memory_order_relaxed );
+         result.push_back( stats );
+      }
+      return result;
+   }
+
+} // namespace fc
@@ -23,21 +23,33 @@
  */
 
 #include <fc/thread/parallel.hpp>
-#include <fc/thread/spin_yield_lock.hpp>
+#include <fc/thread/affinity.hpp>
+#include <fc/thread/spin_lock.hpp>
 #include <fc/thread/unique_lock.hpp>
 #include <fc/asio.hpp>
+#include "context.hpp"
+#include "lock_waiter.hpp"
+#include "thread_d.hpp"
 
 #include <boost/atomic/atomic.hpp>
-#include <boost/lockfree/queue.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <deque>
+#include <map>
 
 namespace fc {
    namespace detail {
+      /** Each pool worker owns one of these. It is the worker's idle notifier
+       *  and also its task deque. The owner pushes and pops at the back, idle
+       *  workers steal from the front.
+       */
       class idle_notifier_impl : public thread_idle_notifier
       {
       public:
          idle_notifier_impl()
          {
             is_idle.store(false);
+            queued.store(0);
          }
 
          idle_notifier_impl( const idle_notifier_impl& copy )
@@ -45,96 +57,237 @@ namespace fc {
             id = copy.id;
             my_pool = copy.my_pool;
             is_idle.store( copy.is_idle.load() );
+            queued.store( copy.queued.load() );
+            tasks = copy.tasks;
          }
 
          virtual ~idle_notifier_impl() {}
 
          virtual task_base* idle();
-         virtual void       busy()
+         virtual void       busy();
+
+         void push( task_base* task )
          {
-            is_idle.store(false);
+            synchronized(queue_lock)
+            tasks.push_back( task );
+            queued.fetch_add( 1, boost::memory_order_relaxed );
+         }
+
+         task_base* pop_back()
+         {
+            if( !queued.load( boost::memory_order_relaxed ) )
+               return nullptr;
+            synchronized(queue_lock)
+            if( tasks.empty() )
+               return nullptr;
+            task_base* task = tasks.back();
+            tasks.pop_back();
+            queued.fetch_sub( 1, boost::memory_order_relaxed );
+            return task;
          }
 
-         uint32_t            id;
-         pool_impl*          my_pool;
-         boost::atomic<bool> is_idle;
+         /** Called on the worker thread, so that the queue storage is allocated there */
+         void localize_queue()
+         {
+            synchronized(queue_lock)
+            std::deque<task_base*> local( tasks.begin(), tasks.end() );
+            tasks.swap( local );
+         }
+
+         task_base* steal()
+         {
+            if( !queued.load( boost::memory_order_relaxed ) )
+               return nullptr;
+            synchronized(queue_lock)
+            if( tasks.empty() )
+               return nullptr;
+            task_base* task = tasks.front();
+            tasks.pop_front();
+            queued.fetch_sub( 1, boost::memory_order_relaxed );
+            return task;
+         }
+
+         uint32_t                id;
+         pool_impl*              my_pool;
+         boost::atomic<bool>     is_idle;
+         boost::atomic<uint32_t> queued;
+         fc::spin_lock           queue_lock;
+         std::deque<task_base*>  tasks;
       };
 
+      /** @return the worker (of any pool) that is running on the current thread, if any */
+      static idle_notifier_impl*& current_worker()
+      {
+#ifdef _MSC_VER
+         static __declspec(thread) idle_notifier_impl* w = NULL;
+#else
+         static __thread idle_notifier_impl* w = NULL;
+#endif
+         return w;
+      }
+
       class pool_impl
       {
       public:
-         explicit pool_impl( const uint16_t num_threads )
-            : idle_threads( 2 * num_threads ), waiting_tasks( 200 )
+         pool_impl( const std::string& n, const worker_pool_options& options )
+            : num_idle(0), name(n), next_queue(0)
          {
+            const uint16_t num_threads = options.threads ? options.threads
+                                                         : fc::asio::default_io_service_scope::get_num_threads();
+            std::vector<int> cpus = options.cpus;
+            if( cpus.empty() && options.numa_node >= 0 )
+            {
+               cpus = numa_node_cpus( options.numa_node );
+               FC_ASSERT( !cpus.empty(), "NUMA node ${n} has no CPUs", ("n",options.numa_node) );
+            }
+
+            const std::string prefix = name == "default" ? std::string( "pool worker " ) : name + " worker ";
             notifiers.resize( num_threads );
             threads.reserve( num_threads );
             for( uint32_t i = 0; i < num_threads; i++ )
             {
                notifiers[i].id = i;
                notifiers[i].my_pool = this;
-               threads.push_back( new thread( "pool worker " + fc::to_string(i), &notifiers[i] ) );
+               threads.push_back( new thread( prefix + fc::to_string(i), &notifiers[i] ) );
+            }
+
+            if( !cpus.empty() )
+            {
+               std::vector<future<void>> pinned;
+               for( uint32_t i = 0; i < num_threads; i++ )
+               {
+                  idle_notifier_impl* worker = &notifiers[i];
+                  pinned.push_back( threads[i]->async( [worker,&cpus] () {
+                     set_current_thread_affinity( cpus );
+                     worker->localize_queue();
+                  }, "pin worker" ) );
+               }
+               // the kernel may still refuse the CPUs, e.g. outside of our cpuset
+               std::exception_ptr failed;
+               for( auto& f : pinned )
+               {
+                  try
+                  {
+                     f.wait();
+                  }
+                  catch( ... )
+                  {
+                     if( !failed )
+                        failed = std::current_exception();
+                  }
+               }
+               if( failed )
+               {
+                  for( thread* t : threads )
+                     delete t;
+                  std::rethrow_exception( failed );
+               }
             }
          }
          ~pool_impl()
          {
             for( thread* t : threads)
                delete t; // also calls quit()
-            waiting_tasks.consume_all( [] ( task_base* t ) {
-               t->cancel( "thread pool quitting" );
-            });
+            for( idle_notifier_impl& worker : notifiers )
+               for( task_base* t : worker.tasks )
+                  t->cancel( "thread pool quitting" );
          }
 
+         /** Tasks posted from outside the pool are handed directly to an idle
+          *  worker if there is one (the worker is returned to the caller),
+          *  otherwise they are spread round-robin over the worker deques.
+          *  Tasks posted from one of our own workers go to the back of that
+          *  worker's deque, so that nested work stays on the same thread
+          *  unless somebody else is idle and steals it.
+          */
          thread* post( task_base* task )
          {
-            idle_notifier_impl* ini;
-            while( idle_threads.pop( ini ) )
-               if( ini->is_idle.exchange( false ) )
-               { // minor race condition here, a thread might receive a task while it's busy
-                  return threads[ini->id];
-               }
-            boost::unique_lock<fc::spin_yield_lock> lock(pool_lock);
-            while( idle_threads.pop( ini ) )
-               if( ini->is_idle.exchange( false ) )
-               { // minor race condition here, a thread might receive a task while it's busy
-                  return threads[ini->id];
-               }
-            while( !waiting_tasks.push( task ) )
-               elog( "Worker pool internal error" );
+            idle_notifier_impl* self = current_worker();
+            if( !self || self->my_pool != this )
+            {
+               const uint32_t first = next_queue.fetch_add( 1, boost::memory_order_relaxed ) % notifiers.size();
+               idle_notifier_impl* worker = claim_idle_worker( first );
+               if( worker )
+                  return threads[worker->id];
+               self = &notifiers[first];
+            }
+            self->push( task );
+
+            // pairs with the fence in idle(): either the idle worker sees the new task,
+            // or we see the idle worker
+            boost::atomic_thread_fence( boost::memory_order_seq_cst );
+            if( num_idle.load( boost::memory_order_relaxed ) > 0 )
+            {
+               idle_notifier_impl* worker = claim_idle_worker( self->id );
+               if( worker )
+                  threads[worker->id]->poke();
+            }
             return 0;
          }
 
-         task_base* enqueue_idle_thread( idle_notifier_impl* ini )
+         /** Looks for work in the worker's own deque first, then tries to
+          *  steal from the other workers.
+          */
+         task_base* find_task( idle_notifier_impl& worker )
          {
-            task_base* task;
-            if( waiting_tasks.pop( task ) )
-               return task;
-            fc::unique_lock<fc::spin_yield_lock> lock(pool_lock);
-            if( waiting_tasks.pop( task ) )
-               return task;
-            while( !idle_threads.push( ini ) )
-               elog( "Worker pool internal error" );
-            return 0;
+            task_base* task = worker.pop_back();
+            for( uint32_t i = 1; !task && i < notifiers.size(); i++ )
+               task = notifiers[ (worker.id + i) % notifiers.size() ].steal();
+            return task;
+         }
+
+         idle_notifier_impl* claim_idle_worker( uint32_t first )
+         {
+            if( num_idle.load( boost::memory_order_relaxed ) == 0 )
+               return nullptr;
+            for( uint32_t i = 0; i < notifiers.size(); i++ )
+            {
+               idle_notifier_impl& worker = notifiers[ (first + i) % notifiers.size() ];
+               if( worker.is_idle.load( boost::memory_order_relaxed ) && worker.is_idle.exchange( false ) )
+               {
+                  num_idle.fetch_sub( 1 );
+                  return &worker;
+               }
+            }
+            return nullptr;
          }
+
+         uint16_t size()const { return threads.size(); }
+
+         boost::atomic<uint32_t>                        num_idle;
+         const std::string                              name;
       private:
          std::vector<idle_notifier_impl>                notifiers;
          std::vector<thread*>                           threads;
-         boost::lockfree::queue<idle_notifier_impl*>    idle_threads;
-         boost::lockfree::queue<task_base*>             waiting_tasks;
-         fc::spin_yield_lock                            pool_lock;
+         boost::atomic<uint32_t>                        next_queue;
       };
 
       task_base* idle_notifier_impl::idle()
       {
+         current_worker() = this;
+         task_base* result = my_pool->find_task( *this );
+         if( result )
+            return result;
+
          is_idle.store( true );
-         task_base* result = my_pool->enqueue_idle_thread( this );
-         if( result ) is_idle.store( false );
+         my_pool->num_idle.fetch_add( 1 );
+         boost::atomic_thread_fence( boost::memory_order_seq_cst );
+         result = my_pool->find_task( *this );
+         if( result )
+            busy();
          return result;
       }
 
-      worker_pool::worker_pool()
+      void idle_notifier_impl::busy()
+      {
+         if( is_idle.exchange( false ) )
+            my_pool->num_idle.fetch_sub( 1 );
+      }
+
+      worker_pool::worker_pool( const std::string& name, const worker_pool_options& options )
       {
          fc::asio::default_io_service();
-         my = new pool_impl( fc::asio::default_io_service_scope::get_num_threads() );
+         my = new pool_impl( name, options );
       }
 
       worker_pool::~worker_pool()
@@ -149,11 +302,84 @@ namespace fc {
              worker->async_task( task, priority() );
       }
 
+      uint16_t worker_pool::size()const
+      {
+         return my->size();
+      }
+
+      const std::string& worker_pool::name()const
+      {
+         return my->name;
+      }
+
+      /** The worker pools by name. Pools are never removed, so references to them stay valid. */
+      class pool_registry
+      {
+      public:
+         worker_pool* find( const std::string& name )
+         {
+            boost::mutex::scoped_lock lock( pools_mutex );
+            auto it = pools.find( name );
+            return it == pools.end() ? nullptr : it->second.get();
+         }
+
+         /** @return the pool under name, which is p unless somebody was faster */
+         worker_pool& add( std::unique_ptr<worker_pool>&& p )
+         {
+            boost::mutex::scoped_lock lock( pools_mutex );
+            auto it = pools.insert( std::make_pair( p->name(), std::unique_ptr<worker_pool>() ) ).first;
+            if( !it->second )
+               it->second = std::move( p );
+            return *it->second;
+         }
+
+      private:
+         boost::mutex                                         pools_mutex;
+         std::map<std::string, std::unique_ptr<worker_pool>>  pools;
+      };
+
+      static pool_registry& get_pool_registry()
+      {
+         fc::asio::default_io_service(); // created first, so that it outlives the pools
+         static pool_registry the_registry;
+         return the_registry;
+      }
+
       worker_pool& get_worker_pool()
       {
-         static worker_pool the_pool;
+         static worker_pool& the_pool = [] () -> worker_pool& {
+            pool_registry& registry = get_pool_registry();
+            if( worker_pool* configured = registry.find( "default" ) )
+               return *configured;
+            return registry.add( std::unique_ptr<worker_pool>( new worker_pool( "default", worker_pool_options() ) ) );
+         }();
          return the_pool;
       }
+
+      size_t default_grain_size( size_t count )
+      {
+         // a few chunks per worker, so that work stealing can even out chunks of unequal cost
+         const size_t chunks = 4 * size_t( get_worker_pool().size() );
+         return std::max( size_t(1), (count + chunks - 1) / chunks );
+      }
+   }
+
+   void configure_worker_pool( const std::string& name, const worker_pool_options& options )
+   {
+      detail::pool_registry& registry = detail::get_pool_registry();
+      FC_ASSERT( !registry.find( name ), "worker pool ${n} exists already", ("n",name) );
+      // created outside of the registry lock, because pinning the workers waits for them
+      std::unique_ptr<detail::worker_pool> pool( new detail::worker_pool( name, options ) );
+      detail::worker_pool* created = pool.get();
+      FC_ASSERT( &registry.add( std::move(pool) ) == created, "worker pool ${n} exists already", ("n",name) );
+   }
+
+   detail::worker_pool& get_worker_pool( const std::string& name )
+   {
+      detail::worker_pool* pool = detail::get_pool_registry().find( name );
+      if( !pool )
+         FC_THROW_EXCEPTION( key_not_found_exception, "no worker pool named ${n}", ("n",name) );
+      return *pool;
    }
 
    serial_valve::ticket_guard::ticket_guard( boost::atomic<future<void>*>& latch )
@@ -199,4 +425,203 @@ namespace fc {
       last->wait();
       delete last;
    }
+
+   ordered_pipeline::ticket::ticket( ticket&& o ) : _pipe( o._pipe ), _seq( o._seq )
+   {
+      o._pipe = nullptr;
+   }
+
+   ordered_pipeline::ticket& ordered_pipeline::ticket::operator=( ticket&& o )
+   {
+      if( this != &o )
+      {
+         if( _pipe )
+            _pipe->leave( _seq );
+         _pipe = o._pipe;
+         _seq = o._seq;
+         o._pipe = nullptr;
+      }
+      return *this;
+   }
+
+   ordered_pipeline::ticket::~ticket()
+   {
+      leave();
+   }
+
+   void ordered_pipeline::ticket::leave()
+   {
+      if( _pipe )
+         _pipe->leave( _seq );
+      _pipe = nullptr;
+   }
+
+   void ordered_pipeline::ticket::wait_for_turn( uint32_t stage )
+   {
+      FC_ASSERT( _pipe, "The ticket has left the pipeline" );
+      FC_ASSERT( stage < _pipe->ordered_stages(), "No stage ${s} in the pipeline", ("s",stage) );
+      fc::unique_lock<boost::mutex> lock( _pipe->_lock );
+      uint32_t& passed = _pipe->_passed[_seq % _pipe->_passed.size()];
+      FC_ASSERT( passed <= stage, "Stage ${s} was passed already", ("s",stage) );
+      if( passed < stage )
+      {
+         passed = stage;
+         _pipe->advance();
+      }
+      while( _pipe->_gates[stage] != _seq )
+      {
+         detail::lock_waiter w;
+         w.count = _seq;
+         _pipe->wait( _pipe->_stage_waiters[stage], w, lock );
+      }
+   }
+
+   void ordered_pipeline::ticket::pass( uint32_t stage )
+   {
+      FC_ASSERT( _pipe, "The ticket has left the pipeline" );
+      FC_ASSERT( stage < _pipe->ordered_stages(), "No stage ${s} in the pipeline", ("s",stage) );
+      fc::unique_lock<boost::mutex> lock( _pipe->_lock );
+      uint32_t& passed = _pipe->_passed[_seq % _pipe->_passed.size()];
+      if( passed <= stage )
+      {
+         passed = stage + 1;
+         _pipe->advance();
+      }
+   }
+
+   ordered_pipeline::ordered_pipeline( uint32_t ordered_stages, uint32_t max_in_flight )
+      : _gates( ordered_stages, 0 ), _passed( max_in_flight, 0 ), _stage_waiters( ordered_stages )
+   {
+      FC_ASSERT( max_in_flight > 0, "A pipeline needs room for at least one item" );
+   }
+
+   ordered_pipeline::~ordered_pipeline()
+   {
+      fc::unique_lock<boost::mutex> lock( _lock );
+      _closing = true;
+      // fail the producers that wait for room
+      while( _entrants.head )
+         wake( *detail::pop_waiter( _entrants.head, _entrants.tail ) );
+      while( _oldest != _next )
+      {
+         detail::lock_waiter w;
+         wait( _entrants, w, lock );
+      }
+   }
+
+   ordered_pipeline::ticket ordered_pipeline::enter()
+   {
+      fc::unique_lock<boost::mutex> lock( _lock );
+      FC_ASSERT( !_closing, "Pipeline is shutting down!" );
+      if( !_entrants.head && _next - _oldest < _passed.size() )
+         return ticket( this, _next++ );
+
+      // leave() hands out the sequence numbers in the order of the waiters
+      detail::lock_waiter w;
+      try
+      {
+         wait( _entrants, w, lock );
+      }
+      catch( ... )
+      {
+         if( w.granted )
+         {
+            lock.unlock();
+            leave( w.count );
+         }
+         throw;
+      }
+      FC_ASSERT( w.granted, "Pipeline is shutting down!" );
+      return ticket( this, w.count );
+   }
+
+   void ordered_pipeline::wait( waiter_list& list, detail::lock_waiter& w, fc::unique_lock<boost::mutex>& lock )
+   {
+      fc::thread& t = fc::thread::current();
+      if( !t.my->current )
+         t.my->current = new fc::context( &t );
+      w.ctx = t.my->current;
+      w.ctx->waiting_on_lock = true;
+      detail::push_waiter( list.head, list.tail, w );
+      lock.unlock();
+
+      std::exception_ptr e; // relocking may yield, so the exception is moved out of the catch block
+      try
+      {
+         t.yield(false);
+      }
+      catch( ... )
+      {
+         e = std::current_exception();
+      }
+      w.ctx->waiting_on_lock = false;
+      lock.lock();
+      if( e )
+      {
+         detail::remove_waiter( list.head, list.tail, w );
+         std::rethrow_exception( e );
+      }
+   }
+
+   void ordered_pipeline::wake( detail::lock_waiter& w )
+   {
+      fc::context* c = w.ctx; // w may go out of scope as soon as its fiber resumes
+      if( c->claim_lock_wakeup() )
+         c->ctx_thread->my->unblock( c );
+   }
+
+   void ordered_pipeline::advance()
+   {
+      for( uint32_t stage = 0; stage < _gates.size(); ++stage )
+      {
+         uint64_t& gate = _gates[stage];
+         const uint64_t before = gate;
+         while( gate < _next && _passed[gate % _passed.size()] > stage )
+            ++gate;
+         if( gate == before )
+            continue;
+         waiter_list& waiters = _stage_waiters[stage];
+         for( detail::lock_waiter* w = waiters.head; w; w = w->next )
+            if( w->count == gate )
+            {
+               detail::remove_waiter( waiters.head, waiters.tail, *w );
+               w->granted = true;
+               wake( *w );
+               break;
+            }
+      }
+   }
+
+   void ordered_pipeline::leave( uint64_t seq )
+   {
+      fc::unique_lock<boost::mutex> lock( _lock );
+      const uint32_t left = ordered_stages() + 1;
+      _passed[seq % _passed.size()] = left;
+      advance();
+      // the gates have moved past every item that left, so their slots can be reused
+      while( _oldest < _next && _passed[_oldest % _passed.size()] == left )
+         _passed[_oldest++ % _passed.size()] = 0;
+
+      if( _closing )
+      {
+         if( _oldest == _next && _entrants.head ) // the destructor waits
+         {
+            detail::lock_waiter* w = detail::pop_waiter( _entrants.head, _entrants.tail );
+            w->granted = true;
+            wake( *w );
+         }
+         return;
+      }
+      // waking a producer for every item that leaves would cost a context switch per item,
+      // so producers resume once the pipeline is half empty
+      if( _next - _oldest > _passed.size() / 2 )
+         return;
+      while( _entrants.head && _next - _oldest < _passed.size() )
+      {
+         detail::lock_waiter* w = detail::pop_waiter( _entrants.head, _entrants.tail );
+         w->count = _next++;
+         w->granted = true;
+         wake( *w );
+      }
+   }
 } // namespace fc
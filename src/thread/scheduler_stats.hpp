@@ -0,0 +1,303 @@
+#pragma once
+#include <fc/time.hpp>
+#include <fc/variant_object.hpp>
+
+#include <boost/atomic.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace fc { namespace detail {
+
+  /**
+   *  Histogram of durations with power of two buckets: bucket 0 counts
+   *  durations below 1us, bucket i durations in [2^(i-1), 2^i) us, and the
+   *  last bucket everything longer.
+   */
+  struct duration_histogram
+  {
+    static const unsigned buckets = 32;
+
+    uint64_t counts[buckets] = {};
+    uint64_t samples  = 0;
+    uint64_t total_us = 0;
+    uint64_t max_us   = 0;
+
+    void add( int64_t us )
+    {
+      const uint64_t d = us > 0 ? uint64_t(us) : 0;
+      unsigned b = 0;
+      while( b + 1 < buckets && (uint64_t(1) << b) <= d )
+        ++b;
+      ++counts[b];
+      ++samples;
+      total_us += d;
+      max_us = std::max( max_us, d );
+    }
+
+    /** Only non-empty buckets are listed, as [upper bound in us, count] pairs */
+    variant to_variant()const
+    {
+      variants non_empty;
+      for( unsigned b = 0; b < buckets; ++b )
+        if( counts[b] )
+        {
+          variants bucket;
+          bucket.push_back( b + 1 < buckets ? variant( uint64_t(1) << b ) : variant( "inf" ) );
+          bucket.push_back( counts[b] );
+          non_empty.push_back( variant( std::move(bucket) ) );
+        }
+      return mutable_variant_object( "count", samples )
+                                   ( "total_us", total_us )
+                                   ( "max_us", max_us )
+                                   ( "buckets", variant( std::move(non_empty) ) );
+    }
+
+    void merge( const duration_histogram& o )
+    {
+      for( unsigned i = 0; i < buckets; ++i )
+        counts[i] += o.counts[i];
+      samples += o.samples;
+      total_us += o.total_us;
+      max_us = std::max( max_us, o.max_us );
+    }
+  };
+
+  /**
+   *  A duration_histogram that is written by one thread and read by others.
+   *  The counters are relaxed atomics, so a reader may see a sample in some
+   *  counters and not yet in others.
+   */
+  struct shared_duration_histogram
+  {
+    boost::atomic<uint64_t> counts[duration_histogram::buckets];
+    boost::atomic<uint64_t> samples{0};
+    boost::atomic<uint64_t> total_us{0};
+    boost::atomic<uint64_t> max_us{0};
+
+    shared_duration_histogram()
+    {
+      for( auto& c : counts )
+        c.store( 0, boost::memory_order_relaxed );
+    }
+
+    /** Called by the writing thread only */
+    void add( int64_t us )
+    {
+      const uint64_t d = us > 0 ? uint64_t(us) : 0;
+      unsigned b = 0;
+      while( b + 1 < duration_histogram::buckets && (uint64_t(1) << b) <= d )
+        ++b;
+      bump( counts[b], 1 );
+      bump( samples, 1 );
+      bump( total_us, d );
+      if( d > max_us.load( boost::memory_order_relaxed ) )
+        max_us.store( d, boost::memory_order_relaxed );
+    }
+
+    duration_histogram load()const
+    {
+      duration_histogram h;
+      for( unsigned b = 0; b < duration_histogram::buckets; ++b )
+        h.counts[b] = counts[b].load( boost::memory_order_relaxed );
+      h.samples = samples.load( boost::memory_order_relaxed );
+      h.total_us = total_us.load( boost::memory_order_relaxed );
+      h.max_us = max_us.load( boost::memory_order_relaxed );
+      return h;
+    }
+
+    static void bump( boost::atomic<uint64_t>& counter, uint64_t n )
+    {
+      counter.store( counter.load( boost::memory_order_relaxed ) + n, boost::memory_order_relaxed );
+    }
+  };
+
+  /**
+   *  Scheduler counters of one fc::thread.
+   *
+   *  Only the owning thread updates them, so the counters are relaxed atomics
+   *  that are written with a plain store and never need a locked instruction.
+   *  The per-task histograms are kept in a fixed table keyed by the FNV-1a
+   *  hash of the text of the task description. Each slot keeps its own copy
+   *  of the name, so descriptions do not have to outlive their tasks.
+   *  Descriptions that do not fit into the table are counted as "other".
+   *  Snapshots read the table without a lock and merge a task named "other"
+   *  into that slot.
+   */
+  class scheduler_stats
+  {
+    public:
+      void context_switched()          { bump( context_switches ); }
+      void handed_off()                { bump( handoffs ); }
+      void long_slice( int64_t us )
+      {
+        bump( long_slices );
+        if( uint64_t(us) > max_long_slice_us.load( boost::memory_order_relaxed ) )
+          max_long_slice_us.store( us, boost::memory_order_relaxed );
+      }
+      void context_blocked()           { bump( blocked_contexts ); bump( blocking_waits ); }
+      void context_unblocked()         { blocked_contexts.store( blocked_contexts.load( boost::memory_order_relaxed ) - 1,
+                                                                 boost::memory_order_relaxed ); }
+      void parked( int64_t us )        { bump( parks ); bump( parked_us, us > 0 ? uint64_t(us) : 0 ); }
+
+      void queue_depths( size_t ready, size_t queued )
+      {
+        ready_contexts.store( ready, boost::memory_order_relaxed );
+        queued_tasks.store( queued, boost::memory_order_relaxed );
+        if( ready > max_ready_contexts.load( boost::memory_order_relaxed ) )
+          max_ready_contexts.store( ready, boost::memory_order_relaxed );
+        if( queued > max_queued_tasks.load( boost::memory_order_relaxed ) )
+          max_queued_tasks.store( queued, boost::memory_order_relaxed );
+      }
+
+      /**
+       *  @param latency_us time from posting the task (or from the time it was
+       *         scheduled for) until it started
+       *  @param run_us wall time from start to completion, including the time
+       *         the task spent blocked or yielded to other fibers
+       */
+      void task_finished( const char* desc, int64_t latency_us, int64_t run_us )
+      {
+        bump( tasks_run );
+        task_slot& s = slot_of( desc );
+        s.latency.add( latency_us );
+        s.run_time.add( run_us );
+      }
+
+      /**
+       *  Tasks are listed by the total time they ran, descending, so the
+       *  tasks that keep the thread busy come first. Tasks described as
+       *  "other" are merged with those that found no free slot.
+       */
+      variant snapshot( const std::string& thread_name )const
+      {
+        std::vector<per_task_stats> by_name;
+        std::unordered_map<std::string, size_t> index;
+        for( unsigned i = 0; i <= task_slots; ++i )
+        {
+          const task_slot& slot = tasks[i];
+          if( !slot.desc.load( boost::memory_order_acquire ) )
+            continue;
+          per_task_stats entry{ slot.name, slot.latency.load(), slot.run_time.load() };
+          auto ins = index.insert( std::make_pair( entry.name, by_name.size() ) );
+          if( ins.second )
+            by_name.push_back( std::move(entry) );
+          else
+            by_name[ins.first->second].merge( entry );
+        }
+        std::sort( by_name.begin(), by_name.end(), []( const per_task_stats& a, const per_task_stats& b ) {
+          return a.run_time.total_us > b.run_time.total_us;
+        });
+
+        variants task_list;
+        task_list.reserve( by_name.size() );
+        for( const per_task_stats& s : by_name )
+          task_list.push_back( mutable_variant_object( "name", s.name )
+                                                     ( "latency", s.latency.to_variant() )
+                                                     ( "run_time", s.run_time.to_variant() ) );
+
+        return mutable_variant_object( "name", thread_name )
+                                     ( "ready_contexts", uint64_t( ready_contexts.load() ) )
+                                     ( "max_ready_contexts", uint64_t( max_ready_contexts.load() ) )
+                                     ( "queued_tasks", uint64_t( queued_tasks.load() ) )
+                                     ( "max_queued_tasks", uint64_t( max_queued_tasks.load() ) )
+                                     ( "blocked_contexts", uint64_t( blocked_contexts.load() ) )
+                                     ( "blocking_waits", uint64_t( blocking_waits.load() ) )
+                                     ( "context_switches", uint64_t( context_switches.load() ) )
+                                     ( "handoffs", uint64_t( handoffs.load() ) )
+                                     ( "long_slices", uint64_t( long_slices.load() ) )
+                                     ( "max_long_slice_us", uint64_t( max_long_slice_us.load() ) )
+                                     ( "tasks_run", uint64_t( tasks_run.load() ) )
+                                     ( "parks", uint64_t( parks.load() ) )
+                                     ( "parked_us", uint64_t( parked_us.load() ) )
+                                     ( "tasks", variant( std::move(task_list) ) );
+      }
+
+    private:
+      struct per_task_stats
+      {
+        std::string        name;
+        duration_histogram latency;
+        duration_histogram run_time;
+
+        void merge( const per_task_stats& o )
+        {
+          latency.merge( o.latency );
+          run_time.merge( o.run_time );
+        }
+      };
+
+      /** Written by the owning thread only, desc is stored last and points to name */
+      struct task_slot
+      {
+        boost::atomic<const char*> desc{nullptr};
+        std::string                name;
+        shared_duration_histogram  latency;
+        shared_duration_histogram  run_time;
+      };
+
+      static const unsigned task_slots = 64; // a power of two, the slot after them counts the other tasks
+
+      /**
+       *  Slots are found by the text of the description rather than its address,
+       *  as a description need not outlive its task, e.g. the c_str() of a string,
+       *  and a later one may be given the same address.
+       */
+      task_slot& slot_of( const char* desc )
+      {
+        if( !desc )
+          desc = "?";
+        uint32_t h = 2166136261u; // FNV-1a
+        for( const char* c = desc; *c; ++c )
+          h = ( h ^ uint8_t( *c ) ) * 16777619u;
+        unsigned i = h & ( task_slots - 1 );
+        for( unsigned probes = 0; probes < task_slots; ++probes, i = ( i + 1 ) & ( task_slots - 1 ) )
+        {
+          task_slot& s = tasks[i];
+          const char* d = s.desc.load( boost::memory_order_relaxed );
+          if( !d )
+          {
+            s.name = desc;
+            s.desc.store( s.name.c_str(), boost::memory_order_release );
+            return s;
+          }
+          if( strcmp( d, desc ) == 0 )
+            return s;
+        }
+        task_slot& other = tasks[task_slots];
+        if( !other.desc.load( boost::memory_order_relaxed ) )
+        {
+          other.name = "other";
+          other.desc.store( other.name.c_str(), boost::memory_order_release );
+        }
+        return other;
+      }
+
+      static void bump( boost::atomic<uint64_t>& counter, uint64_t n = 1 )
+      {
+        counter.store( counter.load( boost::memory_order_relaxed ) + n, boost::memory_order_relaxed );
+      }
+
+      boost::atomic<uint64_t> ready_contexts{0};
+      boost::atomic<uint64_t> max_ready_contexts{0};
+      boost::atomic<uint64_t> queued_tasks{0};
+      boost::atomic<uint64_t> max_queued_tasks{0};
+      boost::atomic<uint64_t> blocked_contexts{0};
+      boost::atomic<uint64_t> blocking_waits{0};
+      boost::atomic<uint64_t> context_switches{0};
+      boost::atomic<uint64_t> handoffs{0};
+      boost::atomic<uint64_t> long_slices{0};       // see fc::start_fiber_watchdog()
+      boost::atomic<uint64_t> max_long_slice_us{0};
+      boost::atomic<uint64_t> tasks_run{0};
+      boost::atomic<uint64_t> parks{0};
+      boost::atomic<uint64_t> parked_us{0};
+
+      std::unique_ptr<task_slot[]> tasks{ new task_slot[task_slots + 1] };
+  };
+
+} } // namespace fc::detail
@@ -0,0 +1,114 @@
+#include <fc/thread/semaphore.hpp>
+#include <fc/thread/thread.hpp>
+#include <fc/thread/unique_lock.hpp>
+#include "context.hpp"
+#include "lock_waiter.hpp"
+#include "thread_d.hpp"
+
+namespace fc {
+
+  semaphore::semaphore( uint64_t initial_count ) :
+    m_count(initial_count),
+    m_head(nullptr),
+    m_tail(nullptr)
+  {}
+
+  semaphore::~semaphore()
+  {
+    BOOST_ASSERT( !m_head && "Attempt to free semaphore while others are blocking on it." );
+  }
+
+  void semaphore::acquire( uint64_t n )
+  {
+    detail::lock_waiter w;
+    w.count = n;
+    { synchronized(m_lock)
+      // waiters are served in order, so nobody may overtake them
+      if( !m_head && m_count >= n )
+      {
+        m_count -= n;
+        detail::record_acquisition( m_stats );
+        return;
+      }
+      fc::thread& t = fc::thread::current();
+      if( !t.my->current )
+        t.my->current = new fc::context( &t );
+      w.ctx = t.my->current;
+      w.ctx->waiting_on_lock = true;
+      detail::push_waiter( m_head, m_tail, w );
+    }
+
+    const time_point start = time_point::now();
+    std::exception_ptr e; // cleanup may yield, so the exception is moved out of the catch block
+    try
+    {
+      fc::thread::current().yield(false);
+    }
+    catch( ... )
+    {
+      e = std::current_exception();
+    }
+    w.ctx->waiting_on_lock = false;
+
+    { fc::unique_lock<fc::spin_yield_lock> lock( m_lock, fc::try_to_lock_t() );
+      detail::lock_after_wait( lock, e );
+      if( !e )
+      {
+        BOOST_ASSERT( w.granted );
+        detail::record_acquisition( m_stats );
+        detail::record_wait( m_stats, start );
+        return;
+      }
+      if( w.granted )
+        m_count += n;
+      else
+        detail::remove_waiter( m_head, m_tail, w );
+      grant_waiters();
+    }
+    std::rethrow_exception( e );
+  }
+
+  bool semaphore::try_acquire( uint64_t n )
+  {
+    synchronized(m_lock)
+    if( m_head || m_count < n )
+      return false;
+    m_count -= n;
+    detail::record_acquisition( m_stats );
+    return true;
+  }
+
+  void semaphore::release( uint64_t n )
+  {
+    synchronized(m_lock)
+    m_count += n;
+    grant_waiters();
+  }
+
+  uint64_t semaphore::available()const
+  {
+    synchronized(m_lock)
+    return m_count;
+  }
+
+  lock_stats semaphore::get_stats()const
+  {
+    synchronized(m_lock)
+    return m_stats;
+  }
+
+  /** Called with m_lock held */
+  void semaphore::grant_waiters()
+  {
+    while( m_head && m_head->count <= m_count )
+    {
+      detail::lock_waiter* w = detail::pop_waiter( m_head, m_tail );
+      m_count -= w->count;
+      fc::context* c = w->ctx;
+      w->granted = true; // w may go out of scope as soon as its fiber resumes
+      if( c->claim_lock_wakeup() )
+        c->ctx_thread->my->unblock( c );
+    }
+  }
+
+} // namespace fc
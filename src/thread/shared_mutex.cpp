@@ -0,0 +1,208 @@
+#include <fc/thread/shared_mutex.hpp>
+#include <fc/thread/thread.hpp>
+#include "context.hpp"
+#include "lock_waiter.hpp"
+#include "thread_d.hpp"
+
+namespace fc {
+
+  shared_mutex::shared_mutex( preference p ) :
+    m_preference(p),
+    m_readers(0),
+    m_writer(false),
+    m_waiting_writers(0),
+    m_head(nullptr),
+    m_tail(nullptr)
+  {}
+
+  shared_mutex::~shared_mutex()
+  {
+    BOOST_ASSERT( !m_head && "Attempt to free shared_mutex while others are blocking on it." );
+  }
+
+  void shared_mutex::lock()
+  {
+    detail::lock_waiter w;
+    { synchronized(m_lock)
+      if( !m_writer && !m_readers )
+      {
+        m_writer = true;
+        detail::record_acquisition( m_exclusive_stats );
+        return;
+      }
+      enqueue( w );
+    }
+    wait( w, m_exclusive_stats );
+  }
+
+  bool shared_mutex::try_lock()
+  {
+    synchronized(m_lock)
+    if( m_writer || m_readers )
+      return false;
+    m_writer = true;
+    detail::record_acquisition( m_exclusive_stats );
+    return true;
+  }
+
+  void shared_mutex::unlock()
+  {
+    synchronized(m_lock)
+    BOOST_ASSERT( m_writer );
+    m_writer = false;
+    grant_waiters();
+  }
+
+  void shared_mutex::lock_shared()
+  {
+    detail::lock_waiter w;
+    w.count = 1;
+    { synchronized(m_lock)
+      if( !m_writer && (m_preference == prefer_readers || !m_waiting_writers) )
+      {
+        ++m_readers;
+        detail::record_acquisition( m_shared_stats );
+        return;
+      }
+      enqueue( w );
+    }
+    wait( w, m_shared_stats );
+  }
+
+  bool shared_mutex::try_lock_shared()
+  {
+    synchronized(m_lock)
+    if( m_writer || (m_preference == prefer_writers && m_waiting_writers) )
+      return false;
+    ++m_readers;
+    detail::record_acquisition( m_shared_stats );
+    return true;
+  }
+
+  void shared_mutex::unlock_shared()
+  {
+    synchronized(m_lock)
+    BOOST_ASSERT( m_readers > 0 );
+    if( --m_readers == 0 )
+      grant_waiters();
+  }
+
+  lock_stats shared_mutex::exclusive_stats()const
+  {
+    synchronized(m_lock)
+    return m_exclusive_stats;
+  }
+
+  lock_stats shared_mutex::shared_stats()const
+  {
+    synchronized(m_lock)
+    return m_shared_stats;
+  }
+
+  /** Called with m_lock held */
+  void shared_mutex::enqueue( detail::lock_waiter& w )
+  {
+    fc::thread& t = fc::thread::current();
+    if( !t.my->current )
+      t.my->current = new fc::context( &t );
+    w.ctx = t.my->current;
+    if( w.count == 0 )
+      ++m_waiting_writers;
+    w.ctx->waiting_on_lock = true; // task_base::cancel() unblocks it
+    detail::push_waiter( m_head, m_tail, w );
+  }
+
+  /** Called with m_lock held */
+  void shared_mutex::remove( detail::lock_waiter& w )
+  {
+    if( detail::remove_waiter( m_head, m_tail, w ) && w.count == 0 )
+      --m_waiting_writers;
+  }
+
+  /**
+   *  Suspends the current fiber until the lock is granted to w. If the fiber
+   *  is canceled meanwhile, it leaves the queue, or gives the lock back if it
+   *  was granted already, and the exception is rethrown.
+   */
+  void shared_mutex::wait( detail::lock_waiter& w, lock_stats& stats )
+  {
+    const time_point start = time_point::now();
+    std::exception_ptr e; // cleanup may yield, so the exception is moved out of the catch block
+    try
+    {
+      fc::thread::current().yield(false);
+    }
+    catch( ... )
+    {
+      e = std::current_exception();
+    }
+    w.ctx->waiting_on_lock = false;
+
+    { fc::unique_lock<fc::spin_yield_lock> lock( m_lock, fc::try_to_lock_t() );
+      detail::lock_after_wait( lock, e );
+      if( !e )
+      {
+        BOOST_ASSERT( w.granted );
+        detail::record_acquisition( stats );
+        detail::record_wait( stats, start );
+        return;
+      }
+      if( !w.granted )
+        remove( w );
+      else if( w.count == 0 )
+        m_writer = false;
+      else
+        --m_readers;
+      grant_waiters();
+    }
+    std::rethrow_exception( e );
+  }
+
+  /**
+   *  Called with m_lock held. Grants the lock to the first waiter and the
+   *  readers behind it; with prefer_readers every queued reader is let in
+   *  before the next writer.
+   */
+  void shared_mutex::grant_waiters()
+  {
+    auto grant = []( detail::lock_waiter* w ) {
+      fc::context* c = w->ctx;
+      w->granted = true; // w may go out of scope as soon as its fiber resumes
+      if( c->claim_lock_wakeup() )
+        c->ctx_thread->my->unblock( c );
+    };
+
+    if( m_writer )
+      return;
+    if( m_preference == prefer_readers )
+    {
+      detail::lock_waiter* w = m_head;
+      while( w )
+      {
+        detail::lock_waiter* next = w->next;
+        if( w->count )
+        {
+          detail::remove_waiter( m_head, m_tail, *w );
+          ++m_readers;
+          grant( w );
+        }
+        w = next;
+      }
+    }
+    while( m_head )
+    {
+      if( m_head->count == 0 )
+      {
+        if( m_readers )
+          return;
+        --m_waiting_writers;
+        m_writer = true;
+        grant( detail::pop_waiter( m_head, m_tail ) );
+        return;
+      }
+      ++m_readers;
+      grant( detail::pop_waiter( m_head, m_tail ) );
+    }
+  }
+
+} // namespace fc
@@ -18,11 +18,14 @@ namespace fc {
   :
   promise_base("task_base"),
   _posted_num(0),
+  _posted_time(time_point::now()),
   _active_context(nullptr),
   _next(nullptr),
+  _timer_thread(nullptr),
   _task_specific_data(nullptr),
   _promise_impl(nullptr),
   _functor(func){
+    _timer.owner = this;
   }
 
   void task_base::run() {
@@ -63,18 +66,28 @@ namespace fc {
   void task_base::cancel(const char* reason /* = nullptr */)
   {
     promise_base::cancel(reason);
-    if (_active_context)
+    thread* timer_thread;
+    context* active_context; // _active_context is reset as soon as the canceled task finishes
+    { synchronized( *_spinlock )
+      timer_thread = _timer_thread;
+      active_context = _active_context;
+    }
+    if (timer_thread)
+      timer_thread->cancel_scheduled_task(this);
+    if (active_context)
     {
-      if (_active_context->next_blocked_mutex)
+      if (active_context->next_blocked_mutex)
       {
         // this task is blocked on a mutex, we probably don't handle this correctly
-        _active_context->ctx_thread->unblock(_active_context);
+        active_context->ctx_thread->unblock(active_context);
       }
-      _active_context->canceled = true;
+      active_context->canceled = true;
 #ifndef NDEBUG
-      _active_context->cancellation_reason = reason;
+      active_context->cancellation_reason = reason;
 #endif
-      _active_context->ctx_thread->notify_task_has_been_canceled();
+      if (active_context->claim_lock_wakeup())
+        active_context->ctx_thread->unblock(active_context); // leaves the lock's queue when it resumes
+      active_context->ctx_thread->notify_task_has_been_canceled();
     }
   }
 
@@ -135,6 +135,21 @@ namespace fc {
      return my->name;
    }
 
+   variant thread::get_stats()const
+   {
+     return my->stats.snapshot( my->name );
+   }
+
+   void thread::set_wake_policy( wake_policy p )
+   {
+     my->direct_handoff.store( p == wake_policy::direct_handoff, boost::memory_order_relaxed );
+   }
+
+   wake_policy thread::get_wake_policy()const
+   {
+     return my->direct_handoff.load( boost::memory_order_relaxed ) ? wake_policy::direct_handoff : wake_policy::queue;
+   }
+
    void thread::set_name( const std::string& n )
    {
      if (!is_current())
@@ -192,16 +207,14 @@ namespace fc {
       unstarted_task->set_exception(std::make_shared<canceled_exception>(FC_LOG_MESSAGE(error, "cancellation reason: thread quitting")));
     my->task_pqueue.clear();
 
-    for (task_base* scheduled_task : my->task_sch_queue)
+    my->clear_scheduled_tasks( []( task_base* scheduled_task ) {
       scheduled_task->set_exception(std::make_shared<canceled_exception>(FC_LOG_MESSAGE(error, "cancellation reason: thread quitting")));
-    my->task_sch_queue.clear();
+    });
 
 
 
     // move all sleep tasks to ready
-    for( uint32_t i = 0; i < my->sleep_pqueue.size(); ++i )
-      my->add_context_to_ready_list( my->sleep_pqueue[i] );
-    my->sleep_pqueue.clear();
+    my->clear_sleep_queue( [this]( fc::context* c ) { my->add_context_to_ready_list( c ); } );
 
     // move all idle tasks to ready
     fc::context* cur = my->pt_head;
@@ -296,10 +309,7 @@ namespace fc {
        if( timeout != time_point::maximum() )
        {
            my->current->resume_time = timeout;
-           my->sleep_pqueue.push_back(my->current);
-           std::push_heap( my->sleep_pqueue.begin(),
-                           my->sleep_pqueue.end(),
-                           sleep_priority_less()   );
+           my->add_to_sleep_queue( my->current );
        }
 
        my->add_to_blocked( my->current );
@@ -322,8 +332,7 @@ namespace fc {
    }
 
    void thread::poke() {
-     boost::unique_lock<boost::mutex> lock(my->task_ready_mutex);
-     my->task_ready.notify_one();
+     my->parker.unpark();
    }
 
    void thread::async_task( task_base* t, const priority& p, const time_point& tp ) {
@@ -333,13 +342,10 @@ namespace fc {
       do { t->_next = stale_head;
       }while( !my->task_in_queue.compare_exchange_weak( stale_head, t, boost::memory_order_release ) );
 
-      // Because only one thread can post the 'first task', only that thread will attempt
-      // to aquire the lock and therefore there should be no contention on this lock except
-      // when *this thread is about to block on a wait condition.
-      if( this != &current() &&  !stale_head ) {
-          boost::unique_lock<boost::mutex> lock(my->task_ready_mutex);
-          my->task_ready.notify_one();
-      }
+      // The parker coalesces wakeups, so this only makes a system call if the
+      // thread is blocked and no other poster has woken it up already.
+      if( this != &current() )
+          my->parker.unpark();
    }
 
    void yield() {
@@ -352,6 +358,17 @@ namespace fc {
       thread::current().sleep_until(tp);
    }
 
+   static boost::atomic<timer_backend>& default_timer_backend() {
+      static boost::atomic<timer_backend> backend( timer_backend::heap );
+      return backend;
+   }
+   void set_default_timer_backend( timer_backend b ) {
+      default_timer_backend().store( b );
+   }
+   timer_backend get_default_timer_backend() {
+      return default_timer_backend().load();
+   }
+
    void  exec()
    {
       return thread::current().exec();
@@ -384,10 +401,7 @@ namespace fc {
          if( timeout != time_point::maximum() )
          {
              my->current->resume_time = timeout;
-             my->sleep_pqueue.push_back(my->current);
-             std::push_heap( my->sleep_pqueue.begin(),
-                             my->sleep_pqueue.end(),
-                             sleep_priority_less() );
+             my->add_to_sleep_queue( my->current );
          }
 
          my->add_to_blocked( my->current );
@@ -399,13 +413,13 @@ namespace fc {
          my->check_fiber_exceptions();
     }
 
-    void thread::notify( const promise_base::ptr& p )
+    bool thread::notify( const promise_base::ptr& p, bool defer_handoff )
     {
       BOOST_ASSERT(p->ready());
       if( !is_current() )
       {
         this->async( [=](){ notify(p); }, "notify", priority::max() );
-        return;
+        return false;
       }
       // TODO: store a list of blocked contexts with the promise
       //  to accelerate the lookup.... unless it introduces contention...
@@ -415,6 +429,7 @@ namespace fc {
 
       fc::context* cur_blocked  = my->blocked;
       fc::context* prev_blocked = 0;
+      fc::context* handoff      = 0;
       while( cur_blocked )
       {
         // if the blocked context is waiting on this promise
@@ -423,17 +438,8 @@ namespace fc {
           // remove it from the blocked list.
 
           // remove this context from the sleep queue...
-          for( uint32_t i = 0; i < my->sleep_pqueue.size(); ++i )
-          {
-            if( my->sleep_pqueue[i] == cur_blocked )
-            {
-              my->sleep_pqueue[i]->blocking_prom.clear();
-              my->sleep_pqueue[i] = my->sleep_pqueue.back();
-              my->sleep_pqueue.pop_back();
-              std::make_heap( my->sleep_pqueue.begin(),my->sleep_pqueue.end(), sleep_priority_less() );
-              break;
-            }
-          }
+          if( my->remove_from_sleep_queue( cur_blocked ) )
+            cur_blocked->blocking_prom.clear();
           auto cur = cur_blocked;
           if( prev_blocked )
           {
@@ -446,7 +452,12 @@ namespace fc {
               cur_blocked = my->blocked;
           }
           cur->next_blocked = 0;
-          my->add_context_to_ready_list( cur );
+          my->stats.context_unblocked();
+          detail::trace( detail::trace_event_kind::wake, p->get_desc(), p.get(), cur );
+          if( !handoff && my->can_hand_off_to( cur ) )
+            handoff = cur;
+          else
+            my->add_context_to_ready_list( cur );
         }
         else
         { // goto the next blocked task
@@ -454,6 +465,25 @@ namespace fc {
           cur_blocked   = cur_blocked->next_blocked;
         }
       }
+      if( !handoff )
+        return false;
+      if( !defer_handoff )
+      {
+        my->hand_off_to( handoff );
+        return false;
+      }
+      if( my->deferred_handoff ) // an outer notify() defers its own handoff
+      {
+        my->add_context_to_ready_list( handoff );
+        return false;
+      }
+      my->deferred_handoff = handoff;
+      return true;
+    }
+
+    void thread::hand_off_deferred()
+    {
+      my->hand_off_deferred();
     }
 
     bool thread::is_current()const
@@ -466,6 +496,17 @@ namespace fc {
       async( [this](){ my->notify_task_has_been_canceled(); }, "notify_task_has_been_canceled", priority::max() );
     }
 
+    void thread::cancel_scheduled_task( task_base* t )
+    {
+      if( !is_current() )
+      {
+        promise_base::ptr keep_alive( t, true );
+        async( [this,t,keep_alive](){ my->remove_scheduled_task( t ); }, "cancel_scheduled_task", priority::max() );
+        return;
+      }
+      my->remove_scheduled_task( t );
+    }
+
     void thread::unblock(fc::context* c)
     {
       my->unblock(c);
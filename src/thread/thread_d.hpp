@@ -2,9 +2,18 @@
 #include <fc/time.hpp>
 #include <boost/thread.hpp>
 #include "context.hpp"
+#include "timing_wheel.hpp"
+#include "thread_parker.hpp"
+#include "scheduler_stats.hpp"
+#include <fc/fwd_impl.hpp>
+#include <fc/thread/fiber_trace.hpp>
+#include <fc/thread/fiber_watchdog.hpp>
+#include <fc/thread/spin_lock.hpp>
+#include <fc/thread/unique_lock.hpp>
 #include <boost/thread/condition_variable.hpp>
 #include <boost/thread.hpp>
 #include <boost/atomic.hpp>
+#include <memory>
 #include <vector>
 //#include <fc/logger.hpp>
 
@@ -46,6 +55,11 @@ namespace fc {
             { 
               static boost::atomic<int> cnt(0);
               name = std::string("th_") + char('a'+cnt++); 
+              if( get_default_timer_backend() == timer_backend::timing_wheel )
+              {
+                sleep_wheel.reset( new detail::timing_wheel() );
+                task_wheel.reset( new detail::timing_wheel() );
+              }
 //              printf("thread=%p\n",this);
             }
 
@@ -81,14 +95,21 @@ namespace fc {
            fc::thread&             self;
            boost::thread* boost_thread;
            stack_allocator                  stack_alloc;
-           boost::condition_variable        task_ready;
-           boost::mutex                     task_ready_mutex;
+           detail::thread_parker            parker;   // blocks the thread while it is idle
+           detail::scheduler_stats          stats;
+
+           boost::atomic<bool>              direct_handoff{false}; // see thread::set_wake_policy()
+           unsigned                         handoff_streak = 0;    // handoffs since the ready queue had its turn
+           bool                             in_scheduler = false;  // see scheduler_scope
+           fc::context*                     deferred_handoff = nullptr; // see thread::notify()
 
            boost::atomic<task_base*>       task_in_queue;
            std::vector<task_base*>         task_pqueue;    // heap of tasks that have never started, ordered by proirity & scheduling time
            uint64_t                        next_posted_num; // each task or context gets assigned a number in the order it is ready to execute, tracked here
            std::vector<task_base*>         task_sch_queue; // heap of tasks that have never started but are scheduled for a time in the future, ordered by the time they should be run
            std::vector<fc::context*>       sleep_pqueue;   // heap of running tasks that have sleeped, ordered by the time they should resume
+           std::unique_ptr<detail::timing_wheel> task_wheel;  // replaces task_sch_queue with timer_backend::timing_wheel
+           std::unique_ptr<detail::timing_wheel> sleep_wheel; // replaces sleep_pqueue with timer_backend::timing_wheel
            std::vector<fc::context*>       free_list;      // list of unused contexts that are ready for deletion
 
            bool                     done;
@@ -165,10 +186,15 @@ namespace fc {
            {
               c->next_blocked = blocked;
               blocked = c;
+              stats.context_blocked();
+              if( !c->blocking_prom.empty() )
+                detail::trace( detail::trace_event_kind::wait, c->blocking_prom.front().prom->get_desc(),
+                               c->blocking_prom.front().prom, c );
            }
 
            void pt_push_back(fc::context* c) 
            {
+              c->record_stack_high_water_mark();
               c->next = pt_head;
               pt_head = c;
               /* 
@@ -257,11 +283,7 @@ namespace fc {
               while (cur)
               {
                 if (cur->_when > now)
-                {
-                  task_sch_queue.push_back(cur);
-                  std::push_heap(task_sch_queue.begin(),
-                                 task_sch_queue.end(), task_when_less());
-                }
+                  add_scheduled_task(cur);
                 else
                 {
                   cur->_posted_num = next_posted_num - (++tasks_posted);
@@ -292,17 +314,140 @@ namespace fc {
             // second, walk through task_sch_queue and move any scheduled tasks that are now
             // able to run (because their scheduled time has arrived) to task_pqueue
 
+            if (task_wheel)
+            {
+              task_wheel->advance(time_point::now(), [this](detail::timer_link* l) {
+                task_base* ready_task = static_cast<task_base*>(l->owner);
+                { synchronized( *ready_task->_spinlock )
+                  ready_task->_timer_thread = nullptr;
+                }
+                add_task_to_ready_queue(ready_task);
+              });
+              return;
+            }
+
             while (!task_sch_queue.empty() &&
                    task_sch_queue.front()->_when <= time_point::now())
             {
               task_base* ready_task = task_sch_queue.front();
               std::pop_heap(task_sch_queue.begin(), task_sch_queue.end(), task_when_less());
               task_sch_queue.pop_back();
+              add_task_to_ready_queue(ready_task);
+            }
+          }
 
-              ready_task->_posted_num = next_posted_num++;
-              task_pqueue.push_back(ready_task);
-              std::push_heap(task_pqueue.begin(), task_pqueue.end(), task_priority_less());
+          void add_task_to_ready_queue(task_base* ready_task)
+          {
+            ready_task->_posted_num = next_posted_num++;
+            task_pqueue.push_back(ready_task);
+            std::push_heap(task_pqueue.begin(), task_pqueue.end(), task_priority_less());
+          }
+
+          void add_scheduled_task(task_base* t)
+          {
+            if (task_wheel)
+            {
+              task_wheel->insert(&t->_timer, t->_when);
+              { synchronized( *t->_spinlock )
+                t->_timer_thread = &self;
+              }
+              // cancel() may have run before it could see _timer_thread
+              if (t->canceled())
+                remove_scheduled_task(t);
+              return;
             }
+            task_sch_queue.push_back(t);
+            std::push_heap(task_sch_queue.begin(), task_sch_queue.end(), task_when_less());
+          }
+
+          /** Takes a canceled task out of the timing wheel, it will complete with a canceled_exception */
+          void remove_scheduled_task(task_base* t)
+          {
+            if (!task_wheel || !t->_timer.linked)
+              return;
+            task_wheel->remove(&t->_timer);
+            { synchronized( *t->_spinlock )
+              t->_timer_thread = nullptr;
+            }
+            add_task_to_ready_queue(t);
+          }
+
+          /** Removes all scheduled tasks and passes them to f */
+          template<typename Functor>
+          void clear_scheduled_tasks(Functor&& f)
+          {
+            if (task_wheel)
+              task_wheel->clear([this,&f](detail::timer_link* l) {
+                task_base* t = static_cast<task_base*>(l->owner);
+                { synchronized( *t->_spinlock )
+                  t->_timer_thread = nullptr;
+                }
+                f(t);
+              });
+            for (task_base* scheduled_task : task_sch_queue)
+              f(scheduled_task);
+            task_sch_queue.clear();
+          }
+
+          time_point next_scheduled_time()const
+          {
+            if (task_wheel)
+              return task_wheel->next_expiry();
+            return task_sch_queue.empty() ? time_point::maximum() : task_sch_queue.front()->_when;
+          }
+
+          /** Puts c on the sleep queue, until c->resume_time */
+          void add_to_sleep_queue(fc::context* c)
+          {
+            if (sleep_wheel)
+            {
+              sleep_wheel->remove(&c->timer);
+              sleep_wheel->insert(&c->timer, c->resume_time);
+              return;
+            }
+            sleep_pqueue.push_back(c);
+            std::push_heap(sleep_pqueue.begin(), sleep_pqueue.end(), sleep_priority_less());
+          }
+
+          /** @return true if c was on the sleep queue */
+          bool remove_from_sleep_queue(fc::context* c)
+          {
+            if (sleep_wheel)
+            {
+              if (!c->timer.linked)
+                return false;
+              sleep_wheel->remove(&c->timer);
+              return true;
+            }
+            for (uint32_t i = 0; i < sleep_pqueue.size(); ++i)
+            {
+              if (sleep_pqueue[i] == c)
+              {
+                sleep_pqueue[i] = sleep_pqueue.back();
+                sleep_pqueue.pop_back();
+                std::make_heap(sleep_pqueue.begin(), sleep_pqueue.end(), sleep_priority_less());
+                return true;
+              }
+            }
+            return false;
+          }
+
+          /** Removes all sleeping contexts and passes them to f */
+          template<typename Functor>
+          void clear_sleep_queue(Functor&& f)
+          {
+            if (sleep_wheel)
+              sleep_wheel->clear([&f](detail::timer_link* l) { f(static_cast<fc::context*>(l->owner)); });
+            for (fc::context* c : sleep_pqueue)
+              f(c);
+            sleep_pqueue.clear();
+          }
+
+          time_point next_resume_time()const
+          {
+            if (sleep_wheel)
+              return sleep_wheel->next_expiry();
+            return sleep_pqueue.empty() ? time_point::maximum() : sleep_pqueue.front()->resume_time;
           }
 
            task_base* dequeue() 
@@ -319,6 +464,7 @@ namespace fc {
 
            bool process_canceled_tasks()
            {
+              scheduler_scope scope( *this );
               bool canceled_task = false;
               for( auto task_itr = task_sch_queue.begin();
                    task_itr != task_sch_queue.end();
@@ -363,6 +509,116 @@ namespace fc {
               }
            }
            
+           /** Starts a new watchdog slice, desc is null while the thread is idle */
+           void next_slice( const char* desc )
+           {
+              if( int64_t us = detail::watchdog_slice( desc ) )
+                stats.long_slice( us );
+           }
+
+           static const char* slice_desc( const fc::context* c )
+           {
+              return c->cur_task ? c->cur_task->get_desc() : "fc::thread scheduler";
+           }
+
+           /** Switches from prev, which is current, to next, which was taken off the ready list */
+           void jump_to_ready( fc::context* prev, fc::context* next )
+           {
+                next_slice( slice_desc( next ) );
+                stats.context_switched();
+                detail::trace( detail::trace_event_kind::context_switch, nullptr, next, prev );
+                // slog( "jump to %p from %p", next, prev );
+                // fc_dlog( logger::get("fc_context"), "from ${from} to ${to}", ( "from", int64_t(prev) )( "to", int64_t(next) ) ); 
+#if BOOST_VERSION >= 106100
+                auto p = context_pair{nullptr, prev};
+                auto t = bc::jump_fcontext( next->my_context, &p );
+                static_cast<context_pair*>(t.data)->second->my_context = t.fctx;
+#elif BOOST_VERSION >= 105600
+                bc::jump_fcontext( &prev->my_context, next->my_context, 0 );
+#elif BOOST_VERSION >= 105300
+                bc::jump_fcontext( prev->my_context, next->my_context, 0 );
+#else
+                bc::jump_fcontext( &prev->my_context, &next->my_context, 0 );
+#endif
+                BOOST_ASSERT( current );
+                BOOST_ASSERT( current == prev );
+                //current = prev;
+           }
+
+           /**
+            *  Marks scheduler code, e.g. timeouts that set promises. A direct
+            *  handoff must not switch fibers in the middle of it.
+            */
+           struct scheduler_scope
+           {
+              explicit scheduler_scope( thread_d& d ) : d(d), outer(d.in_scheduler) { d.in_scheduler = true; }
+              ~scheduler_scope() { d.in_scheduler = outer; }
+
+              thread_d&  d;
+              const bool outer;
+           };
+
+           /** At most this many fibers take turns by handoff before the ready list is served */
+           static const unsigned max_handoff_streak = 8;
+
+           /** @return true if the current fiber may switch straight to the woken context c */
+           bool can_hand_off_to( fc::context* c )const
+           {
+              if( !direct_handoff.load( boost::memory_order_relaxed ) || handoff_streak >= max_handoff_streak || done
+                  || in_scheduler )
+                return false;
+#ifndef NDEBUG
+              if( non_preemptable_scope_count )
+                return false;
+#endif
+              // the fiber may be unwinding or in a catch block, switching stacks there is not safe
+              if( std::uncaught_exception() || std::current_exception() )
+                return false;
+              if( c == current )
+                return false;
+              const int woken = fiber_priority( c );
+              if( current && woken < fiber_priority( current ) )
+                return false;
+              return ready_heap.empty() || ready_heap.front()->prio.value <= woken;
+           }
+
+           /** the priority of the task a fiber runs; a context's own priority only orders the ready list */
+           static int fiber_priority( const fc::context* c )
+           {
+              return c->cur_task ? c->cur_task->_prio.value : c->prio.value;
+           }
+
+           /**
+            *  Switches straight to c, which is ready, and queues the current
+            *  fiber behind the ready ones. A cancellation of the current fiber
+            *  is noticed the next time it blocks, because the fiber that set a
+            *  promise does not expect an exception.
+            */
+           void hand_off_to( fc::context* c )
+           {
+              if( !current )
+                current = new fc::context( &fc::thread::current() );
+              fc::context* prev = current;
+              add_context_to_ready_list( prev );
+              current = c;
+              ++handoff_streak;
+              stats.handed_off();
+              jump_to_ready( prev, c );
+           }
+
+           /** Completes the handoff that thread::notify() deferred, if it is still allowed */
+           void hand_off_deferred()
+           {
+              fc::context* c = deferred_handoff;
+              deferred_handoff = nullptr;
+              if( !c )
+                return;
+              if( can_hand_off_to( c ) )
+                hand_off_to( c );
+              else
+                add_context_to_ready_list( c );
+           }
+
            /**
             *   Find the next available context and switch to it.
             *   If none are available then create a new context and
@@ -389,6 +645,7 @@ namespace fc {
                 current = new fc::context( &fc::thread::current() );
 
               priority original_priority = current->prio;
+              handoff_streak = 0;
 
               // check to see if any other contexts are ready
               if (!ready_heap.empty())
@@ -410,22 +667,7 @@ namespace fc {
                   current->prio = priority::_internal__priority_for_short_sleeps();
                   add_context_to_ready_list(prev, true);
                 }
-                // slog( "jump to %p from %p", next, prev );
-                // fc_dlog( logger::get("fc_context"), "from ${from} to ${to}", ( "from", int64_t(prev) )( "to", int64_t(next) ) ); 
-#if BOOST_VERSION >= 106100
-                auto p = context_pair{nullptr, prev};
-                auto t = bc::jump_fcontext( next->my_context, &p );
-                static_cast<context_pair*>(t.data)->second->my_context = t.fctx;
-#elif BOOST_VERSION >= 105600
-                bc::jump_fcontext( &prev->my_context, next->my_context, 0 );
-#elif BOOST_VERSION >= 105300
-                bc::jump_fcontext( prev->my_context, next->my_context, 0 );
-#else
-                bc::jump_fcontext( &prev->my_context, &next->my_context, 0 );
-#endif
-                BOOST_ASSERT( current );
-                BOOST_ASSERT( current == prev );
-                //current = prev;
+                jump_to_ready( prev, next );
               } 
               else 
               { 
@@ -456,6 +698,9 @@ namespace fc {
                   add_context_to_ready_list(prev, true);
                 }
 
+                next_slice( "fc::thread scheduler" );
+                stats.context_switched();
+                detail::trace( detail::trace_event_kind::context_switch, nullptr, next, prev );
                 // slog( "jump to %p from %p", next, prev );
                 // fc_dlog( logger::get("fc_context"), "from ${from} to ${to}", ( "from", int64_t(prev) )( "to", int64_t(next) ) );
 #if BOOST_VERSION >= 106100
@@ -523,7 +768,14 @@ namespace fc {
 
               next->_set_active_context( current );
               current->cur_task = next;
+              const time_point start = time_point::now();
+              detail::trace( detail::trace_event_kind::task_start, next->get_desc(), next, current );
+              next_slice( next->get_desc() );
               next->run();
+              next_slice( "fc::thread scheduler" );
+              detail::trace( detail::trace_event_kind::task_end, next->get_desc(), next, current );
+              stats.task_finished( next->get_desc(), (start - std::max( next->_posted_time, next->_when )).count(),
+                                   (time_point::now() - start).count() );
               current->cur_task = 0;
               next->_set_active_context(0);
               next->release();
@@ -533,7 +785,7 @@ namespace fc {
            bool has_next_task() 
            {
              if( task_pqueue.size() ||
-                 (task_sch_queue.size() && task_sch_queue.front()->_when <= time_point::now()) ||
+                 next_scheduled_time() <= time_point::now() ||
                  task_in_queue.load( boost::memory_order_relaxed ) )
                return true;
              return false;
@@ -556,6 +808,8 @@ namespace fc {
                 // move all now-ready sleeping tasks to the ready list
                 check_for_timeouts();
 
+                stats.queue_depths( ready_heap.size(), task_pqueue.size() );
+
                 if (!task_pqueue.empty())
                 {
                   if (!ready_heap.empty())
@@ -590,46 +844,24 @@ namespace fc {
 
                 clear_free_list();
 
-                { // lock scope
-                  boost::unique_lock<boost::mutex> lock(task_ready_mutex);
-                  if( has_next_task() ) 
-                    continue;
-                  time_point timeout_time = check_for_timeouts();
-                  
-                  if( done ) 
-                    return;
-
-                  detail::idle_guard guard( this );
-                  if( task_in_queue.load(boost::memory_order_relaxed) )
-                     continue;
-
-                  if( timeout_time == time_point::maximum() ) 
-                    task_ready.wait( lock );
-                  else if( timeout_time != time_point::min() ) 
-                  {
-                     // there may be tasks that have been canceled we should filter them out now
-                     // rather than waiting... 
-
-
-                    /* This bit is kind of sloppy -- this wait was originally implemented as a wait
-                     * with respect to boost::chrono::system_clock.  This behaved rather comically
-                     * if you were to do a:
-                     *   fc::usleep(fc::seconds(60));
-                     * and then set your system's clock back a month, it would sleep for a month
-                     * plus a minute before waking back up (this happened on Linux, it seems 
-                     * Windows' behavior in this case was less unexpected).
-                     *
-                     * Boost Chrono's steady_clock will always increase monotonically so it will 
-                     * avoid this behavior.
-                     *
-                     * Right now we don't really have a way to distinguish when a timeout_time is coming
-                     * from a function that takes a relative time like fc::usleep() vs something
-                     * that takes an absolute time like fc::promise::wait_until(), so we can't always
-                     * do the right thing here.
-                     */ 
-                    task_ready.wait_until( lock, boost::chrono::steady_clock::now() + 
-                                                 boost::chrono::microseconds(timeout_time.time_since_epoch().count() - time_point::now().time_since_epoch().count()) );
-                  }
+                if( has_next_task() ) 
+                  continue;
+                time_point timeout_time = check_for_timeouts();
+
+                if( done ) 
+                  return;
+
+                detail::idle_guard guard( this );
+                if( task_in_queue.load(boost::memory_order_relaxed) )
+                   continue;
+
+                if( timeout_time != time_point::min() ) 
+                {
+                  next_slice( nullptr );
+                  const time_point park_start = time_point::now();
+                  parker.park( [this]() { return task_in_queue.load( boost::memory_order_relaxed ) != nullptr; },
+                               timeout_time );
+                  stats.parked( (time_point::now() - park_start).count() );
                 }
               }
            }
@@ -640,46 +872,47 @@ namespace fc {
      */
     time_point check_for_timeouts() 
     {
-        if( !sleep_pqueue.size() && !task_sch_queue.size() ) 
+        scheduler_scope scope( *this );
+        time_point next = std::min( next_resume_time(), next_scheduled_time() );
+        if( next == time_point::maximum() ) 
         {
           // ilog( "no timeouts ready" );
           return time_point::maximum();
         }
 
-        time_point next = time_point::maximum();
-        if( !sleep_pqueue.empty() && next > sleep_pqueue.front()->resume_time )
-          next = sleep_pqueue.front()->resume_time;
-        if( !task_sch_queue.empty() && next > task_sch_queue.front()->_when )
-          next = task_sch_queue.front()->_when;
-
         time_point now = time_point::now();
         if( now < next )
           return next;
 
         // move all expired sleeping tasks to the ready queue
+        if( sleep_wheel )
+          sleep_wheel->advance( now, [this]( detail::timer_link* l ) { wake_sleeping( static_cast<fc::context*>( l->owner ) ); } );
         while( sleep_pqueue.size() && sleep_pqueue.front()->resume_time < now ) 
         {
           fc::context::ptr c = sleep_pqueue.front();
           std::pop_heap(sleep_pqueue.begin(), sleep_pqueue.end(), sleep_priority_less() );
           // ilog( "sleep pop back..." );
           sleep_pqueue.pop_back();
-
-          if( c->blocking_prom.size() ) 
-          {
-            // ilog( "timeout blocking prom" );
-            c->timeout_blocking_promises();
-          }
-          else 
-          { 
-            // ilog( "..." );
-            // ilog( "ready_push_front" );
-            if (c != current)
-              add_context_to_ready_list(c);
-          }
+          wake_sleeping( c );
         }
         return time_point::min();
     }
 
+    void wake_sleeping( fc::context* c )
+    {
+        if( c->blocking_prom.size() ) 
+        {
+          // ilog( "timeout blocking prom" );
+          c->timeout_blocking_promises();
+        }
+        else 
+        { 
+          // ilog( "ready_push_front" );
+          if (c != current)
+            add_context_to_ready_list(c);
+        }
+    }
+
         void unblock( fc::context* c ) 
         {
           if( fc::thread::current().my != this ) 
@@ -707,24 +940,12 @@ namespace fc {
           current->resume_time = tp;
           current->clear_blocking_promises();
 
-          sleep_pqueue.push_back(current);
-          std::push_heap( sleep_pqueue.begin(),
-                          sleep_pqueue.end(), sleep_priority_less()   );
+          add_to_sleep_queue(current);
           
           start_next_fiber(reschedule);
 
           // clear current context from sleep queue...
-          for( uint32_t i = 0; i < sleep_pqueue.size(); ++i ) 
-          {
-            if( sleep_pqueue[i] == current ) 
-            {
-              sleep_pqueue[i] = sleep_pqueue.back();
-              sleep_pqueue.pop_back();
-              std::make_heap( sleep_pqueue.begin(),
-                              sleep_pqueue.end(), sleep_priority_less() );
-              break;
-            }
-          }
+          remove_from_sleep_queue(current);
 
           current->resume_time = time_point::maximum();
           check_fiber_exceptions();
@@ -750,10 +971,7 @@ namespace fc {
           if( timeout != time_point::maximum() ) 
           {
             current->resume_time = timeout;
-            sleep_pqueue.push_back(current);
-            std::push_heap( sleep_pqueue.begin(),
-                            sleep_pqueue.end(), 
-                            sleep_priority_less()   );
+            add_to_sleep_queue(current);
           }
 
           // elog( "blocking %1%", current );
@@ -789,6 +1007,7 @@ namespace fc {
             {
               fc::context* next_blocked = (*iter)->next_blocked;
               (*iter)->next_blocked = nullptr;
+              stats.context_unblocked();
               add_context_to_ready_list(*iter);
               *iter = next_blocked;
               continue;
@@ -796,6 +1015,22 @@ namespace fc {
             iter = &(*iter)->next_blocked;
           }
 
+          if (sleep_wheel)
+          {
+            std::vector<fc::context*> canceled_sleepers;
+            sleep_wheel->for_each([&canceled_sleepers](detail::timer_link* l) {
+              if (static_cast<fc::context*>(l->owner)->canceled)
+                canceled_sleepers.push_back(static_cast<fc::context*>(l->owner));
+            });
+            for (fc::context* c : canceled_sleepers)
+            {
+              sleep_wheel->remove(&c->timer);
+              if (std::find(ready_heap.begin(), ready_heap.end(), c) == ready_heap.end())
+                add_context_to_ready_list(c);
+            }
+            return;
+          }
+
           bool task_removed_from_sleep_pqueue = false;
           for (auto sleep_iter = sleep_pqueue.begin(); sleep_iter != sleep_pqueue.end();)
           {
@@ -0,0 +1,134 @@
+#pragma once
+#include <fc/time.hpp>
+
+#include <boost/atomic.hpp>
+#include <boost/chrono.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <algorithm>
+
+#if defined(__linux__)
+# include <linux/futex.h>
+# include <sys/syscall.h>
+# include <time.h>
+# include <unistd.h>
+# define FC_PARKER_USE_FUTEX
+#endif
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+# include <immintrin.h>
+# define FC_PARKER_PAUSE() _mm_pause()
+#else
+# define FC_PARKER_PAUSE() boost::atomic_signal_fence( boost::memory_order_seq_cst )
+#endif
+
+namespace fc { namespace detail {
+
+  /**
+   *  Lets an idle thread sleep until another thread posts work to it.
+   *
+   *  park() first spins for a short while, which keeps the latency of a post
+   *  that arrives right after the thread ran out of work low. Then it blocks on
+   *  a futex on Linux, or on a condition variable elsewhere.
+   *
+   *  unpark() leaves a permit that makes the next park() return at once, so a
+   *  wakeup is never lost. Only the unpark() that finds the thread blocked makes
+   *  a system call. Posts to a thread that is running, or that has a wakeup
+   *  pending, cost a fence and a load.
+   */
+  class thread_parker
+  {
+    public:
+      thread_parker() : state(awake) {}
+
+      /**
+       *  Returns when unpark() is called, ready() returns true or the timeout
+       *  expires, or spuriously. ready() is called without any locks held.
+       */
+      template<typename Ready>
+      void park( Ready&& ready, const time_point& timeout )
+      {
+        for( unsigned i = 0; i < spin_iterations; ++i )
+        {
+          if( state.load( boost::memory_order_relaxed ) == notified || ready() )
+          {
+            state.store( awake, boost::memory_order_relaxed );
+            return;
+          }
+          FC_PARKER_PAUSE();
+        }
+
+        if( state.exchange( parked, boost::memory_order_seq_cst ) == notified || ready() )
+        {
+          state.store( awake, boost::memory_order_relaxed );
+          return;
+        }
+        block( timeout );
+        state.store( awake, boost::memory_order_relaxed );
+      }
+
+      void unpark()
+      {
+        // pairs with the exchange in park(), after the caller published its work
+        boost::atomic_thread_fence( boost::memory_order_seq_cst );
+        if( state.load( boost::memory_order_relaxed ) == notified )
+          return;
+        if( state.exchange( notified, boost::memory_order_seq_cst ) == parked )
+          wake();
+      }
+
+    private:
+      enum { awake = 0, parked = 1, notified = 2 };
+      static const unsigned spin_iterations = 1000;
+
+      /*
+       * Timeouts are waited for relative to a monotonic clock. A time_point is
+       * based on the system clock, so setting the system clock back while a
+       * thread waits for an fc::usleep() does not make it wait longer.
+       */
+      void block( const time_point& timeout )
+      {
+        const bool forever = timeout == time_point::maximum();
+        const int64_t wait_us = forever ? 0 : std::max<int64_t>( 0, (timeout - time_point::now()).count() );
+#ifdef FC_PARKER_USE_FUTEX
+        struct timespec ts;
+        ts.tv_sec  = wait_us / 1000000;
+        ts.tv_nsec = (wait_us % 1000000) * 1000;
+        // returns at once if the state is no longer parked
+        syscall( SYS_futex, reinterpret_cast<int32_t*>( &state ), FUTEX_WAIT_PRIVATE, int32_t(parked),
+                 forever ? nullptr : &ts, nullptr, 0 );
+#else
+        const boost::chrono::steady_clock::time_point deadline = boost::chrono::steady_clock::now()
+                                                                 + boost::chrono::microseconds( wait_us );
+        boost::unique_lock<boost::mutex> lock( mutex );
+        while( state.load() == parked )
+        {
+          if( forever )
+            cond.wait( lock );
+          else if( cond.wait_until( lock, deadline ) == boost::cv_status::timeout )
+            break;
+        }
+#endif
+      }
+
+      void wake()
+      {
+#ifdef FC_PARKER_USE_FUTEX
+        syscall( SYS_futex, reinterpret_cast<int32_t*>( &state ), FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0 );
+#else
+        boost::unique_lock<boost::mutex> lock( mutex );
+        cond.notify_one();
+#endif
+      }
+
+      boost::atomic<int32_t> state;
+#ifdef FC_PARKER_USE_FUTEX
+      static_assert( sizeof(boost::atomic<int32_t>) == sizeof(int32_t), "the futex operates on the state" );
+#else
+      boost::mutex               mutex;
+      boost::condition_variable  cond;
+#endif
+  };
+
+} } // namespace fc::detail
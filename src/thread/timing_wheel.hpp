@@ -0,0 +1,257 @@
+#pragma once
+#include <fc/thread/task.hpp>
+#include <fc/time.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+
+#ifdef _MSC_VER
+# include <intrin.h>
+#endif
+
+namespace fc { namespace detail {
+
+  /**
+   *  Hierarchical timing wheel with 1ms ticks.
+   *
+   *  Each level has 64 slots and covers 6 more bits of the tick count than the
+   *  level below, so 11 levels span every possible tick. An entry lives on the
+   *  lowest level at which its tick shares all higher digits with the current
+   *  tick, and moves down when the current tick reaches the start of its slot.
+   *  Entries that are already due go into the current slot of level 0.
+   *
+   *  Insert and remove are O(1). Advancing the wheel skips empty slots by means
+   *  of a bitmap per level.
+   */
+  class timing_wheel
+  {
+    public:
+      static const int64_t  tick_us   = 1000;
+      static const unsigned slot_bits = 6;
+      static const unsigned slots     = 1u << slot_bits;
+      static const unsigned levels    = 11;
+
+      timing_wheel()
+      : current_tick( time_point::now().time_since_epoch().count() / tick_us ),
+        count(0)
+      {
+        std::fill( &heads[0][0], &heads[0][0] + levels * slots, nullptr );
+        std::fill( occupied, occupied + levels, 0 );
+      }
+
+      bool   empty()const { return count == 0; }
+      size_t size()const  { return count; }
+
+      void insert( timer_link* l, const time_point& expires )
+      {
+        l->expires = expires.time_since_epoch().count();
+        link( l );
+      }
+
+      void remove( timer_link* l )
+      {
+        if( !l->linked )
+          return;
+        if( l->prev )
+          l->prev->next = l->next;
+        else
+        {
+          heads[l->level][l->slot] = l->next;
+          if( !l->next )
+            occupied[l->level] &= ~(uint64_t(1) << l->slot);
+        }
+        if( l->next )
+          l->next->prev = l->prev;
+        l->prev = l->next = nullptr;
+        l->linked = false;
+        --count;
+      }
+
+      /**
+       *  @return the earliest time at which advance() may find an expired entry,
+       *  time_point::maximum() if the wheel is empty. For entries on higher
+       *  levels this is the time at which they move down.
+       */
+      time_point next_expiry()const
+      {
+        if( !count )
+          return time_point::maximum();
+        const unsigned digit = current_tick & (slots - 1);
+        const uint64_t pending = occupied[0] & (~uint64_t(0) << digit);
+        if( pending )
+          return earliest_in( heads[0][lowest_bit( pending )] );
+        return time_point( microseconds( next_cascade() * tick_us ) );
+      }
+
+      /**
+       *  Advances the wheel to now and calls on_expired(link) for every entry
+       *  that expired at or before now. Each entry is removed before its callback
+       *  runs, and the callback may insert or remove other entries.
+       */
+      template<typename Callback>
+      void advance( const time_point& now, Callback&& on_expired )
+      {
+        const int64_t now_us = now.time_since_epoch().count();
+        const int64_t target = now_us / tick_us;
+        expire_current( now_us, on_expired );
+        while( current_tick < target )
+        {
+          if( !count )
+          {
+            current_tick = target;
+            break;
+          }
+          // jump to the next occupied slot on level 0, or to the next slot that moves down
+          const unsigned digit = current_tick & (slots - 1);
+          const uint64_t later = digit + 1 < slots ? occupied[0] & (~uint64_t(0) << (digit + 1)) : 0;
+          const int64_t next = later ? (current_tick & ~int64_t(slots - 1)) + lowest_bit( later )
+                                     : next_cascade();
+          current_tick = std::min( next, target );
+          if( !(current_tick & (slots - 1)) )
+            cascade();
+          expire_current( now_us, on_expired );
+        }
+      }
+
+      /** Removes every entry and passes it to f */
+      template<typename Callback>
+      void clear( Callback&& f )
+      {
+        for( unsigned level = 0; level < levels && count; ++level )
+          while( occupied[level] )
+          {
+            timer_link* l = heads[level][lowest_bit( occupied[level] )];
+            remove( l );
+            f( l );
+          }
+      }
+
+      /** Calls f(link) for every entry, f must not modify the wheel */
+      template<typename Callback>
+      void for_each( Callback&& f )const
+      {
+        for( unsigned level = 0; level < levels; ++level )
+          for( unsigned slot = 0; slot < slots; ++slot )
+            for( timer_link* l = heads[level][slot]; l; l = l->next )
+              f( l );
+      }
+
+    private:
+      static unsigned lowest_bit( uint64_t v )
+      {
+#ifdef _MSC_VER
+        unsigned long i;
+        _BitScanForward64( &i, v );
+        return i;
+#else
+        return __builtin_ctzll( v );
+#endif
+      }
+
+      static unsigned highest_bit( uint64_t v )
+      {
+#ifdef _MSC_VER
+        unsigned long i;
+        _BitScanReverse64( &i, v );
+        return i;
+#else
+        return 63 - __builtin_clzll( v );
+#endif
+      }
+
+      static time_point earliest_in( const timer_link* l )
+      {
+        int64_t earliest = l->expires;
+        for( l = l->next; l; l = l->next )
+          earliest = std::min( earliest, l->expires );
+        return time_point( microseconds( earliest ) );
+      }
+
+      void link( timer_link* l )
+      {
+        const int64_t tick = l->expires / tick_us;
+        unsigned level = 0;
+        unsigned slot = current_tick & (slots - 1);
+        if( tick > current_tick )
+        {
+          level = highest_bit( uint64_t(tick) ^ uint64_t(current_tick) ) / slot_bits;
+          slot = (tick >> (level * slot_bits)) & (slots - 1);
+        }
+        l->level = level;
+        l->slot = slot;
+        l->prev = nullptr;
+        l->next = heads[level][slot];
+        if( l->next )
+          l->next->prev = l;
+        heads[level][slot] = l;
+        occupied[level] |= uint64_t(1) << slot;
+        l->linked = true;
+        ++count;
+      }
+
+      /**
+       *  @return the first tick after the current one at which an occupied slot
+       *  of level 1 or higher starts. Lower levels always come first.
+       */
+      int64_t next_cascade()const
+      {
+        for( unsigned level = 1; level < levels; ++level )
+        {
+          const unsigned shift = level * slot_bits;
+          const unsigned digit = (current_tick >> shift) & (slots - 1);
+          const uint64_t later = digit + 1 < slots ? occupied[level] & (~uint64_t(0) << (digit + 1)) : 0;
+          if( later )
+          {
+            const int64_t base = shift + slot_bits < 64 ? (current_tick >> (shift + slot_bits)) << (shift + slot_bits) : 0;
+            return base + (int64_t(lowest_bit( later )) << shift);
+          }
+        }
+        return std::numeric_limits<int64_t>::max() / tick_us;
+      }
+
+      /** Moves the entries of every level whose slot starts at the current tick down */
+      void cascade()
+      {
+        unsigned top = 1;
+        while( top + 1 < levels && !(current_tick & ((int64_t(1) << ((top + 1) * slot_bits)) - 1)) )
+          ++top;
+        for( unsigned level = top; level >= 1; --level )
+        {
+          const unsigned slot = (current_tick >> (level * slot_bits)) & (slots - 1);
+          timer_link* l = heads[level][slot];
+          heads[level][slot] = nullptr;
+          occupied[level] &= ~(uint64_t(1) << slot);
+          while( l )
+          {
+            timer_link* next = l->next;
+            --count;
+            link( l );
+            l = next;
+          }
+        }
+      }
+
+      template<typename Callback>
+      void expire_current( int64_t now_us, Callback& on_expired )
+      {
+        const unsigned slot = current_tick & (slots - 1);
+        for( ;; )
+        {
+          timer_link* l = heads[0][slot];
+          while( l && l->expires > now_us )
+            l = l->next;
+          if( !l )
+            return;
+          remove( l );
+          on_expired( l );
+        }
+      }
+
+      int64_t     current_tick;
+      size_t      count;
+      uint64_t    occupied[levels];
+      timer_link* heads[levels][slots];
+  };
+
+} } // namespace fc::detail
@@ -1,5 +1,6 @@
 #include <fc/variant.hpp>
 #include <fc/variant_object.hpp>
+#include <fc/variant_arena.hpp>
 #include <fc/exception/exception.hpp>
 #include <fc/io/sstream.hpp>
 #include <fc/io/json.hpp>
@@ -22,6 +23,50 @@ void set_variant_type( variant* v, variant::type_id t)
    data[ sizeof(variant) -1 ] = t;
 }
 
+namespace {
+   /**
+    *  Set next to the TypeID when the heap value of the variant was allocated
+    *  in a variant_arena, so that values from the heap need no header.
+    */
+   const char arena_flag = 0x10;
+
+   template<typename T, typename... Args>
+   void set_heap_value( variant* v, variant::type_id t, Args&&... args )
+   {
+      if( !detail::in_variant_arena() )
+      {
+         *reinterpret_cast<T**>(v) = new T( std::forward<Args>(args)... );
+         set_variant_type( v, t );
+         return;
+      }
+      void* p = detail::arena_allocate( sizeof(T) );
+      try
+      {
+         *reinterpret_cast<T**>(v) = new (p) T( std::forward<Args>(args)... );
+      }
+      catch( ... )
+      {
+         detail::arena_deallocate( p );
+         throw;
+      }
+      set_variant_type( v, t );
+      reinterpret_cast<char*>(v)[ sizeof(variant) - 1 ] |= arena_flag;
+   }
+
+   template<typename T>
+   void delete_heap_value( variant* v )
+   {
+      T* p = *reinterpret_cast<T**>(v);
+      if( reinterpret_cast<const char*>(v)[ sizeof(variant) - 1 ] & arena_flag )
+      {
+         p->~T();
+         detail::arena_deallocate( p );
+      }
+      else
+         delete p;
+   }
+}
+
 variant::variant()
 {
    set_variant_type( this, null_type );
@@ -108,14 +153,12 @@ variant::variant( bool val, uint32_t max_depth )
 
 variant::variant( char* str, uint32_t max_depth )
 {
-   *reinterpret_cast<string**>(this)  = new string( str );
-   set_variant_type( this, string_type );
+   set_heap_value<string>( this, string_type, str );
 }
 
 variant::variant( const char* str, uint32_t max_depth )
 {
-   *reinterpret_cast<string**>(this)  = new string( str );
-   set_variant_type( this, string_type );
+   set_heap_value<string>( this, string_type, str );
 }
 
 // TODO: do a proper conversion to utf8
@@ -125,8 +168,7 @@ variant::variant( wchar_t* str, uint32_t max_depth )
    boost::scoped_array<char> buffer(new char[len]);
    for (unsigned i = 0; i < len; ++i)
       buffer[i] = (char)str[i];
-   *reinterpret_cast<string**>(this)  = new string(buffer.get(), len);
-   set_variant_type( this, string_type );
+   set_heap_value<string>( this, string_type, buffer.get(), len );
 }
 
 // TODO: do a proper conversion to utf8
@@ -136,14 +178,12 @@ variant::variant( const wchar_t* str, uint32_t max_depth )
    boost::scoped_array<char> buffer(new char[len]);
    for (unsigned i = 0; i < len; ++i)
       buffer[i] = (char)str[i];
-   *reinterpret_cast<string**>(this)  = new string(buffer.get(), len);
-   set_variant_type( this, string_type );
+   set_heap_value<string>( this, string_type, buffer.get(), len );
 }
 
 variant::variant( std::string val, uint32_t max_depth )
 {
-   *reinterpret_cast<string**>(this)  = new string( std::move(val) );
-   set_variant_type( this, string_type );
+   set_heap_value<string>( this, string_type, std::move(val) );
 }
 variant::variant( blob val, uint32_t max_depth )
 {
@@ -153,19 +193,16 @@ variant::variant( blob val, uint32_t max_depth )
 
 variant::variant( variant_object obj, uint32_t max_depth )
 {
-   *reinterpret_cast<variant_object**>(this) = new variant_object(std::move(obj));
-   set_variant_type(this,  object_type );
+   set_heap_value<variant_object>( this, object_type, std::move(obj) );
 }
 variant::variant( mutable_variant_object obj, uint32_t max_depth )
 {
-   *reinterpret_cast<variant_object**>(this) = new variant_object(std::move(obj));
-   set_variant_type(this,  object_type );
+   set_heap_value<variant_object>( this, object_type, std::move(obj) );
 }
 
 variant::variant( variants arr, uint32_t max_depth )
 {
-   *reinterpret_cast<variants**>(this)  = new variants(std::move(arr));
-   set_variant_type(this,  array_type );
+   set_heap_value<variants>( this, array_type, std::move(arr) );
 }
 
 typedef const variant_object* const_variant_object_ptr; 
@@ -178,13 +215,13 @@ void variant::clear()
    switch( get_type() )
    {
      case object_type:
-        delete *reinterpret_cast<variant_object**>(this);
+        delete_heap_value<variant_object>( this );
         break;
      case array_type:
-        delete *reinterpret_cast<variants**>(this);
+        delete_heap_value<variants>( this );
         break;
      case string_type:
-        delete *reinterpret_cast<string**>(this);
+        delete_heap_value<string>( this );
         break;
      default:
         break;
@@ -197,19 +234,13 @@ variant::variant( const variant& v, uint32_t max_depth )
    switch( v.get_type() )
    {
        case object_type:
-          *reinterpret_cast<variant_object**>(this)  = 
-             new variant_object(**reinterpret_cast<const const_variant_object_ptr*>(&v));
-          set_variant_type( this, object_type );
+          set_heap_value<variant_object>( this, object_type, **reinterpret_cast<const const_variant_object_ptr*>(&v) );
           return;
        case array_type:
-          *reinterpret_cast<variants**>(this)  = 
-             new variants(**reinterpret_cast<const const_variants_ptr*>(&v));
-          set_variant_type( this,  array_type );
+          set_heap_value<variants>( this, array_type, **reinterpret_cast<const const_variants_ptr*>(&v) );
           return;
        case string_type:
-          *reinterpret_cast<string**>(this)  = 
-             new string(**reinterpret_cast<const const_string_ptr*>(&v) );
-          set_variant_type( this, string_type );
+          set_heap_value<string>( this, string_type, **reinterpret_cast<const const_string_ptr*>(&v) );
           return;
        default:
           memcpy( this, &v, sizeof(v) );
@@ -245,21 +276,18 @@ variant& variant::operator=( const variant& v )
    switch( v.get_type() )
    {
       case object_type:
-         *reinterpret_cast<variant_object**>(this)  = 
-            new variant_object((**reinterpret_cast<const const_variant_object_ptr*>(&v)));
+         set_heap_value<variant_object>( this, object_type, **reinterpret_cast<const const_variant_object_ptr*>(&v) );
          break;
       case array_type:
-         *reinterpret_cast<variants**>(this)  = 
-            new variants((**reinterpret_cast<const const_variants_ptr*>(&v)));
+         set_heap_value<variants>( this, array_type, **reinterpret_cast<const const_variants_ptr*>(&v) );
          break;
       case string_type:
-         *reinterpret_cast<string**>(this)  = new string((**reinterpret_cast<const const_string_ptr*>(&v)) );
+         set_heap_value<string>( this, string_type, **reinterpret_cast<const const_string_ptr*>(&v) );
          break;
 
       default:
          memcpy( this, &v, sizeof(v) );
    }
-   set_variant_type( this, v.get_type() );
    return *this;
 }
 
@@ -298,7 +326,7 @@ void  variant::visit( const visitor& v )const
 
 variant::type_id variant::get_type()const
 {
-   return (type_id)reinterpret_cast<const char*>(this)[sizeof(*this)-1];
+   return (type_id)(reinterpret_cast<const char*>(this)[sizeof(*this)-1] & ~arena_flag);
 }
 
 bool variant::is_null()const
@@ -587,7 +615,13 @@ void from_variant( const variant& var, variants& vo, uint32_t max_depth )
    vo = var.get_array();
 }
 
+void from_variant( variant&& var, variants& vo, uint32_t max_depth )
+{
+   vo = std::move( var.get_array() );
+}
+
 void from_variant( const variant& var, variant& vo, uint32_t max_depth ) { vo = var; }
+void from_variant( variant&& var, variant& vo, uint32_t max_depth )      { vo = std::move(var); }
 
 void to_variant( const uint8_t& var, variant& vo, uint32_t max_depth )  { vo = uint64_t(var); }
 // TODO: warn on overflow?
@@ -655,6 +689,14 @@ void from_variant( const variant& var, string& vo, uint32_t max_depth )
    vo = var.as_string();
 }
 
+void from_variant( variant&& var, string& vo, uint32_t max_depth )
+{
+   if( var.get_type() == variant::string_type )
+      vo = std::move( **reinterpret_cast<string**>(&var) );
+   else
+      vo = var.as_string();
+}
+
 void to_variant( const std::vector<char>& var, variant& vo, uint32_t max_depth )
 {
   if( var.size() )
@@ -672,6 +714,12 @@ void from_variant( const variant& var, std::vector<char>& vo, uint32_t max_depth
      }
 }
 
+void from_variant( variant&& var, std::vector<char>& vo, uint32_t max_depth )
+{
+   // decoded from hex, there is nothing to take over
+   from_variant( static_cast<const variant&>( var ), vo, max_depth );
+}
+
 #ifdef __APPLE__
 #elif !defined(_MSC_VER)
    void to_variant( long long int s, variant& v, uint32_t max_depth ) { v = variant( int64_t(s) ); }
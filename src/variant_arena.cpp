@@ -0,0 +1,126 @@
+#include <fc/variant_arena.hpp>
+#include <fc/exception/exception.hpp>
+#include <fc/thread/thread.hpp>
+
+#include "thread/thread_d.hpp"
+
+#include <boost/atomic.hpp>
+
+namespace fc
+{
+   namespace detail
+   {
+      struct arena_block
+      {
+         boost::atomic<size_t> refs;  // allocations not yet released, + 1 while an arena fills the block
+         char*                 next;
+         char*                 end;
+      };
+
+      namespace
+      {
+         /** Precedes every allocation of arena_allocate(), null for the ones from the heap */
+         struct alignas(std::max_align_t) allocation_header
+         {
+            arena_block* block;
+         };
+
+         const size_t header_size = sizeof(allocation_header);
+         const size_t block_header_size = ( sizeof(arena_block) + header_size - 1 ) / header_size * header_size;
+
+         // lets threads without any arena skip the lookup of the fiber
+#ifdef _MSC_VER
+         __declspec(thread) unsigned active_arenas = 0;
+#else
+         __thread unsigned active_arenas = 0;
+#endif
+
+         void release( arena_block* block )
+         {
+            if( block->refs.fetch_sub( 1, boost::memory_order_release ) == 1 )
+            {
+               boost::atomic_thread_fence( boost::memory_order_acquire );
+               block->~arena_block();
+               ::operator delete( block );
+            }
+         }
+      }
+
+      bool in_variant_arena()
+      {
+         return active_arenas && variant_arena::current();
+      }
+
+      void* arena_allocate( size_t size )
+      {
+         if( variant_arena* arena = variant_arena::current() )
+            if( void* p = arena->allocate( size ) )
+               return p;
+         allocation_header* h = static_cast<allocation_header*>( ::operator new( header_size + size ) );
+         h->block = nullptr;
+         return h + 1;
+      }
+
+      void arena_deallocate( void* p )
+      {
+         if( !p )
+            return;
+         allocation_header* h = static_cast<allocation_header*>( p ) - 1;
+         if( h->block )
+            release( h->block );
+         else
+            ::operator delete( h );
+      }
+   } // namespace detail
+
+   variant_arena::variant_arena( size_t block_size )
+   :_block_size( block_size ), _block( nullptr )
+   {
+      FC_ASSERT( block_size >= 1024, "variant_arena blocks must hold at least 1 KiB" );
+      thread_d* t = thread::current().my;
+      if( !t->current )
+         t->current = new fc::context( &thread::current() );
+      _outer = t->current->arena;
+      t->current->arena = this;
+      ++detail::active_arenas;
+   }
+
+   variant_arena::~variant_arena()
+   {
+      thread::current().my->current->arena = _outer;
+      --detail::active_arenas;
+      if( _block )
+         detail::release( _block );
+   }
+
+   variant_arena* variant_arena::current()
+   {
+      return thread::current().my->current->arena;
+   }
+
+   /** @return null if size does not fit into a block */
+   void* variant_arena::allocate( size_t size )
+   {
+      const size_t needed = detail::header_size
+                            + ( size + detail::header_size - 1 ) / detail::header_size * detail::header_size;
+      if( needed > _block_size / 4 )
+         return nullptr;
+      if( !_block || size_t( _block->end - _block->next ) < needed )
+      {
+         char* memory = static_cast<char*>( ::operator new( detail::block_header_size + _block_size ) );
+         detail::arena_block* block = new (memory) detail::arena_block();
+         block->refs.store( 1, boost::memory_order_relaxed );
+         block->next = memory + detail::block_header_size;
+         block->end = block->next + _block_size;
+         if( _block )
+            detail::release( _block );
+         _block = block;
+      }
+      detail::allocation_header* h = reinterpret_cast<detail::allocation_header*>( _block->next );
+      _block->next += needed;
+      _block->refs.fetch_add( 1, boost::memory_order_relaxed );
+      h->block = _block;
+      return h + 1;
+   }
+
+} // namespace fc
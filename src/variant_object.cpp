@@ -1,10 +1,90 @@
 #include <fc/variant_object.hpp>
 #include <fc/exception/exception.hpp>
 #include <assert.h>
+#include <string.h>
 
 
 namespace fc
 {
+   namespace detail
+   {
+      /**
+       *  An open addressing hash table of the positions of the keys in a vector
+       *  of entries. Of duplicate keys it knows the first, like a scan would.
+       */
+      class key_index
+      {
+         public:
+            typedef std::vector< variant_object::entry > entries;
+
+            /** Objects with fewer keys are scanned */
+            static const size_t min_size = 16;
+
+            explicit key_index( const entries& e )
+            {
+               rebuild( e );
+            }
+
+            /** @return the position of key in e, e.size() if it is not there */
+            size_t find( const entries& e, const char* key, size_t length )const
+            {
+               for( size_t i = hash( key, length ) & _mask; _slots[i]; i = ( i + 1 ) & _mask )
+               {
+                  const string& k = e[ _slots[i] - 1 ].key();
+                  if( k.size() == length && memcmp( k.data(), key, length ) == 0 )
+                     return _slots[i] - 1;
+               }
+               return e.size();
+            }
+
+            /** Adds the last entry of e */
+            void push_back( const entries& e )
+            {
+               if( 2 * ( _size + 1 ) > _slots.size() )
+                  rebuild( e );
+               else
+                  insert( e, uint32_t( e.size() - 1 ) );
+            }
+
+         private:
+            /** FNV-1a */
+            static size_t hash( const char* key, size_t length )
+            {
+               uint64_t h = 14695981039346656037ull;
+               for( size_t i = 0; i < length; ++i )
+                  h = ( h ^ uint8_t( key[i] ) ) * 1099511628211ull;
+               return size_t( h ^ ( h >> 32 ) );
+            }
+
+            void rebuild( const entries& e )
+            {
+               size_t capacity = 32;
+               while( capacity < 2 * e.size() )
+                  capacity *= 2;
+               _slots.assign( capacity, 0 );
+               _mask = capacity - 1;
+               _size = 0;
+               for( uint32_t pos = 0; pos < e.size(); ++pos )
+                  insert( e, pos );
+            }
+
+            void insert( const entries& e, uint32_t pos )
+            {
+               const string& key = e[pos].key();
+               size_t i = hash( key.data(), key.size() ) & _mask;
+               for( ; _slots[i]; i = ( i + 1 ) & _mask )
+                  if( e[ _slots[i] - 1 ].key() == key )
+                     return;
+               _slots[i] = pos + 1;
+               ++_size;
+            }
+
+            std::vector< uint32_t > _slots; // position + 1, 0 if free
+            size_t                  _mask;
+            size_t                  _size;
+      };
+   }
+
    // ---------------------------------------------------------------
    // entry
 
@@ -68,6 +148,21 @@ namespace fc
 
    variant_object::iterator variant_object::find( const char* key )const
    {
+      const entries& e = *_key_value;
+      const detail::key_index* index = e.index.load( std::memory_order_acquire );
+      if( !index && e.size() >= detail::key_index::min_size )
+      {
+         // concurrent readers may build it as well, the first one wins
+         std::unique_ptr<detail::key_index> built( new detail::key_index( e ) );
+         const detail::key_index* expected = nullptr;
+         if( e.index.compare_exchange_strong( expected, built.get(), std::memory_order_acq_rel ) )
+            index = built.release();
+         else
+            index = expected;
+      }
+      if( index )
+         return begin() + index->find( e, key, strlen( key ) );
+
       for( auto itr = begin(); itr != end(); ++itr )
       {
          if( itr->key() == key )
@@ -96,12 +191,12 @@ namespace fc
    }
 
    variant_object::variant_object() 
-      :_key_value(std::make_shared<std::vector<entry>>() )
+      :_key_value(make_entries() )
    {
    }
 
    variant_object::variant_object( string key, variant val )
-      : _key_value(std::make_shared<std::vector<entry>>())
+      : _key_value(make_entries())
    {
        _key_value->emplace_back(entry(std::move(key), std::move(val)));
    }
@@ -115,19 +210,21 @@ namespace fc
    variant_object::variant_object( variant_object&& obj)
    : _key_value( std::move(obj._key_value) )
    {
-      obj._key_value = std::make_shared<std::vector<entry>>();
+      obj._key_value = make_entries();
       assert( _key_value != nullptr );
    }
 
    variant_object::variant_object( const mutable_variant_object& obj )
-      : _key_value(std::make_shared<std::vector<entry>>(*obj._key_value))
+      : _key_value( make_entries( *obj._key_value ) )
    {
    }
 
    variant_object::variant_object( mutable_variant_object&& obj )
-   : _key_value(std::move(obj._key_value))
+   : _key_value( make_entries( std::move( *obj._key_value ) ) )
    {
-      assert( _key_value != nullptr );
+      // the positions stay the same
+      _key_value->index.store( obj._index.release(), std::memory_order_relaxed );
+      obj._key_value->clear();
    }
 
    variant_object& variant_object::operator=( variant_object&& obj )
@@ -151,17 +248,29 @@ namespace fc
 
    variant_object& variant_object::operator=( mutable_variant_object&& obj )
    {
-      _key_value = std::move(obj._key_value);
-      obj._key_value.reset( new std::vector<entry>() );
+      _key_value = make_entries( std::move( *obj._key_value ) );
+      _key_value->index.store( obj._index.release(), std::memory_order_relaxed );
+      obj._key_value->clear();
       return *this;
    }
 
    variant_object& variant_object::operator=( const mutable_variant_object& obj )
    {
-      *_key_value = *obj._key_value;
+      static_cast<std::vector<entry>&>( *_key_value ) = *obj._key_value;
+      _key_value->reindex();
       return *this;
    }
 
+   variant_object::entries::~entries()
+   {
+      delete index.load( std::memory_order_relaxed );
+   }
+
+   void variant_object::entries::reindex()
+   {
+      delete index.exchange( nullptr );
+   }
+
    void to_variant( const variant_object& var, variant& vo, uint32_t max_depth )
    {
       vo = variant(var);
@@ -172,11 +281,20 @@ namespace fc
       vo = var.get_object();
    }
 
+   void from_variant( variant&& var, variant_object& vo, uint32_t max_depth )
+   {
+      if( !var.is_object() )
+         return from_variant( static_cast<const variant&>( var ), vo, max_depth );
+      vo = std::move( var.get_object() );
+   }
+
    // ---------------------------------------------------------------
    // mutable_variant_object
 
    mutable_variant_object::iterator mutable_variant_object::begin()
    {
+      // the keys may be changed through the iterators
+      _index.reset();
       return _key_value->begin();
    }
 
@@ -202,6 +320,8 @@ namespace fc
 
    mutable_variant_object::iterator mutable_variant_object::find( const char* key )const
    {
+      if( _index )
+         return _key_value->begin() + _index->find( *_key_value, key, strlen( key ) );
       for( auto itr = begin(); itr != end(); ++itr )
       {
          if( itr->key() == key )
@@ -219,14 +339,9 @@ namespace fc
 
    mutable_variant_object::iterator mutable_variant_object::find( const char* key )
    {
-      for( auto itr = begin(); itr != end(); ++itr )
-      {
-         if( itr->key() == key )
-         {
-            return itr;
-         }
-      }
-      return end();
+      if( !_index )
+         reindex();
+      return static_cast<const mutable_variant_object&>( *this ).find( key );
    }
 
    const variant& mutable_variant_object::operator[]( const string& key )const
@@ -250,6 +365,7 @@ namespace fc
       auto itr = find( key );
       if( itr != end() ) return itr->value();
       _key_value->emplace_back(entry(key, variant()));
+      appended();
       return _key_value->back().value();
    }
 
@@ -272,21 +388,41 @@ namespace fc
    mutable_variant_object::mutable_variant_object( const variant_object& obj )
       : _key_value( new std::vector<entry>(*obj._key_value) )
    {
+      reindex();
+   }
+
+   mutable_variant_object::mutable_variant_object( variant_object&& obj )
+   {
+      if( obj._key_value.use_count() == 1 )
+      {
+         _key_value.reset( new std::vector<entry>( std::move( static_cast<std::vector<entry>&>( *obj._key_value ) ) ) );
+         obj._key_value->clear();
+         obj._key_value->reindex();
+      }
+      else
+         _key_value.reset( new std::vector<entry>( *obj._key_value ) );
+      reindex();
    }
 
    mutable_variant_object::mutable_variant_object( const mutable_variant_object& obj )
       : _key_value( new std::vector<entry>(*obj._key_value) )
    {
+      reindex();
    }
 
    mutable_variant_object::mutable_variant_object( mutable_variant_object&& obj )
-      : _key_value(std::move(obj._key_value))
+      : _key_value(std::move(obj._key_value)), _index(std::move(obj._index))
+   {
+   }
+
+   mutable_variant_object::~mutable_variant_object()
    {
    }
 
    mutable_variant_object& mutable_variant_object::operator=( const variant_object& obj )
    {
       *_key_value = *obj._key_value;
+      reindex();
       return *this;
    }
 
@@ -295,6 +431,7 @@ namespace fc
       if (this != &obj)
       {
          _key_value = std::move(obj._key_value);
+         _index = std::move(obj._index);
       }
       return *this;
    }
@@ -304,10 +441,24 @@ namespace fc
       if (this != &obj)
       {
          *_key_value = *obj._key_value;
+         reindex();
       }
       return *this;
    }
 
+   void mutable_variant_object::reindex()
+   {
+      _index.reset( _key_value->size() >= detail::key_index::min_size ? new detail::key_index( *_key_value ) : nullptr );
+   }
+
+   void mutable_variant_object::appended()
+   {
+      if( _index )
+         _index->push_back( *_key_value );
+      else if( _key_value->size() >= detail::key_index::min_size )
+         reindex();
+   }
+
    void mutable_variant_object::reserve( size_t s )
    {
       _key_value->reserve(s);
@@ -315,11 +466,12 @@ namespace fc
 
    void  mutable_variant_object::erase( const string& key )
    {
-      for( auto itr = begin(); itr != end(); ++itr )
+      for( auto itr = _key_value->begin(); itr != _key_value->end(); ++itr )
       {
          if( itr->key() == key )
          {
             _key_value->erase(itr);
+            reindex();
             return;
          }
       }
@@ -336,6 +488,7 @@ namespace fc
       else
       {
          _key_value->push_back( entry( std::move(key), std::move(var) ) );
+         appended();
       }
       return *this;
    }
@@ -346,6 +499,7 @@ namespace fc
    mutable_variant_object& mutable_variant_object::operator()( string key, variant var, uint32_t max_depth )
    {
       _key_value->push_back( entry( std::move(key), std::move(var) ) );
+      appended();
       return *this;
    }
 
@@ -407,4 +561,11 @@ namespace fc
       vo = var.get_object();
    }
 
+   void from_variant( variant&& var, mutable_variant_object& vo, uint32_t max_depth )
+   {
+      if( !var.is_object() )
+         return from_variant( static_cast<const variant&>( var ), vo, max_depth );
+      vo = mutable_variant_object( std::move( var.get_object() ) );
+   }
+
 } // namesapce fc
@@ -0,0 +1,146 @@
+/*
+ * Counts the heap allocations and measures the time it takes to parse a
+ * typical API payload, with and without a variant_arena, to copy the values
+ * of the resulting variant, to write it back out as JSON and to look up every
+ * key of a large object. Also compares writing and reading a reflected struct
+ * through a variant with doing so directly.
+ *
+ * usage: json_benchmark [documents]
+ */
+#include <fc/io/json.hpp>
+#include <fc/reflect/variant.hpp>
+#include <fc/time.hpp>
+#include <fc/variant.hpp>
+#include <fc/variant_arena.hpp>
+#include <fc/variant_object.hpp>
+
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <string>
+
+namespace {
+   std::atomic<uint64_t> allocations( 0 );
+}
+
+void* operator new( size_t size )
+{
+   ++allocations;
+   if( void* p = std::malloc( size ? size : 1 ) )
+      return p;
+   throw std::bad_alloc();
+}
+
+void operator delete( void* p ) noexcept
+{
+   std::free( p );
+}
+
+void operator delete( void* p, size_t ) noexcept
+{
+   std::free( p );
+}
+
+namespace {
+
+   struct limit_order
+   {
+      std::string id;
+      std::string name;
+      std::string symbol;
+      std::string type;
+      uint64_t    amount = 0;
+      std::string expiration;
+      bool        active = false;
+      std::string memo;
+   };
+
+   struct call_result
+   {
+      uint32_t                 id = 0;
+      std::string              jsonrpc;
+      std::vector<limit_order> result;
+   };
+
+}
+
+FC_REFLECT( limit_order, (id)(name)(symbol)(type)(amount)(expiration)(active)(memo) )
+FC_REFLECT( call_result, (id)(jsonrpc)(result) )
+
+namespace {
+
+   std::string make_document()
+   {
+      std::string doc = "{\"id\":1234,\"jsonrpc\":\"2.0\",\"method\":\"call\",\"result\":[";
+      for( int i = 0; i < 20; ++i )
+      {
+         if( i )
+            doc += ",";
+         doc += "{\"id\":\"1.2." + std::to_string( 1000 + i ) + "\",\"name\":\"account" + std::to_string( i )
+                + "\",\"symbol\":\"BTS\",\"type\":\"limit_order\",\"amount\":\"" + std::to_string( 123456789ull * i )
+                + "\",\"expiration\":\"2026-10-16T12:00:00\",\"active\":true,"
+                  "\"memo\":\"a memo that is too long for the small string buffer of std::string\"}";
+      }
+      return doc + "]}";
+   }
+
+   template<typename F>
+   void measure( const char* what, size_t documents, F&& f )
+   {
+      const uint64_t before = allocations.load();
+      const fc::time_point start = fc::time_point::now();
+      for( size_t i = 0; i < documents; ++i )
+         f();
+      const double elapsed_us = double( ( fc::time_point::now() - start ).count() );
+      std::cout << what << ": " << double( allocations.load() - before ) / documents << " allocations, "
+                << elapsed_us / documents << " us per document\n";
+   }
+
+}
+
+int main( int argc, char** argv )
+{
+   const size_t documents = argc > 1 ? std::strtoul( argv[1], nullptr, 10 ) : 2000;
+   const std::string doc = make_document();
+   const fc::variant parsed = fc::json::from_string( doc );
+
+   measure( "parse", documents, [&doc] () { fc::json::from_string( doc ); } );
+   measure( "parse in a variant_arena", documents, [&doc] () {
+      fc::variant_arena arena;
+      fc::json::from_string( doc );
+   } );
+   measure( "copy ", documents, [&parsed] () {
+      // copying the document itself would only share its objects
+      for( const fc::variant& entry : parsed["result"].get_array() )
+         for( const auto& field : entry.get_object() )
+            fc::variant copy( field.value() );
+   } );
+   measure( "write", documents, [&parsed] () { fc::json::to_string( parsed ); } );
+
+   const call_result reflected = parsed.as<call_result>( 10 );
+   measure( "write a reflected struct through a variant", documents, [&reflected] () {
+      fc::json::to_string( fc::variant( reflected, 10 ) );
+   } );
+   std::string buffer;
+   measure( "write a reflected struct directly", documents, [&reflected,&buffer] () {
+      buffer.clear();
+      fc::json_writer( buffer ).write( reflected );
+   } );
+   measure( "read a reflected struct through a variant", documents, [&doc] () {
+      fc::json::from_string( doc, fc::json::legacy_parser, 10 ).as<call_result>( 10 );
+   } );
+   measure( "read a reflected struct directly", documents, [&doc] () {
+      fc::json::from_string<call_result>( doc, fc::json::legacy_parser, 10 );
+   } );
+
+   fc::mutable_variant_object large;
+   for( int i = 0; i < 200; ++i )
+      large( "field" + std::to_string( i ), i );
+   const fc::variant_object large_object( std::move( large ) );
+   measure( "look up 200 keys", documents, [&large_object] () {
+      for( int i = 0; i < 200; ++i )
+         large_object.find( "field" + std::to_string( i ) );
+   } );
+   return 0;
+}
@@ -9,9 +9,63 @@
 #include <fc/io/iostream.hpp>
 #include <fc/io/json.hpp>
 #include <fc/io/sstream.hpp>
+#include <fc/reflect/variant.hpp>
+#include <fc/static_variant.hpp>
 
 #include <fstream>
 
+namespace fc { namespace test {
+
+   enum class side { buy, sell };
+
+   struct custom_amount
+   {
+      int64_t value = 0;
+   };
+
+   struct order_base
+   {
+      uint64_t    id = 0;
+      std::string owner;
+   };
+
+   struct order : order_base
+   {
+      side                           direction = side::buy;
+      int64_t                        amount = 0;
+      double                         price = 0;
+      bool                           active = false;
+      fc::optional<std::string>      memo;
+      std::vector<char>              data;
+      std::vector<fc::optional<int>> fills;
+      custom_amount                  fee;
+      fc::static_variant<int32_t, std::string> tag;
+      fc::time_point_sec             expiration;
+   };
+
+   struct order_book
+   {
+      std::vector<order> orders;
+      fc::variant        extra;
+   };
+
+   void to_variant( const custom_amount& a, fc::variant& v, uint32_t max_depth ) { v = std::to_string( a.value ) + " BTS"; }
+   void from_variant( const fc::variant& v, custom_amount& a, uint32_t max_depth ) {}
+
+} } // fc::test
+
+FC_REFLECT_ENUM( fc::test::side, (buy)(sell) )
+FC_REFLECT( fc::test::custom_amount, (value) )
+FC_REFLECT( fc::test::order_base, (id)(owner) )
+FC_REFLECT_DERIVED( fc::test::order, (fc::test::order_base),
+                    (direction)(amount)(price)(active)(memo)(data)(fills)(fee)(tag)(expiration) )
+FC_REFLECT( fc::test::order_book, (orders)(extra) )
+
+static_assert( fc::detail::uses_reflected_to_variant<fc::test::order>::value
+               && fc::detail::uses_reflected_from_variant<fc::test::order>::value, "converted member by member" );
+static_assert( !fc::detail::uses_reflected_to_variant<fc::test::custom_amount>::value
+               && !fc::detail::uses_reflected_from_variant<fc::test::custom_amount>::value, "its own conversion wins" );
+
 BOOST_AUTO_TEST_SUITE(json_tests)
 
 static void replace_some( std::string& str )
@@ -332,6 +386,126 @@ BOOST_AUTO_TEST_CASE(recursion_test)
    BOOST_CHECK_THROW( fc::json::to_string( nested, fc::json::stringify_large_ints_and_doubles, 9 ), fc::assert_exception );
 }
 
+BOOST_AUTO_TEST_CASE(reflected_writer_test)
+{
+   fc::test::order_book book;
+   book.extra = fc::mutable_variant_object( "note", "tab\there" );
+   for( int i = 0; i < 3; ++i )
+   {
+      fc::test::order o;
+      o.id = 0x100000000ull * i;
+      o.owner = "account\"" + std::to_string( i ) + "\" with a name longer than the small string buffer";
+      o.direction = i % 2 ? fc::test::side::sell : fc::test::side::buy;
+      o.amount = -3000000000ll * i;
+      o.price = 1.25 * i;
+      o.active = i == 1;
+      if( i )
+         o.memo = std::string( "\x01memo" );
+      o.data = { 'a', char( i ) };
+      o.fills = { fc::optional<int>(), i };
+      o.fee.value = i;
+      if( i == 2 )
+         o.tag = std::string( "tagged" );
+      o.expiration = fc::time_point_sec( 1700000000 + i );
+      book.orders.push_back( o );
+   }
+
+   for( auto format : { fc::json::stringify_large_ints_and_doubles, fc::json::legacy_generator } )
+   {
+      // the same bytes as through a variant, also where the depth runs out
+      for( uint32_t depth : { 200u, 1u, 2u, 3u, 4u } )
+      {
+         std::string expected;
+         try {
+            expected = fc::json::to_string( fc::variant( book, depth ), format, depth );
+         } catch( const fc::assert_exception& ) {
+            BOOST_CHECK_THROW( fc::json::to_string( book, format, depth ), fc::assert_exception );
+            continue;
+         }
+         BOOST_CHECK_EQUAL( expected, fc::json::to_string( book, format, depth ) );
+      }
+   }
+   BOOST_CHECK_EQUAL( "\"sell\"", fc::json::to_string( fc::test::side::sell ) );
+   BOOST_CHECK_EQUAL( "\"7 BTS\"", fc::json::to_string( fc::test::custom_amount{ 7 } ) );
+
+   // one buffer for many values
+   std::string buffer;
+   fc::json_writer writer( buffer );
+   writer.write( book.orders[0] );
+   buffer += '\n';
+   writer.write( book.orders[1] ).write( fc::variant( 1 ) );
+   BOOST_CHECK_EQUAL( fc::json::to_string( book.orders[0] ) + "\n" + fc::json::to_string( book.orders[1] ) + "1", buffer );
+}
+
+BOOST_AUTO_TEST_CASE(reflected_reader_test)
+{
+   fc::test::order_book book;
+   for( int i = 0; i < 2; ++i )
+   {
+      fc::test::order o;
+      o.id = 0x100000000ull * i;
+      o.owner = "account\"" + std::to_string( i ) + "\" with a name longer than the small string buffer";
+      o.direction = fc::test::side::sell;
+      o.amount = -3000000000ll * i;
+      o.memo = std::string( "\tmemo" );
+      o.data = { 'a', char( i ) };
+      o.fills = { fc::optional<int>(), i };
+      o.tag = std::string( "tagged" );
+      o.expiration = fc::time_point_sec( 1700000000 + i );
+      book.orders.push_back( o );
+   }
+
+   const std::vector<std::string> inputs = {
+      fc::json::to_string( book ),
+      fc::json::to_pretty_string( book ),
+      "{\"orders\":[{\"id\":\"7\",\"owner\":\"a\\tb\\\"c\\u0041\\\\\",\"direction\":1,\"amount\":-12,\"price\":\"1.5\","
+         "\"memo\":null,\"fills\":[1 null,\"3\",],\"tag\":[1,\"x\",\"ignored\"],\"expiration\":\"2026-10-16T12:00:00\"}],"
+         "\"unknown\":{\"a\":[1,{}]},\"extra\":[true,nul]}",
+      " { \"orders\" : [ { \"owner\" : \"first\" , , \"owner\" : \"second\" , \"id\":12 } ] } trailing",
+      "{\"orders\":[{\"tag\":[0]},{\"tag\":[]},{\"memo\":nothing}]}",
+      "{\"orders\":[{\"id\":123456789012345678901234}]}",
+      "{\"orders\":[{\"tag\":[5,1]}]}",
+      "{\"orders\":[{\"amount\":12abc}]}",
+      "{\"orders\":[{\"owner\":\"unterminated}]}",
+      "{\"orders\":[{\"id\" 1}]}",
+      "{\"orders\":[{\"expiration\":\"tomorrow\"}]}",
+      "{\"orders\":{}}",
+      "[]",
+      ""
+   };
+   auto as_string = []( const fc::test::order_book& b ) { return fc::json::to_string( fc::variant( b, 10 ) ); };
+   for( const std::string& in : inputs )
+      for( auto ptype : { fc::json::legacy_parser, fc::json::broken_nul_parser } )
+         // the same values and errors as through a variant, also where the depth runs out
+         for( uint32_t depth : { 200u, 1u, 2u, 3u, 4u, 5u } )
+         {
+            std::string expected;
+            try {
+               expected = as_string( fc::json::from_string( in, ptype, depth ).as<fc::test::order_book>( depth ) );
+            } catch( const fc::exception& e ) {
+               // the reader throws the same exception where the parser does, without a second parse
+               try {
+                  fc::json::from_string<fc::test::order_book>( in, ptype, depth );
+                  BOOST_FAIL( "no error reading " + in );
+               } catch( const fc::exception& f ) {
+                  BOOST_CHECK_EQUAL( e.code(), f.code() );
+                  if( e.code() == fc::parse_error_exception::code_value )
+                     BOOST_CHECK_EQUAL( e.get_log().front().get_format(), f.get_log().front().get_format() );
+               }
+               continue;
+            }
+            BOOST_CHECK_EQUAL( expected, as_string( fc::json::from_string<fc::test::order_book>( in, ptype, depth ) ) );
+            // without falling back to the variant path
+            fc::test::order_book direct;
+            fc::json_reader( in, ptype, depth ).read( direct );
+            BOOST_CHECK_EQUAL( expected, as_string( direct ) );
+         }
+
+   BOOST_CHECK( fc::test::side::sell == fc::json::from_string<fc::test::side>( "\"sell\"" ) );
+   BOOST_CHECK_EQUAL( 42u, fc::json::from_string<uint64_t>( "42" ) );
+   BOOST_CHECK_EQUAL( "x", fc::json::from_string<std::string>( "\"x\"" ) );
+}
+
 BOOST_AUTO_TEST_CASE(rethrow_test)
 {
    fc::variants biggie;
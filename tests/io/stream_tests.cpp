@@ -5,8 +5,14 @@
 #include <fc/io/buffered_iostream.hpp>
 #include <fc/io/fstream.hpp>
 #include <fc/io/sstream.hpp>
+#include <fc/thread/thread.hpp>
 
 #include <fstream>
+#include <thread>
+
+#ifndef _WIN32
+# include <sys/stat.h>
+#endif
 
 BOOST_AUTO_TEST_SUITE(stream_tests)
 
@@ -175,4 +181,97 @@ BOOST_AUTO_TEST_CASE(buffered_fstream_test)
    }
 }
 
+BOOST_AUTO_TEST_CASE(fstream_backends)
+{
+   std::string data( 1024 * 1024 + 17, 0 );
+   for( size_t i = 0; i < data.size(); ++i )
+      data[i] = char( i * 7 + i / 251 );
+
+   for( fc::file_io_backend backend : { fc::file_io_backend::blocking, fc::file_io_backend::thread_pool,
+                                        fc::file_io_backend::io_uring } )
+   {
+      const fc::file_io_backend used = fc::set_file_io_backend( backend );
+      BOOST_CHECK( used == backend
+                   || ( backend == fc::file_io_backend::io_uring && used == fc::file_io_backend::thread_pool ) );
+      BOOST_CHECK( used == fc::get_file_io_backend() );
+
+      fc::temp_file f( fc::temp_directory_path(), true );
+      {
+         fc::ofstream out( f.path() );
+         for( size_t i = 0; i < data.size(); i += 1000 )
+            out.writesome( data.data() + i, std::min<size_t>( 1000, data.size() - i ) );
+         out.writesome( data.data(), 100 * 1024 ); // bypasses the buffer
+         out.close();
+      }
+      const std::string expected = data + data.substr( 0, 100 * 1024 );
+
+      std::string contents;
+      fc::read_file_contents( f.path(), contents );
+      BOOST_CHECK( contents == expected );
+
+      fc::ifstream in( f.path() );
+      std::string chunked( expected.size(), 0 );
+      in.read( &chunked[0], 10 );
+      in.read( &chunked[10], chunked.size() - 10 );
+      BOOST_CHECK( chunked == expected );
+      char c;
+      BOOST_CHECK_THROW( in.readsome( &c, 1 ), fc::eof_exception );
+      BOOST_CHECK( in.eof() );
+      in.seekg( 70000 );
+      BOOST_CHECK( !in.eof() );
+      in.get( c );
+      BOOST_CHECK_EQUAL( expected[70000], c );
+
+      // as with std::fstream, a file that cannot be opened reads as empty and drops writes
+      const fc::path missing = f.path() / "file";
+      fc::ifstream none( missing );
+      BOOST_CHECK( none.eof() );
+      BOOST_CHECK_THROW( none.readsome( &c, 1 ), fc::eof_exception );
+      contents = "stale";
+      fc::read_file_contents( missing, contents );
+      BOOST_CHECK( contents.empty() );
+      fc::ofstream nowhere( missing );
+      BOOST_CHECK_EQUAL( 4u, nowhere.writesome( "lost", 4 ) );
+      nowhere.flush();
+      nowhere.close();
+      BOOST_CHECK( !fc::exists( missing ) );
+
+      // the size of a file is only a hint, and a directory reads as empty
+      contents = "stale";
+      fc::read_file_contents( fc::temp_directory_path(), contents );
+      BOOST_CHECK( contents.empty() );
+#ifdef __linux__
+      fc::read_file_contents( "/proc/self/status", contents );
+      BOOST_CHECK( contents.find( "Name:" ) != std::string::npos );
+#endif
+#ifndef _WIN32
+      fc::temp_file fifo( fc::temp_directory_path() );
+      BOOST_REQUIRE_EQUAL( 0, mkfifo( fifo.path().string().c_str(), 0600 ) );
+      std::thread feeder( [&fifo,&data] () {
+         std::ofstream( fifo.path().string(), std::ios::binary ) << data;
+      } );
+      fc::read_file_contents( fifo.path(), contents );
+      feeder.join();
+      BOOST_CHECK( contents == data );
+#endif
+   }
+
+   // a stream opened as blocking keeps the writing fiber running, whatever the default backend is
+   fc::set_file_io_backend( fc::file_io_backend::thread_pool );
+   fc::temp_file f( fc::temp_directory_path(), true );
+   fc::thread writer( "writer" );
+   writer.async( [&f,&data] () {
+      bool ran = false;
+      fc::future<void> other = fc::async( [&ran] () { ran = true; }, "other fiber" );
+      fc::ofstream out;
+      out.open( f.path(), std::ios_base::out | std::ios_base::binary, fc::file_io_backend::blocking );
+      out.writesome( data.data(), data.size() );
+      out.close();
+      BOOST_CHECK( !ran );
+      other.wait();
+   } ).wait();
+   writer.quit();
+   fc::set_file_io_backend( fc::file_io_backend::blocking );
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,100 @@
+/*
+ * Measures the round trip of two fibers of one thread that wake each other
+ * through promises, with and without direct handoff, and with single_thread
+ * promises.
+ *
+ * usage: handoff_benchmark [round_trips]
+ */
+#include <fc/thread/thread.hpp>
+#include <fc/exception/exception.hpp>
+#include <fc/variant_object.hpp>
+
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+namespace {
+
+   struct result
+   {
+      double   round_trip_ns;
+      uint64_t context_switches;
+      uint64_t handoffs;
+   };
+
+   uint64_t counter( const fc::variant& stats, const char* name )
+   {
+      return stats.get_object()[name].as_uint64();
+   }
+
+   result run( fc::wake_policy policy, bool single_thread, size_t round_trips )
+   {
+      fc::thread thread( "handoff_benchmark" );
+      thread.set_wake_policy( policy );
+      const fc::variant before = thread.get_stats();
+
+      const double elapsed_us = thread.async( [single_thread,round_trips] () {
+         std::vector<fc::promise<void>::ptr> pings, pongs;
+         pings.reserve( round_trips );
+         pongs.reserve( round_trips );
+         for( size_t i = 0; i < round_trips; ++i )
+         {
+            if( single_thread )
+            {
+               pings.emplace_back( new fc::promise<void>( fc::single_thread, "ping" ) );
+               pongs.emplace_back( new fc::promise<void>( fc::single_thread, "pong" ) );
+            }
+            else
+            {
+               pings.emplace_back( new fc::promise<void>( "ping" ) );
+               pongs.emplace_back( new fc::promise<void>( "pong" ) );
+            }
+         }
+
+         fc::future<void> responder = fc::async( [&] () {
+            for( size_t i = 0; i < round_trips; ++i )
+            {
+               fc::future<void>( pings[i] ).wait();
+               pongs[i]->set_value();
+            }
+         }, "responder" );
+         fc::yield(); // the responder waits for the first ping
+
+         const fc::time_point start = fc::time_point::now();
+         for( size_t i = 0; i < round_trips; ++i )
+         {
+            pings[i]->set_value();
+            fc::future<void>( pongs[i] ).wait();
+         }
+         const double us = double( (fc::time_point::now() - start).count() );
+         responder.wait();
+         return us;
+      }, "initiator" ).wait();
+
+      const fc::variant after = thread.get_stats();
+      thread.quit();
+
+      result r;
+      r.round_trip_ns    = elapsed_us * 1000 / round_trips;
+      r.context_switches = counter( after, "context_switches" ) - counter( before, "context_switches" );
+      r.handoffs         = counter( after, "handoffs" ) - counter( before, "handoffs" );
+      return r;
+   }
+
+   void print( const char* name, const result& r, size_t round_trips )
+   {
+      std::cout << name << ": " << r.round_trip_ns << " ns/round trip, "
+                << double( r.context_switches ) / round_trips << " switches/round trip, "
+                << r.handoffs << " handoffs\n";
+   }
+}
+
+int main( int argc, char** argv )
+{
+   const size_t round_trips = argc > 1 ? std::strtoul( argv[1], nullptr, 10 ) : 200000;
+   print( "ready queue   ", run( fc::wake_policy::queue, false, round_trips ), round_trips );
+   print( "direct handoff", run( fc::wake_policy::direct_handoff, false, round_trips ), round_trips );
+   print( "single thread ", run( fc::wake_policy::queue, true, round_trips ), round_trips );
+   print( "single thread, direct handoff", run( fc::wake_policy::direct_handoff, true, round_trips ), round_trips );
+   return 0;
+}
@@ -30,10 +30,17 @@
 #include <fc/crypto/sha224.hpp>
 #include <fc/crypto/sha256.hpp>
 #include <fc/crypto/sha512.hpp>
+#include <fc/thread/affinity.hpp>
 #include <fc/thread/parallel.hpp>
 #include <fc/time.hpp>
 
 #include <iostream>
+#include <numeric>
+
+#ifdef __linux__
+# include <pthread.h>
+# include <sched.h>
+#endif
 
 struct thread_config {
   thread_config() {
@@ -96,6 +103,142 @@ BOOST_AUTO_TEST_CASE( do_something_parallel )
    }
 }
 
+BOOST_AUTO_TEST_CASE( nested_parallel )
+{
+   // more tasks than the old fixed-size queue could hold, posted from inside the pool
+   auto outer = fc::do_parallel( [] () {
+      std::vector<fc::future<uint32_t>> inner;
+      inner.reserve( 1000 );
+      for( uint32_t i = 0; i < inner.capacity(); i++ )
+         inner.push_back( fc::do_parallel( [i] () { return i; } ) );
+      uint64_t sum = 0;
+      for( auto& f : inner )
+         sum += f.wait();
+      return sum;
+   });
+   BOOST_CHECK_EQUAL( 999u * 1000u / 2, outer.wait() );
+
+   std::vector<fc::future<void>> results;
+   results.reserve( 5000 );
+   boost::atomic<uint32_t> counter(0);
+   for( size_t i = 0; i < results.capacity(); i++ )
+      results.push_back( fc::do_parallel( [&counter] () { counter.fetch_add(1); } ) );
+   for( auto& result : results )
+      result.wait();
+   BOOST_CHECK_EQUAL( 5000u, counter.load() );
+}
+
+BOOST_AUTO_TEST_CASE( named_worker_pools )
+{
+   int cpu = 0;
+#ifdef __linux__
+   // one of the CPUs this process may run on, and one it may not
+   cpu_set_t allowed;
+   BOOST_REQUIRE_EQUAL( 0, sched_getaffinity( 0, sizeof(allowed), &allowed ) );
+   int forbidden = -1;
+   for( int i = 0; i < CPU_SETSIZE; i++ )
+      if( CPU_ISSET( i, &allowed ) )
+         cpu = i;
+      else if( forbidden < 0 )
+         forbidden = i;
+   if( forbidden >= 0 )
+   {
+      fc::worker_pool_options bad;
+      bad.threads = 2;
+      bad.cpus.push_back( forbidden );
+      BOOST_CHECK_THROW( fc::configure_worker_pool( "pinned", bad ), fc::exception );
+   }
+#endif
+
+   fc::worker_pool_options options;
+   options.threads = 2;
+   options.cpus.push_back( cpu );
+   fc::configure_worker_pool( "pinned", options );
+   BOOST_CHECK_THROW( fc::configure_worker_pool( "pinned", options ), fc::assert_exception );
+   BOOST_CHECK_THROW( fc::get_worker_pool( "no such pool" ), fc::key_not_found_exception );
+
+   fc::detail::worker_pool& pinned = fc::get_worker_pool( "pinned" );
+   BOOST_CHECK_EQUAL( 2u, pinned.size() );
+   BOOST_CHECK_EQUAL( "pinned", pinned.name() );
+
+   std::vector<fc::future<std::string>> names;
+   for( int i = 0; i < 20; i++ )
+      names.push_back( fc::do_parallel( [cpu] () {
+#ifdef __linux__
+         cpu_set_t set;
+         pthread_getaffinity_np( pthread_self(), sizeof(set), &set );
+         FC_ASSERT( CPU_COUNT( &set ) == 1 && CPU_ISSET( cpu, &set ), "worker is not pinned" );
+#endif
+         return fc::thread::current().name();
+      }, "pinned task", pinned ) );
+   for( auto& name : names )
+      BOOST_CHECK_EQUAL( "pinned worker ", name.wait().substr( 0, 14 ) );
+
+   // the default pool is not affected
+   BOOST_CHECK_EQUAL( "pool worker ", fc::do_parallel( [] () { return fc::thread::current().name(); } ).wait().substr( 0, 12 ) );
+}
+
+BOOST_AUTO_TEST_CASE( parallel_algorithms )
+{
+   std::vector<uint64_t> values( 50000 );
+   fc::parallel_for( 0, values.size(), [&values] ( size_t i ) { values[i] = i * i; } ).wait();
+   for( size_t i = 0; i < values.size(); i++ )
+      BOOST_REQUIRE_EQUAL( i * i, values[i] );
+
+   std::vector<std::string> strings( values.size() );
+   fc::parallel_transform( values.begin(), values.end(), strings.begin(),
+                           [] ( uint64_t v ) { return fc::to_string( v ); } ).wait();
+   for( size_t i = 0; i < values.size(); i++ )
+      BOOST_REQUIRE_EQUAL( fc::to_string( values[i] ), strings[i] );
+
+   uint64_t sum = fc::parallel_reduce( values.begin(), values.end(), uint64_t(7),
+                                       [] ( uint64_t a, uint64_t b ) { return a + b; } ).wait();
+   BOOST_CHECK_EQUAL( std::accumulate( values.begin(), values.end(), uint64_t(7) ), sum );
+
+   // non-commutative, so the partial results must be combined in order
+   std::string joined = fc::parallel_reduce( strings.begin(), strings.begin() + 1000, std::string(">"),
+                                             [] ( std::string a, const std::string& b ) { return a + b; },
+                                             "join", 7 ).wait();
+   BOOST_CHECK_EQUAL( std::accumulate( strings.begin(), strings.begin() + 1000, std::string(">") ), joined );
+
+   std::reverse( values.begin(), values.end() );
+   fc::parallel_sort( values.begin(), values.end() ).wait();
+   BOOST_CHECK( std::is_sorted( values.begin(), values.end() ) );
+   BOOST_CHECK_EQUAL( 0u, values.front() );
+
+   fc::parallel_sort( strings.begin(), strings.end(), std::greater<std::string>(), "sort", 333 ).wait();
+   BOOST_CHECK( std::is_sorted( strings.begin(), strings.end(), std::greater<std::string>() ) );
+
+   std::vector<int> empty;
+   fc::parallel_for( 0, 0, [] ( size_t ) { BOOST_FAIL( "called for empty range" ); } ).wait();
+   fc::parallel_sort( empty.begin(), empty.end() ).wait();
+   BOOST_CHECK_EQUAL( 3, fc::parallel_reduce( empty.begin(), empty.end(), 3, std::plus<int>() ).wait() );
+
+   auto failed = fc::parallel_for( 0, 1000, [] ( size_t i ) { FC_ASSERT( i != 500, "boom" ); } );
+   BOOST_CHECK_THROW( failed.wait(), fc::assert_exception );
+}
+
+BOOST_AUTO_TEST_CASE( parallel_algorithms_with_named_functors )
+{
+   std::vector<uint64_t> values( 1000 );
+   const auto square = [&values] ( size_t i ) { values[i] = i * i; };
+   fc::parallel_for( 0, values.size(), square ).wait();
+   BOOST_CHECK_EQUAL( 999u * 999u, values.back() );
+
+   std::vector<uint64_t> doubled( values.size() );
+   auto twice = [] ( uint64_t v ) { return 2 * v; };
+   fc::parallel_transform( values.begin(), values.end(), doubled.begin(), twice ).wait();
+   BOOST_CHECK_EQUAL( 2 * values.back(), doubled.back() );
+
+   const std::plus<uint64_t> add;
+   BOOST_CHECK_EQUAL( std::accumulate( values.begin(), values.end(), uint64_t(0) ),
+                      fc::parallel_reduce( values.begin(), values.end(), uint64_t(0), add ).wait() );
+
+   auto descending = [] ( uint64_t a, uint64_t b ) { return a > b; };
+   fc::parallel_sort( values.begin(), values.end(), descending, "sort", 100 ).wait();
+   BOOST_CHECK( std::is_sorted( values.begin(), values.end(), descending ) );
+}
+
 const std::string TEXT = "1234567890abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ!\"$%&/()=?,.-#+´{[]}`*'_:;<>|";
 
 template<typename Hash>
@@ -337,6 +480,107 @@ BOOST_AUTO_TEST_CASE( serial_valve )
       BOOST_CHECK( p3.ready() );
       BOOST_CHECK_EQUAL( 3u, counter.load() );
    }
+
+   { // Throughput, compared with an ordered_pipeline doing the same work
+      const uint32_t items = 20000;
+      std::vector<fc::future<void>> results;
+      results.reserve( items );
+      std::vector<fc::sha256> hashes( items );
+      uint32_t next = 0;
+
+      fc::time_point start = fc::time_point::now();
+      for( uint32_t i = 0; i < items; ++i )
+         results.push_back( fc::do_parallel( [&valve,&hashes,&next,i] () {
+            valve.do_serial( [&hashes,i] () { hashes[i] = fc::sha256::hash( (const char*)&i, sizeof(i) ); },
+                             [&next] () { ++next; } ); // in the order in which the workers got here
+         } ) );
+      for( auto& result : results )
+         result.wait();
+      fc::time_point end = fc::time_point::now();
+      ilog( "serial_valve: ${c} items in ${t}µs", ("c",items)("t",end-start) );
+      BOOST_CHECK_EQUAL( items, next );
+
+      results.clear();
+      next = 0;
+      fc::ordered_pipeline pipe( 1, 256 );
+      start = fc::time_point::now();
+      for( uint32_t i = 0; i < items; ++i )
+         results.push_back( fc::do_parallel( [&hashes,&next,i,t=pipe.enter()] () mutable {
+            hashes[i] = fc::sha256::hash( (const char*)&i, sizeof(i) );
+            t.in_order( 0, [&next,i] () { BOOST_CHECK_EQUAL( next++, i ); } );
+            t.leave(); // the task keeps its functor as long as its future
+         } ) );
+      for( auto& result : results )
+         result.wait();
+      end = fc::time_point::now();
+      ilog( "ordered_pipeline: ${c} items in ${t}µs", ("c",items)("t",end-start) );
+      BOOST_CHECK_EQUAL( items, next );
+   }
+}
+
+BOOST_AUTO_TEST_CASE( ordered_pipeline )
+{
+   const uint32_t items = 2000;
+   const uint32_t max_in_flight = 8;
+   fc::ordered_pipeline pipe( 3, max_in_flight );
+   std::vector<uint32_t> stage0, stage1, stage2;
+   boost::atomic<uint32_t> in_flight(0), peak(0), failed(0);
+
+   std::vector<fc::future<void>> results;
+   results.reserve( items );
+   for( uint32_t i = 0; i < items; ++i )
+   {
+      fc::ordered_pipeline::ticket t = pipe.enter();
+      BOOST_CHECK_EQUAL( i, t.sequence() );
+      const uint32_t now = in_flight.fetch_add(1) + 1;
+      uint32_t old = peak.load();
+      while( now > old && !peak.compare_exchange_weak( old, now ) );
+
+      results.push_back( fc::do_parallel( [&,i,t=std::move(t)] () mutable {
+         fc::sha256::hash( (const char*)&i, sizeof(i) ); // parallel
+         try
+         {
+            t.in_order( 0, [&stage0,i] () {
+               stage0.push_back( i );
+               FC_ASSERT( i % 7 != 3, "failing item" ); // failures pass the stage too
+            } );
+         }
+         catch( const fc::assert_exception& )
+         {
+            ++failed;
+         }
+         fc::sha256::hash( (const char*)&i, sizeof(i) ); // parallel
+         if( i % 5 == 0 )
+            t.pass( 1 ); // skips stage 1
+         else
+            t.in_order( 1, [&stage1,i] () { stage1.push_back( i ); } );
+         t.in_order( 2, [&stage2,i] () { stage2.push_back( i ); } );
+         in_flight.fetch_sub(1);
+         t.leave();
+      } ) );
+   }
+   for( auto& result : results )
+      result.wait();
+
+   BOOST_CHECK_EQUAL( items, stage0.size() );
+   BOOST_CHECK_EQUAL( items - items / 5, stage1.size() );
+   BOOST_CHECK_EQUAL( items, stage2.size() );
+   BOOST_CHECK( std::is_sorted( stage0.begin(), stage0.end() ) );
+   BOOST_CHECK( std::is_sorted( stage1.begin(), stage1.end() ) );
+   BOOST_CHECK( std::is_sorted( stage2.begin(), stage2.end() ) );
+   BOOST_CHECK_EQUAL( (items + 3) / 7, failed.load() );
+   BOOST_CHECK( peak.load() <= max_in_flight );
+
+   // an item that leaves early does not hold up the others
+   {
+      fc::ordered_pipeline::ticket first = pipe.enter();
+      fc::ordered_pipeline::ticket second = pipe.enter();
+      { fc::ordered_pipeline::ticket gone( std::move(first) ); }
+      bool ran = false;
+      second.in_order( 2, [&ran] () { ran = true; } );
+      BOOST_CHECK( ran );
+      BOOST_CHECK_THROW( second.in_order( 1, [] () {} ), fc::assert_exception );
+   }
 }
 
 BOOST_AUTO_TEST_SUITE_END()
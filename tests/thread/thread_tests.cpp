@@ -2,6 +2,25 @@
 #include <boost/test/unit_test.hpp>
 
 #include <fc/thread/thread.hpp>
+#include <fc/thread/object_pool.hpp>
+#include <fc/thread/fiber_stack.hpp>
+#include <fc/thread/channel.hpp>
+#include <fc/thread/fiber_trace.hpp>
+#include <fc/thread/fiber_watchdog.hpp>
+#include <fc/thread/semaphore.hpp>
+#include <fc/thread/shared_mutex.hpp>
+#include <fc/thread/when_all.hpp>
+#include <fc/variant_object.hpp>
+
+#include <atomic>
+#include <cstring>
+#include <thread>
+
+#if !defined(NDEBUG) && defined(__unix__)
+# include <csignal>
+# include <sys/wait.h>
+# include <unistd.h>
+#endif
 
 using namespace fc;
 
@@ -56,8 +75,12 @@ BOOST_AUTO_TEST_CASE(yields_execution)
     std::string result;
 
     fc::thread thread("my");
+    // keep the thread busy until both tasks are queued, it could run the first one alone otherwise
+    std::atomic<bool> queued(false);
+    thread.async([&queued]{ while (!queued.load()) std::this_thread::yield(); });
     auto future1 = thread.async([&result]{fc::yield(); result += "world";});
     auto future2 = thread.async([&result]{result += "hello ";});
+    queued.store(true);
 
     future2.wait();
     future1.wait();
@@ -92,4 +115,621 @@ BOOST_AUTO_TEST_CASE(reschedules_yielded_task)
     BOOST_CHECK_EQUAL(10, reschedule_count);
 }
 
+BOOST_AUTO_TEST_CASE(reuses_pooled_promises)
+{
+    auto total = []( const std::vector<object_pool_stats>& stats ) {
+        object_pool_stats sum;
+        for( const auto& s : stats )
+        {
+            sum.allocations += s.allocations;
+            sum.cache_hits += s.cache_hits;
+            sum.frees += s.frees;
+        }
+        return sum;
+    };
+    const object_pool_stats before = total( get_object_pool_stats() );
+
+    fc::thread thread("my");
+    for( int i = 0; i < 1000; ++i )
+        thread.async([]{}).wait();
+    thread.quit();
+
+    // counters are published in batches, so only part of the activity may be visible
+    const object_pool_stats after = total( get_object_pool_stats() );
+    BOOST_CHECK_GT( after.allocations, before.allocations + 500 );
+    BOOST_CHECK_GT( after.cache_hits, before.cache_hits + 500 );
+    BOOST_CHECK_GT( after.frees, before.frees + 500 );
+}
+
+BOOST_AUTO_TEST_CASE(reuses_cached_fiber_stacks)
+{
+    const fiber_stack_config original = get_fiber_stack_config();
+    fiber_stack_config cfg = original;
+    cfg.stack_size = 64 * 1024;
+    cfg.track_high_water_mark = true;
+    set_fiber_stack_config( cfg );
+    fiber_stack_config tiny;
+    tiny.stack_size = 1024;
+    BOOST_CHECK_THROW( set_fiber_stack_config( tiny ), fc::assert_exception );
+
+    for( int i = 0; i < 2; ++i )
+    {
+        fc::thread thread("my");
+        // the first task blocks the thread's own stack, so the second one runs in a fiber
+        promise<void>::ptr filled( new promise<void>() );
+        auto waiter = thread.async([filled]{ future<void>( filled ).wait(); });
+        const size_t used = thread.async([filled]{
+            volatile char buffer[8192];
+            for( size_t i = 0; i < sizeof(buffer); ++i )
+                buffer[i] = 1;
+            filled->set_value();
+            return get_fiber_stack_high_water_mark();
+        }).wait();
+        BOOST_CHECK_GE( used, 8192u );
+        waiter.wait();
+        thread.quit();
+    }
+
+    {
+        // the deep stacks above are cached now, a shallow fiber must not see their use
+        fc::thread thread("my");
+        promise<void>::ptr measured( new promise<void>() );
+        auto waiter = thread.async([measured]{ future<void>( measured ).wait(); });
+        const size_t used = thread.async([measured]{
+            const size_t used = get_fiber_stack_high_water_mark();
+            measured->set_value();
+            return used;
+        }).wait();
+        BOOST_CHECK_GT( used, 0u );
+        BOOST_CHECK_LT( used, 8192u );
+        waiter.wait();
+        thread.quit();
+    }
+
+    const fiber_stack_stats stats = get_fiber_stack_stats();
+    BOOST_CHECK_EQUAL( cfg.stack_size, stats.stack_size );
+    BOOST_CHECK_GT( stats.reuses, 0u );
+    BOOST_CHECK_GE( stats.high_water_mark, 8192u );
+    BOOST_CHECK_LT( stats.high_water_mark, cfg.stack_size );
+
+    set_fiber_stack_config( original );
+}
+
+BOOST_AUTO_TEST_CASE(huge_page_fiber_stacks_with_guard_page)
+{
+    const fiber_stack_config original = get_fiber_stack_config();
+    for( size_t stack_size : { size_t(64 * 1024), size_t(4 * 1024 * 1024) } )
+    {
+        fiber_stack_config cfg = original;
+        cfg.stack_size = stack_size;
+        cfg.guard_page = true;
+        cfg.huge_pages = true;
+        set_fiber_stack_config( cfg );
+
+        fc::thread thread("my");
+        promise<void>::ptr filled( new promise<void>() );
+        auto waiter = thread.async([filled]{ future<void>( filled ).wait(); });
+        thread.async([filled]{
+            volatile char buffer[8192];
+            for( size_t i = 0; i < sizeof(buffer); ++i )
+                buffer[i] = 1;
+            filled->set_value();
+        }).wait();
+        waiter.wait();
+        thread.quit();
+        BOOST_CHECK_EQUAL( stack_size, get_fiber_stack_stats().stack_size );
+    }
+    set_fiber_stack_config( original );
+}
+
+BOOST_AUTO_TEST_CASE(timing_wheel_backend)
+{
+    set_default_timer_backend( timer_backend::timing_wheel );
+    fc::thread thread("wheel");
+    set_default_timer_backend( timer_backend::heap );
+
+    std::string result;
+    const fc::time_point start = fc::time_point::now();
+    auto world = thread.schedule([&result]{ result += "world"; }, start + fc::milliseconds(60));
+    auto hello = thread.schedule([&result]{ result += "hello "; }, start + fc::milliseconds(20));
+    auto never = thread.schedule([&result]{ result += "never"; }, start + fc::milliseconds(40));
+    never.cancel();
+    world.wait();
+    BOOST_CHECK_EQUAL("hello world", result);
+    BOOST_CHECK( fc::time_point::now() >= start + fc::milliseconds(60) );
+    BOOST_CHECK_THROW( never.wait(), fc::canceled_exception );
+
+    // canceling removes the task from the wheel right away
+    auto next_year = thread.schedule([]{}, fc::time_point::now() + fc::days(365));
+    next_year.cancel();
+    BOOST_CHECK_THROW( next_year.wait(fc::seconds(1)), fc::canceled_exception );
+
+    auto timing = thread.async([]{
+        const fc::time_point before_sleep = fc::time_point::now();
+        fc::usleep( fc::milliseconds(30) );
+        const bool slept = fc::time_point::now() >= before_sleep + fc::milliseconds(30);
+        promise<void>::ptr unset( new promise<void>() );
+        try
+        {
+            future<void>( unset ).wait( fc::milliseconds(20) );
+            return false;
+        }
+        catch( const fc::timeout_exception& )
+        {
+            return slept;
+        }
+    });
+    BOOST_CHECK( timing.wait() );
+    thread.quit();
+}
+
+BOOST_AUTO_TEST_CASE(reports_scheduler_stats)
+{
+    fc::thread thread("stats");
+    promise<void>::ptr gate( new promise<void>() );
+    auto waiter = thread.async([gate]{ future<void>( gate ).wait(); }, "waiter");
+    for( int i = 0; i < 3; ++i )
+        thread.async([]{ fc::usleep( fc::milliseconds(15) ); }, "sleeper").wait();
+
+    fc::variant_object stats = thread.get_stats().get_object();
+    BOOST_CHECK_EQUAL( "stats", stats["name"].as_string() );
+    BOOST_CHECK_EQUAL( 1u, stats["blocked_contexts"].as_uint64() );
+    BOOST_CHECK_GE( stats["tasks_run"].as_uint64(), 3u );
+    BOOST_CHECK_GE( stats["context_switches"].as_uint64(), 6u );
+
+    // the sleepers ran longest, so they are listed first
+    fc::variants tasks = stats["tasks"].get_array();
+    BOOST_REQUIRE( !tasks.empty() );
+    fc::variant_object sleeper = tasks[0].get_object();
+    BOOST_CHECK_EQUAL( "sleeper", sleeper["name"].as_string() );
+    BOOST_CHECK_EQUAL( 3u, sleeper["run_time"]["count"].as_uint64() );
+    BOOST_CHECK_GE( sleeper["run_time"]["total_us"].as_uint64(), 45000u );
+    BOOST_CHECK_EQUAL( 3u, sleeper["latency"]["count"].as_uint64() );
+
+    // a description that is not a literal may be reused for another one at the same address
+    char desc[16];
+    strcpy( desc, "first" );
+    thread.async([]{}, desc).wait();
+    strcpy( desc, "second" );
+    thread.async([]{}, desc).wait();
+    std::map<std::string, uint64_t> runs;
+    const fc::variant reused = thread.get_stats();
+    for( const fc::variant& t : reused["tasks"].get_array() )
+        runs[t["name"].as_string()] = t["run_time"]["count"].as_uint64();
+    BOOST_CHECK_EQUAL( 1u, runs["first"] );
+    BOOST_CHECK_EQUAL( 1u, runs["second"] );
+
+    gate->set_value();
+    waiter.wait();
+    stats = thread.get_stats().get_object();
+    BOOST_CHECK_EQUAL( 0u, stats["blocked_contexts"].as_uint64() );
+    BOOST_CHECK_GE( stats["parks"].as_uint64(), 1u );
+    thread.quit();
+}
+
+BOOST_AUTO_TEST_CASE(records_fiber_trace)
+{
+    fc::thread thread("traced");
+    start_fiber_trace( 1024 );
+    promise<void>::ptr gate( new promise<void>( "gate" ) );
+    auto waiter = thread.async([gate]{ future<void>( gate ).wait(); }, "waiter");
+    thread.async([gate]{ gate->set_value(); }, "opener").wait();
+    waiter.wait();
+    thread.async([]{}, "flush").wait(); // the waiter's task_end is recorded after its result is set
+    stop_fiber_trace();
+
+    // the main thread waits too, so only count the events of the traced thread
+    std::map<std::string, int> counts;
+    int64_t traced_pid = -1;
+    const fc::variant trace = get_fiber_trace();
+    for( const fc::variant& e : trace["traceEvents"].get_array() )
+    {
+        const std::string ph = e["ph"].as_string();
+        const std::string name = e["name"].as_string();
+        if( ph == "M" && name == "process_name" && e["args"]["name"].as_string() == "traced" )
+            traced_pid = e["pid"].as_int64();
+        if( e["pid"].as_int64() != traced_pid )
+            continue;
+        counts[ph + " " + name]++;
+        if( ph == "i" && name == "wait" )
+            BOOST_CHECK_EQUAL( "gate", e["args"]["promise"].as_string() );
+    }
+    BOOST_CHECK_NE( -1, traced_pid );
+    BOOST_CHECK_EQUAL( 1, counts["b waiter"] );
+    BOOST_CHECK_EQUAL( 1, counts["e waiter"] );
+    BOOST_CHECK_EQUAL( 1, counts["b opener"] );
+    BOOST_CHECK_EQUAL( 1, counts["i wait"] );
+    BOOST_CHECK_EQUAL( 1, counts["i wake"] );
+    BOOST_CHECK_GE( counts["B running"], 2 );
+    BOOST_CHECK_EQUAL( counts["B running"], counts["E running"] );
+
+    // nothing is recorded once the trace is stopped
+    thread.async([]{}, "untraced").wait();
+    const fc::variant after_stop = get_fiber_trace();
+    BOOST_CHECK_EQUAL( trace["traceEvents"].size(), after_stop["traceEvents"].size() );
+    thread.quit();
+}
+
+BOOST_AUTO_TEST_CASE(shared_mutex_readers_and_writers)
+{
+    fc::thread first("first"), second("second");
+    shared_mutex m;
+    std::atomic<bool> writer_done( false );
+
+    m.lock_shared();
+    // readers on other threads get in at the same time
+    BOOST_CHECK( first.async([&m]{ shared_lock<shared_mutex> l( m, try_to_lock_t() ); return bool(l); }).wait() );
+
+    auto writer = first.async([&]{
+        unique_lock<shared_mutex> l( m );
+        fc::usleep( fc::milliseconds(20) );
+        writer_done = true;
+    });
+    // a waiting writer keeps new readers out
+    while( m.try_lock_shared() )
+    {
+        m.unlock_shared();
+        fc::usleep( fc::milliseconds(1) );
+    }
+    auto reader = second.async([&]{
+        shared_lock<shared_mutex> l( m );
+        return writer_done.load();
+    });
+    fc::usleep( fc::milliseconds(20) );
+    BOOST_CHECK( !writer.ready() );
+    BOOST_CHECK( !reader.ready() );
+
+    m.unlock_shared();
+    writer.wait();
+    BOOST_CHECK( reader.wait() );
+    BOOST_CHECK_EQUAL( 1u, m.exclusive_stats().acquisitions );
+    BOOST_CHECK_EQUAL( 1u, m.exclusive_stats().contended );
+    BOOST_CHECK_EQUAL( 1u, m.shared_stats().contended );
+    BOOST_CHECK_GE( m.exclusive_stats().total_wait_us, 20000u );
+
+    // readers may overtake a waiting writer if they are preferred
+    shared_mutex readers_first( shared_mutex::prefer_readers );
+    readers_first.lock_shared();
+    auto late_writer = first.async([&readers_first]{ unique_lock<shared_mutex> l( readers_first ); });
+    fc::usleep( fc::milliseconds(20) );
+    BOOST_CHECK( second.async([&readers_first]{
+        shared_lock<shared_mutex> l( readers_first, try_to_lock_t() );
+        return bool(l);
+    }).wait() );
+    BOOST_CHECK( !late_writer.ready() );
+    readers_first.unlock_shared();
+    late_writer.wait();
+    first.quit();
+    second.quit();
+}
+
+BOOST_AUTO_TEST_CASE(semaphore_bounds_work_in_flight)
+{
+    fc::thread first("first"), second("second");
+    semaphore s( 2 );
+    std::atomic<int> in_flight( 0 ), max_in_flight( 0 );
+    auto work = [&]{
+        semaphore_guard g( s );
+        int now = ++in_flight;
+        int seen = max_in_flight.load();
+        while( now > seen && !max_in_flight.compare_exchange_weak( seen, now ) ) {}
+        fc::usleep( fc::milliseconds(20) );
+        --in_flight;
+    };
+    std::vector<fc::future<void>> done;
+    for( int i = 0; i < 8; ++i )
+        done.push_back( (i % 2 ? first : second).async( work ) );
+    for( auto& f : done )
+        f.wait();
+    BOOST_CHECK_EQUAL( 2, max_in_flight.load() );
+    BOOST_CHECK_EQUAL( 2u, s.available() );
+    BOOST_CHECK_EQUAL( 8u, s.get_stats().acquisitions );
+    BOOST_CHECK_GT( s.get_stats().contended, 0u );
+
+    // a queued request for many units is not overtaken by small ones
+    s.acquire( 2 );
+    auto big = first.async([&s]{ s.acquire( 2 ); s.release( 2 ); });
+    while( s.try_acquire( 0 ) ) // fails once the big request is queued
+        fc::usleep( fc::milliseconds(1) );
+    s.release( 1 );
+    BOOST_CHECK( !s.try_acquire( 1 ) );
+    s.release( 1 );
+    big.wait();
+    BOOST_CHECK_EQUAL( 2u, s.available() );
+
+    // a canceled waiter leaves the queue
+    s.acquire( 2 );
+    auto canceled = first.async([&s]{ s.acquire( 1 ); });
+    fc::usleep( fc::milliseconds(20) );
+    canceled.cancel_and_wait();
+    BOOST_CHECK_THROW( canceled.wait(), fc::canceled_exception );
+    s.release( 2 );
+    BOOST_CHECK( s.try_acquire( 2 ) );
+    s.release( 2 );
+
+    // a grant that races with a cancel wakes the waiter only once
+    for( int i = 0; i < 200; ++i )
+    {
+        s.acquire( 2 );
+        auto racing = first.async([&s]{ s.acquire( 1 ); });
+        while( s.try_acquire( 0 ) )
+            fc::usleep( fc::microseconds(100) );
+        auto released = second.async([&s]{ s.release( 2 ); });
+        racing.cancel();
+        released.wait();
+        try
+        {
+            racing.wait();
+            s.release( 1 );
+        }
+        catch( const fc::canceled_exception& ) {} // a granted unit was given back
+        BOOST_CHECK_EQUAL( 2u, s.available() );
+    }
+    first.quit();
+    second.quit();
+}
+
+BOOST_AUTO_TEST_CASE(channel_passes_items_between_threads)
+{
+    fc::thread first("first"), second("second"), consumer("consumer");
+    channel<std::pair<int,int>> ch( 4 );
+    auto produce = [&ch]( int producer ) {
+        for( int i = 0; i < 1000; ++i )
+            ch.send( std::make_pair( producer, i ) );
+    };
+    auto a = first.async([&]{ produce( 0 ); });
+    auto b = second.async([&]{ produce( 1 ); });
+    auto received = consumer.async([&ch]{
+        std::vector<std::pair<int,int>> batch;
+        int next[2] = { 0, 0 };
+        bool in_order = true;
+        while( ch.receive_many( batch, 16 ) )
+        {
+            for( const auto& item : batch )
+                in_order = in_order && item.second == next[item.first]++;
+            batch.clear();
+        }
+        return in_order && next[0] == 1000 && next[1] == 1000;
+    });
+    a.wait();
+    b.wait();
+    ch.close();
+    BOOST_CHECK( received.wait() );
+    first.quit();
+    second.quit();
+    consumer.quit();
+}
+
+BOOST_AUTO_TEST_CASE(channel_close_and_cancel)
+{
+    fc::thread thread("channel");
+    channel<std::unique_ptr<int>> ch( 2 );
+    ch.send( std::unique_ptr<int>( new int(1) ) );
+    ch.send( std::unique_ptr<int>( new int(2) ) );
+    std::unique_ptr<int> extra( new int(3) );
+    BOOST_CHECK( !ch.try_send( extra ) );
+    BOOST_CHECK( extra );
+
+    // a full channel blocks the sender until there is room
+    auto blocked_send = thread.async([&ch]{ ch.send( std::unique_ptr<int>( new int(3) ) ); });
+    fc::usleep( fc::milliseconds(20) );
+    BOOST_CHECK( !blocked_send.ready() );
+    BOOST_CHECK_EQUAL( 1, *ch.receive() );
+    blocked_send.wait();
+
+    ch.close();
+    BOOST_CHECK_THROW( ch.send( std::move(extra) ), fc::invalid_operation_exception );
+    BOOST_CHECK_EQUAL( 2, *ch.receive() );
+    BOOST_CHECK_EQUAL( 3, *ch.receive() );
+    BOOST_CHECK_THROW( ch.receive(), fc::eof_exception );
+
+    // canceling a fiber that waits for items takes it out of the channel
+    channel<int> empty( 1 );
+    auto waiting = thread.async([&empty]{ return empty.receive(); });
+    fc::usleep( fc::milliseconds(20) );
+    waiting.cancel_and_wait();
+    BOOST_CHECK_THROW( waiting.wait(), fc::canceled_exception );
+    empty.send( 7 );
+    BOOST_CHECK_EQUAL( 7, thread.async([&empty]{ return empty.receive(); }).wait() );
+    thread.quit();
+}
+
+BOOST_AUTO_TEST_CASE(when_all_and_when_any)
+{
+    fc::thread first("first"), second("second");
+    std::vector<fc::future<int>> squares;
+    for( int i = 0; i < 100; ++i )
+        squares.push_back( (i % 2 ? first : second).async([i]{ return i * i; }) );
+    const std::vector<int> results = fc::when_all( squares ).wait();
+    BOOST_REQUIRE_EQUAL( 100u, results.size() );
+    for( int i = 0; i < 100; ++i )
+        BOOST_CHECK_EQUAL( i * i, results[i] );
+    BOOST_CHECK( fc::when_all( std::vector<fc::future<int>>() ).ready() );
+
+    // the first failure completes the result without waiting for the others
+    std::vector<fc::future<void>> steps;
+    steps.push_back( first.async([]{ fc::usleep( fc::seconds(10) ); }) );
+    steps.push_back( second.async([]{ FC_THROW_EXCEPTION( fc::invalid_arg_exception, "failed step" ); }) );
+    BOOST_CHECK_THROW( fc::when_all( steps ).wait( fc::seconds(5) ), fc::invalid_arg_exception );
+    steps[0].cancel_and_wait();
+
+    std::vector<fc::future<int>> racers;
+    racers.push_back( first.async([]{ fc::usleep( fc::seconds(10) ); return 0; }) );
+    racers.push_back( second.async([]{ return 1; }) );
+    BOOST_CHECK_EQUAL( 1u, fc::when_any( racers ).wait( fc::seconds(5) ) );
+    racers[0].cancel_and_wait();
+
+    // futures that completed already are picked up too, failed ones count as completed
+    BOOST_CHECK_EQUAL( 0u, fc::when_any( racers ).wait() );
+    BOOST_CHECK_EQUAL( 1, fc::when_all( std::vector<fc::future<int>>( 1, racers[1] ) ).wait()[0] );
+    first.quit();
+    second.quit();
+}
+
+BOOST_AUTO_TEST_CASE(future_then_chains_continuations)
+{
+    fc::thread worker("worker"), executor("executor");
+    auto text = worker.async([]{ return 2; })
+                      .then([]( int v ) { return v * 3; })
+                      .then([]( int v ) { return std::to_string( v ); });
+    BOOST_CHECK_EQUAL( "6", text.wait() );
+
+    // without an executor the continuation runs where the future completes
+    auto ran_on = worker.async([]{ fc::usleep( fc::milliseconds(20) ); })
+                        .then([]{ return &fc::thread::current(); });
+    BOOST_CHECK( &worker == ran_on.wait() );
+    auto posted = worker.async([]{ return 1; })
+                        .then([]( int ) { return &fc::thread::current(); }, &executor );
+    BOOST_CHECK( &executor == posted.wait() );
+
+    // a ready future runs the continuation right away
+    bool called = false;
+    fc::future<int> ready = worker.async([]{ return 5; });
+    ready.wait();
+    auto same = ready.then([&called]( int v ) { called = true; return v; });
+    BOOST_CHECK( called && same.ready() );
+
+    // exceptions skip the continuations and fail the end of the chain
+    bool skipped = true;
+    auto failed = worker.async([]() -> int { FC_THROW_EXCEPTION( fc::invalid_arg_exception, "bad input" ); })
+                        .then([&skipped]( int v ) { skipped = false; return v; }, &executor )
+                        .then([]( int v ) { return v + 1; });
+    BOOST_CHECK_THROW( failed.wait(), fc::invalid_arg_exception );
+    BOOST_CHECK( skipped );
+    auto thrown = worker.async([]{ return 1; })
+                        .then([]( int ) -> int { FC_THROW_EXCEPTION( fc::invalid_arg_exception, "bad step" ); }, &executor );
+    BOOST_CHECK_THROW( thrown.wait(), fc::invalid_arg_exception );
+    worker.quit();
+    executor.quit();
+}
+
+BOOST_AUTO_TEST_CASE(direct_handoff_runs_woken_fiber_first)
+{
+    fc::thread thread("handoff");
+    auto order_of_wakeup = [&thread]() {
+        return thread.async([]{
+            std::string order;
+            fc::promise<void>::ptr p( new fc::promise<void>("handoff") );
+            auto waiter = fc::async([&]{ fc::future<void>( p ).wait(); order += "woken "; }, "waiter");
+            fc::future<void>( p ).then([&order]{ order += "handler "; });
+            fc::usleep( fc::milliseconds(20) ); // until the waiter blocks
+            p->set_value();
+            order += "waker";
+            waiter.wait();
+            return order;
+        }).wait();
+    };
+    BOOST_CHECK( thread.get_wake_policy() == fc::wake_policy::queue );
+    BOOST_CHECK_EQUAL( "handler waker", order_of_wakeup().substr( 0, 13 ) );
+    thread.set_wake_policy( fc::wake_policy::direct_handoff );
+    // the handoff waits for the completion handlers of the promise
+    BOOST_CHECK_EQUAL( "handler woken waker", order_of_wakeup() );
+    const uint64_t handoffs = thread.get_stats().get_object()["handoffs"].as_uint64();
+    BOOST_CHECK( handoffs > 0 );
+
+    // a timeout is set by the scheduler, which never hands off
+    thread.async([]{
+        fc::promise<void>::ptr p( new fc::promise<void>("timeout") );
+        BOOST_CHECK_THROW( fc::future<void>( p ).wait( fc::milliseconds(5) ), fc::timeout_exception );
+    }).wait();
+    BOOST_CHECK_EQUAL( handoffs, thread.get_stats().get_object()["handoffs"].as_uint64() );
+    thread.quit();
+}
+
+BOOST_AUTO_TEST_CASE(watchdog_reports_long_slices)
+{
+    fc::thread thread("watchdog");
+    fc::fiber_watchdog_options options;
+    options.slice_budget = fc::milliseconds(20);
+    options.monitor = true;
+    options.sample_stacks = true;
+    fc::start_fiber_watchdog( options );
+
+    thread.async([]{ fc::usleep( fc::milliseconds(30) ); }, "sleeper").wait(); // yields, so it stays within budget
+    thread.async([]{
+        const fc::time_point end = fc::time_point::now() + fc::milliseconds(100);
+        while( fc::time_point::now() < end ) {}
+    }, "hog").wait();
+    thread.async([]{}, "flush").wait(); // the slice of hog ends when the next one starts
+    fc::stop_fiber_watchdog();
+
+    const fc::variant slices = fc::get_long_slices();
+    bool finished = false, running = false;
+    for( const fc::variant& slice : slices.get_array() )
+    {
+        const fc::variant_object& s = slice.get_object();
+        if( s["thread"].as_string() != "watchdog" ) // other threads of the test run may be slow too
+            continue;
+        BOOST_CHECK_EQUAL( "hog", s["task"].as_string() );
+        if( s["running"].as_bool() )
+        {
+            running = true;
+#if defined(__linux__) && BOOST_VERSION / 100 >= 1065
+            BOOST_CHECK( !s["stack"].get_array().empty() );
+#endif
+        }
+        else
+        {
+            finished = true;
+            BOOST_CHECK( s["duration_us"].as_int64() >= 100000 );
+        }
+    }
+    BOOST_CHECK( finished );
+    BOOST_CHECK( running );
+    const fc::variant stats = thread.get_stats();
+    BOOST_CHECK_EQUAL( 1u, stats.get_object()["long_slices"].as_uint64() );
+    BOOST_CHECK( stats.get_object()["max_long_slice_us"].as_uint64() >= 100000 );
+    thread.quit();
+}
+
+BOOST_AUTO_TEST_CASE(single_thread_promise)
+{
+    fc::thread thread("single_thread");
+    thread.async([]{
+        fc::promise<int>::ptr p( new fc::promise<int>( fc::single_thread, "local" ) );
+        std::vector<int> seen;
+        p->on_complete( [&seen]( const int& v, const fc::exception_ptr& e ) { seen.push_back( v ); } );
+        fc::future<int> waiter = fc::async( [p]{ return fc::future<int>( p ).wait() + 1; }, "waiter" );
+        fc::usleep( fc::milliseconds(20) ); // let the waiter block
+        BOOST_CHECK( !waiter.ready() );
+        p->set_value( 41 );
+        BOOST_CHECK_EQUAL( 42, waiter.wait() );
+        BOOST_REQUIRE_EQUAL( 1u, seen.size() );
+        BOOST_CHECK_EQUAL( 41, seen[0] );
+
+        fc::promise<void>::ptr failing( new fc::promise<void>( fc::single_thread, "failing" ) );
+        fc::future<void> f( failing );
+        fc::async( [failing]{ failing->set_exception( std::make_shared<fc::assert_exception>() ); }, "fail" );
+        BOOST_CHECK_THROW( f.wait(), fc::assert_exception );
+        BOOST_CHECK( failing->error() );
+    }, "single_thread_promise").wait();
+    thread.quit();
+}
+
+#if !defined(NDEBUG) && defined(__unix__)
+BOOST_AUTO_TEST_CASE(single_thread_refcount_asserts_owner)
+{
+    fc::thread thread("owner");
+    fc::promise<void>* p = thread.async([]{
+        return new fc::promise<void>( fc::single_thread, "owned" );
+    }).wait();
+
+    // retaining it on another thread must hit the assertion, so try it in a child process
+    const pid_t child = fork();
+    BOOST_REQUIRE( child >= 0 );
+    if( child == 0 )
+    {
+        std::signal( SIGABRT, SIG_DFL ); // not reported by the test framework of the child
+        p->retain();
+        _exit( 0 );
+    }
+    int status = 0;
+    BOOST_REQUIRE_EQUAL( child, waitpid( child, &status, 0 ) );
+    BOOST_CHECK( WIFSIGNALED( status ) && WTERMSIG( status ) == SIGABRT );
+
+    thread.async([p]{ p->release(); }).wait();
+    thread.quit();
+}
+#endif
+
 BOOST_AUTO_TEST_SUITE_END()
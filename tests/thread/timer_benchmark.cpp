@@ -0,0 +1,87 @@
+/*
+ * Compares the timer backends of fc::thread.
+ *
+ * usage: timer_benchmark [timers]
+ */
+#include <fc/thread/thread.hpp>
+#include <fc/exception/exception.hpp>
+
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+namespace {
+
+   struct result
+   {
+      double schedule_us;
+      double cancel_us;
+      double expire_us;
+   };
+
+   double elapsed_us( const fc::time_point& start )
+   {
+      return double( (fc::time_point::now() - start).count() );
+   }
+
+   /** All timers are created, canceled and expired inside of the thread that owns them */
+   result run( fc::timer_backend backend, size_t timers )
+   {
+      fc::set_default_timer_backend( backend );
+      fc::thread thread( "timer_benchmark" );
+      fc::set_default_timer_backend( fc::timer_backend::heap );
+
+      result r = thread.async( [timers] () {
+         std::mt19937 rng( 42 );
+         std::uniform_int_distribution<int64_t> far( 60, 3600 );
+         std::uniform_int_distribution<int64_t> near( 1, 200 );
+         result r;
+
+         // per-connection timeouts: almost all of them are canceled before they expire
+         std::vector<fc::future<void>> pending;
+         pending.reserve( timers );
+         fc::time_point start = fc::time_point::now();
+         for( size_t i = 0; i < timers; ++i )
+            pending.push_back( fc::schedule( [] () {}, start + fc::seconds( far( rng ) ), "timeout" ) );
+         fc::yield(); // moves the new tasks from the incoming queue to the timers
+         r.schedule_us = elapsed_us( start );
+
+         start = fc::time_point::now();
+         for( auto& f : pending )
+            f.cancel();
+         fc::yield(); // the heap removes canceled tasks only when the thread is idle
+         for( auto& f : pending )
+            try { f.wait(); } catch( const fc::canceled_exception& ) {}
+         r.cancel_us = elapsed_us( start );
+         pending.clear();
+
+         // short timers that do expire
+         start = fc::time_point::now();
+         for( size_t i = 0; i < timers; ++i )
+            pending.push_back( fc::schedule( [] () {}, start + fc::milliseconds( near( rng ) ), "tick" ) );
+         for( auto& f : pending )
+            f.wait();
+         r.expire_us = elapsed_us( start );
+         return r;
+      }, "timer_benchmark" ).wait();
+
+      thread.quit();
+      return r;
+   }
+
+   void print( const char* name, const result& r, size_t timers )
+   {
+      std::cout << name << ": schedule " << r.schedule_us / timers << " us/timer, "
+                << "cancel " << r.cancel_us / timers << " us/timer, "
+                << "schedule+expire within 200ms " << r.expire_us / 1000 << " ms total\n";
+   }
+}
+
+int main( int argc, char** argv )
+{
+   const size_t timers = argc > 1 ? std::strtoul( argv[1], nullptr, 10 ) : 100000;
+   print( "heap        ", run( fc::timer_backend::heap, timers ), timers );
+   print( "timing wheel", run( fc::timer_backend::timing_wheel, timers ), timers );
+   return 0;
+}
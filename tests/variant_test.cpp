@@ -2,9 +2,12 @@
 #include <fc/log/logger.hpp>
 
 #include <fc/container/flat.hpp>
+#include <fc/io/json.hpp>
 #include <fc/io/raw.hpp>
 #include <fc/reflect/variant.hpp>
 #include <fc/static_variant.hpp>
+#include <fc/thread/thread.hpp>
+#include <fc/variant_arena.hpp>
 #include <fc/log/logger_config.hpp>
 
 namespace fc { namespace test {
@@ -39,10 +42,59 @@ namespace fc { namespace test {
    { return ( std::tie( a.level, a.w ) < std::tie( b.level, b.w ) ); }
 
 
+   struct base_record
+   {
+      int32_t     id = 0;
+      std::string name;
+   };
+
+   struct record : base_record
+   {
+      fc::optional<std::string> memo;
+      int32_t                   id = 0; // repeats a name of the base
+   };
+
+   struct call
+   {
+      std::string                              method;
+      fc::variants                             params;
+      std::vector<base_record>                 records;
+      fc::optional<std::string>                memo;
+      fc::static_variant<int32_t, std::string> tag;
+      std::map<std::string, std::string>       labels;
+   };
+
+   struct hand_reflected
+   {
+      int64_t     number = 0;
+      std::string text;
+   };
+
 } } // namespace fc::test
 
+namespace fc {
+   // a reflector written by hand, without the member table of FC_REFLECT
+   template<>
+   struct reflector<fc::test::hand_reflected>
+   {
+      typedef fc::test::hand_reflected type;
+      typedef fc::true_type is_defined;
+      typedef fc::false_type is_enum;
+
+      template<typename Visitor>
+      static void visit( const Visitor& v )
+      {
+         v.template operator()<int64_t, type, &type::number>( "number" );
+         v.template operator()<std::string, type, &type::text>( "text" );
+      }
+   };
+}
+
 FC_REFLECT( fc::test::item_wrapper, (v) );
 FC_REFLECT( fc::test::item, (level)(w) );
+FC_REFLECT( fc::test::base_record, (id)(name) );
+FC_REFLECT_DERIVED( fc::test::record, (fc::test::base_record), (memo)(id) );
+FC_REFLECT( fc::test::call, (method)(params)(records)(memo)(tag)(labels) );
 
 BOOST_AUTO_TEST_SUITE(fc_variant_and_log)
 
@@ -95,6 +147,275 @@ BOOST_AUTO_TEST_CASE( types_edge_cases_test )
 }
 
 
+BOOST_AUTO_TEST_CASE( strings_test )
+{
+   for( const std::string& str : { std::string(), std::string( "1234" ), std::string( 14, 'x' ),
+                                  std::string( 100, 'z' ), std::string( "a\0b", 3 ),
+                                  std::string( "tab\t\"quote\"" ) } )
+   {
+      fc::variant v( str );
+      BOOST_CHECK( v.is_string() );
+      BOOST_CHECK_EQUAL( fc::variant::string_type, v.get_type() );
+      BOOST_CHECK_EQUAL( str, v.get_string() );
+      BOOST_CHECK_EQUAL( str, v.as_string() );
+
+      // get_string() refers to the string of the variant, which moves along with it
+      const std::string& ref = v.get_string();
+      BOOST_CHECK_EQUAL( &ref, &v.get_string() );
+      fc::variant moved( std::move( v ) );
+      BOOST_CHECK( v.is_null() );
+      BOOST_CHECK_EQUAL( &ref, &moved.get_string() );
+      v = std::move( moved );
+      BOOST_CHECK_EQUAL( &ref, &v.get_string() );
+
+      fc::variant copy( v );
+      BOOST_CHECK_EQUAL( str, copy.get_string() );
+      BOOST_CHECK( &copy.get_string() != &ref );
+      fc::variant assigned( 42 );
+      assigned = copy;
+      BOOST_CHECK_EQUAL( str, assigned.get_string() );
+      copy = fc::variant( 1.5 );
+      BOOST_CHECK( copy.is_double() );
+      BOOST_CHECK( ( v == assigned ).as_bool() );
+
+      if( str.find( '\0' ) == std::string::npos ) // the legacy parser does not decode \u0000
+         BOOST_CHECK_EQUAL( str, fc::json::from_string( fc::json::to_string( v ) ).get_string() );
+      BOOST_CHECK_EQUAL( str.size(), v.as_blob().data.size() );
+   }
+
+   BOOST_CHECK_EQUAL( 1234, fc::variant( "1234" ).as_int64() );
+   BOOST_CHECK_EQUAL( 1234u, fc::variant( "1234" ).as_uint64() );
+   BOOST_CHECK_EQUAL( 12.5, fc::variant( "12.5" ).as_double() );
+   BOOST_CHECK( fc::variant( "true" ).as_bool() );
+   BOOST_CHECK_EQUAL( "short", fc::variant( L"short" ).get_string() );
+   BOOST_CHECK_EQUAL( "somewhat longer wide string", fc::variant( L"somewhat longer wide string" ).get_string() );
+}
+
+BOOST_AUTO_TEST_CASE( variant_arena_test )
+{
+   const std::string long_string( 100, 'l' );
+   fc::variant escaped;
+   fc::variant sent;
+   {
+      fc::variant_arena arena( 1024 );
+      const fc::variant parsed = fc::json::from_string(
+            "{\"a\":[1,\"a string of some length\",{\"b\":null}],\"c\":\"" + long_string + "\"}" );
+      {
+         fc::variant_arena inner;
+         fc::variants values;
+         for( int i = 0; i < 100; ++i ) // fills more than one block
+            values.emplace_back( fc::mutable_variant_object( "i", i )( "s", long_string ) );
+         sent = values;
+      }
+      escaped = parsed["a"];
+      BOOST_CHECK_EQUAL( long_string, parsed["c"].get_string() );
+   }
+   BOOST_REQUIRE_EQUAL( 3u, escaped.size() );
+   BOOST_CHECK_EQUAL( "a string of some length", escaped[1].get_string() );
+   BOOST_CHECK( escaped[2].get_object()["b"].is_null() );
+
+   // copies made outside of the arena come from the heap, and values of both kinds mix
+   fc::variant copied = escaped;
+   fc::variants mixed = copied.get_array();
+   mixed.push_back( std::move( escaped ) );
+   BOOST_CHECK( escaped.is_null() );
+   mixed[0] = mixed[3][2];
+   mixed[3] = fc::variant( long_string );
+   BOOST_CHECK( mixed[0].get_object()["b"].is_null() );
+   BOOST_CHECK_EQUAL( long_string, mixed[3].get_string() );
+   BOOST_CHECK_EQUAL( "a string of some length", copied[1].get_string() );
+
+   // values from an arena may die on another thread
+   fc::thread other( "variant_arena_test" );
+   other.async( [&sent] () {
+      BOOST_CHECK_EQUAL( 100u, sent.size() );
+      sent = fc::variant();
+   } ).wait();
+   BOOST_CHECK( sent.is_null() );
+
+   // an arena serves only its own fiber
+   fc::variant_arena arena;
+   fc::variant from_other_fiber;
+   fc::async( [&from_other_fiber,&long_string] () { from_other_fiber = long_string; } ).wait();
+   BOOST_CHECK_EQUAL( long_string, from_other_fiber.get_string() );
+}
+
+BOOST_AUTO_TEST_CASE( object_key_index_test )
+{
+   fc::mutable_variant_object mvo;
+   for( int i = 0; i < 60; ++i )
+      mvo( "key" + std::to_string( i ), i );
+   mvo( "key7", "duplicate" ); // the first one is found, as before
+   mvo.set( "key59", 590 );
+   mvo["key60"] = 60;
+   mvo.erase( "key3" );
+   BOOST_CHECK_EQUAL( 61u, mvo.size() );
+   BOOST_CHECK_EQUAL( 7, mvo["key7"].as_int64() );
+   BOOST_CHECK_EQUAL( 590, mvo["key59"].as_int64() );
+   BOOST_CHECK_EQUAL( 60, mvo["key60"].as_int64() );
+   BOOST_CHECK( mvo.find( "key3" ) == mvo.end() );
+   BOOST_CHECK( mvo.find( "key4" ) != mvo.end() );
+
+   const fc::variant_object copied( mvo );
+   const fc::mutable_variant_object moved_from( mvo );
+   const fc::variant_object moved( fc::mutable_variant_object{ moved_from } );
+   for( const fc::variant_object* vo : { &copied, &moved } )
+   {
+      BOOST_CHECK_EQUAL( 61u, vo->size() );
+      for( int i = 0; i <= 60; ++i )
+      {
+         const std::string key = "key" + std::to_string( i );
+         if( i == 3 )
+            BOOST_CHECK( vo->find( key ) == vo->end() );
+         else
+            BOOST_CHECK_EQUAL( i == 59 ? 590 : i, ( *vo )[key].as_int64() );
+      }
+      BOOST_CHECK( !vo->contains( "key61" ) );
+   }
+
+   // copies share the index of the original
+   const fc::variant_object shared( copied );
+   BOOST_CHECK_EQUAL( 42, shared["key42"].as_int64() );
+
+   // changes made through iterators are seen by later lookups
+   fc::mutable_variant_object changed( copied );
+   for( auto& e : changed )
+      if( e.key() == "key10" )
+         e = fc::variant_object::entry( "renamed", 10 );
+   BOOST_CHECK( changed.find( "key10" ) == changed.end() );
+   BOOST_CHECK_EQUAL( 10, changed["renamed"].as_int64() );
+
+   // lookups stay right while an object grows past the size that gets an index, and shrinks again
+   fc::mutable_variant_object growing;
+   auto check_keys = []( const fc::mutable_variant_object& o, int first, int last ) {
+      BOOST_CHECK_EQUAL( size_t( last - first ), o.size() );
+      for( int i = 0; i < 24; ++i )
+      {
+         const std::string key = "key" + std::to_string( i );
+         if( i >= first && i < last )
+            BOOST_CHECK_EQUAL( i, o[key].as_int64() );
+         else
+            BOOST_CHECK( o.find( key ) == o.end() );
+      }
+   };
+   for( int i = 0; i < 20; ++i )
+   {
+      growing( "key" + std::to_string( i ), i );
+      check_keys( growing, 0, i + 1 );
+   }
+   const fc::mutable_variant_object growing_copy( growing );
+   check_keys( growing_copy, 0, 20 );
+   fc::mutable_variant_object growing_moved{ fc::mutable_variant_object( fc::variant_object( growing ) ) };
+   check_keys( growing_moved, 0, 20 );
+
+   // entries changed through begin() are found under their new keys
+   *growing.begin() = fc::variant_object::entry( "key20", 20 );
+   check_keys( growing, 1, 21 );
+
+   for( int i = 1; i < 18; ++i )
+   {
+      growing.erase( "key" + std::to_string( i ) );
+      check_keys( growing, i + 1, 21 );
+   }
+   growing_moved = std::move( growing );
+   check_keys( growing_moved, 18, 21 );
+   check_keys( growing_copy, 0, 20 );
+}
+
+BOOST_AUTO_TEST_CASE( hand_written_reflector_test )
+{
+   using namespace fc::test;
+   static_assert( !fc::detail::has_member_table<hand_reflected>::value, "visit() only" );
+
+   hand_reflected h;
+   h.number = 42;
+   h.text = "some text";
+   const fc::variant v( h, 2 );
+   BOOST_CHECK_EQUAL( 42, v["number"].as_int64() );
+
+   const hand_reflected copied = v.as<hand_reflected>( 2 );
+   BOOST_CHECK_EQUAL( 42, copied.number );
+   BOOST_CHECK_EQUAL( h.text, copied.text );
+   const hand_reflected moved = fc::variant( v ).as<hand_reflected>( 2 );
+   BOOST_CHECK_EQUAL( h.text, moved.text );
+   const hand_reflected read = fc::json::from_string<hand_reflected>( fc::json::to_string( v ),
+                                                                      fc::json::legacy_parser, 2 );
+   BOOST_CHECK_EQUAL( 42, read.number );
+   BOOST_CHECK_EQUAL( h.text, read.text );
+}
+
+BOOST_AUTO_TEST_CASE( reflected_members_test )
+{
+   using namespace fc::test;
+   static_assert( fc::reflector<record>::member_count() == 4, "the members of the base are counted" );
+
+   const fc::reflected_member_table& members = fc::reflector<record>::members();
+   BOOST_REQUIRE_EQUAL( 4u, members.size() );
+   const char* names[] = { "id", "name", "memo", "id" };
+   for( size_t i = 0; i < members.size(); ++i )
+   {
+      BOOST_CHECK_EQUAL( names[i], members[i].name );
+      BOOST_CHECK_EQUAL( strlen( names[i] ), members[i].length );
+      BOOST_CHECK_EQUAL( fc::reflected_name_hash( names[i], strlen( names[i] ) ), members[i].hash );
+   }
+   BOOST_CHECK_EQUAL( 0u, members.index_of( "id" ) );
+   BOOST_CHECK_EQUAL( 2u, members.index_of( "memo" ) );
+   BOOST_CHECK_EQUAL( 4u, members.index_of( "mem" ) );
+   BOOST_CHECK_EQUAL( 0u, members.first_index( 3 ) );
+   BOOST_CHECK_EQUAL( 1u, members.first_index( 1 ) );
+   BOOST_CHECK_EQUAL( &members, &fc::reflector<record>::members() );
+
+   record r;
+   fc::from_variant( fc::mutable_variant_object( "name", "n" )( "unknown", 1 )( "id", 7 )( "id", 8 ), r, 2 );
+   BOOST_CHECK_EQUAL( 7, r.base_record::id );
+   BOOST_CHECK_EQUAL( 7, r.id );
+   BOOST_CHECK_EQUAL( "n", r.name );
+   BOOST_CHECK( !r.memo.valid() );
+   fc::from_variant( fc::mutable_variant_object( "memo", "m" ), r, 2 );
+   BOOST_CHECK_EQUAL( "m", *r.memo );
+   BOOST_CHECK_EQUAL( "n", r.name );
+}
+
+BOOST_AUTO_TEST_CASE( moving_conversion_test )
+{
+   using namespace fc::test;
+   const std::string text( 100, 'x' );
+   const fc::variant rec = fc::mutable_variant_object( "id", 1 )( "name", text );
+   fc::variant source = fc::mutable_variant_object( "method", text )
+                           ( "params", fc::variants{ text, 2, fc::variants{ text } } )
+                           ( "records", fc::variants{ rec, rec } )
+                           ( "memo", text )
+                           ( "tag", fc::variants{ 1, text } )
+                           ( "labels", fc::variants{ fc::variants{ "key", text } } )
+                           ( "unknown", text );
+   const std::string original = fc::json::to_string( source );
+   auto as_json = []( const call& c ) { return fc::json::to_string( fc::variant( c, 10 ) ); };
+   const std::string expected = as_json( source.as<call>( 10 ) );
+
+   // the entries of a shared object are left alone
+   fc::variant shared( source );
+   BOOST_CHECK_EQUAL( expected, as_json( std::move( source ).as<call>( 10 ) ) );
+   BOOST_CHECK_EQUAL( original, fc::json::to_string( shared ) );
+
+   // those of an object of its own are taken over
+   source = fc::variant();
+   const fc::variant* first_param = &shared["params"].get_array()[0];
+   const call moved = std::move( shared ).as<call>( 10 );
+   BOOST_CHECK_EQUAL( expected, as_json( moved ) );
+   BOOST_CHECK_EQUAL( first_param, &moved.params[0] );
+
+   // members that share a name share the value
+   const record r = fc::variant( fc::mutable_variant_object( "id", 7 )( "name", text )( "memo", text ) ).as<record>( 2 );
+   BOOST_CHECK_EQUAL( 7, r.base_record::id );
+   BOOST_CHECK_EQUAL( 7, r.id );
+   BOOST_CHECK_EQUAL( text, r.name );
+   BOOST_CHECK_EQUAL( text, *r.memo );
+
+   BOOST_CHECK_EQUAL( text, fc::variant( text ).as<std::string>( 1 ) );
+   BOOST_CHECK_THROW( fc::variant( 1 ).as<call>( 10 ), fc::bad_cast_exception );
+   BOOST_CHECK_THROW( fc::variant( fc::mutable_variant_object( "records", fc::variants{ rec } ) ).as<call>( 1 ), fc::assert_exception );
+}
+
 BOOST_AUTO_TEST_CASE( nested_objects_test )
 { try {
 